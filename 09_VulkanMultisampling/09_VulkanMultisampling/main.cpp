@@ -1,14 +1,27 @@
-#define NOMINMAX
-
 #define GLFW_INCLUDE_VULKAN
+#ifdef _WIN32
+#define NOMINMAX
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <vector>
 #include <optional>
@@ -18,6 +31,28 @@
 #include <array>
 #include <chrono>
 #include <unordered_map>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <charconv>
+#include <unordered_set>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLING_SSE
+#define MIP_GENERATOR_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -26,6 +61,20 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+// stb_image allocates through ImageDecoder, which can hand it the caller's memory as the buffer it decodes into
+void* DecoderMalloc(size_t size);
+void* DecoderRealloc(void* pointer, size_t size);
+void DecoderFree(void* pointer);
+
+#define STBI_MALLOC(size) DecoderMalloc(size)
+#define STBI_REALLOC(pointer, size) DecoderRealloc(pointer, size)
+#define STBI_FREE(pointer) DecoderFree(pointer)
+
+// the SSE2 JPEG paths are on by default, NEON has to be asked for
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define STBI_NEON
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
@@ -43,6 +92,9 @@ struct QueueFamilyIndex
 	std::optional<uint32_t> graphic;
 	std::optional<uint32_t> present;
 
+	// a family that supports transfers but not graphics, only set when the device has one
+	std::optional<uint32_t> transfer;
+
 	bool IsComplete()
 	{
 		return graphic.has_value() && present.has_value();
@@ -56,6 +108,16 @@ struct SwapChainSupport
 	std::vector<VkPresentModeKHR> modes;
 };
 
+// maps the normalised vertex attributes of a compact layout back to model space, identity for float layouts
+struct VertexQuantization
+{
+	glm::vec3 PositionCenter = glm::vec3(0.0f);
+	glm::vec3 PositionExtent = glm::vec3(1.0f);
+	glm::vec2 TexCoordScale = glm::vec2(1.0f);
+	glm::vec2 TexCoordOffset = glm::vec2(0.0f);
+};
+
+// full precision vertex, every processing step works on this and each vertex layout is encoded from it
 struct Vertex
 {
 	glm::vec3 position;
@@ -104,6 +166,26 @@ struct Vertex
 	{
 		return position == other.position && TexCoord == other.TexCoord && color == other.color;
 	}
+
+	// the full precision layout is uploaded as is
+
+	static const uint32_t LayoutId = 1;
+
+	// the single texture variant reads no draw records and leaves out the shader draw parameters
+	static const char* GetVertexShaderPath(bool bindless)
+	{
+		return bindless ? "shaders/vert.spv" : "shaders/vert_single.spv";
+	}
+
+	static VertexQuantization GetQuantization(const std::vector<Vertex>& vertices)
+	{
+		return VertexQuantization();
+	}
+
+	static Vertex Encode(const Vertex& vertex, const VertexQuantization& quantization)
+	{
+		return vertex;
+	}
 };
 
 namespace std
@@ -117,2262 +199,10148 @@ namespace std
 	};
 }
 
-struct UniformBufferObject
+// 12 byte vertex, snorm16 positions relative to the mesh bounds and unorm16 texture coordinates relative to their
+// bounds, the model has no per vertex colour so that stream is dropped
+struct QuantizedVertex
 {
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 proj;
-};
+	int16_t position[4];
+	uint16_t TexCoord[2];
 
-class VulkanApplication
-{
-public:
-	void run()
+	static const uint32_t LayoutId = 2;
+
+	static const char* GetVertexShaderPath(bool bindless)
 	{
-		InitWindow();
-		InitVulkan();
-		MainLoop();
-		cleanup();
+		return bindless ? "shaders/vert_quantized.spv" : "shaders/vert_quantized_single.spv";
 	}
 
-private:
-	// glfw
-	GLFWwindow* window;
-	const int WindowWidth = 800;
-	const int WindowHeight = 600;
-	const char* WindowTitle = "Vulkan Tutorial 09 : Multisampling";
-
-	const std::string ModelPath = "models/chalet.obj";
-	const std::string TexturePath = "textures/chalet.jpg";
-
-	void InitWindow()
+	static VkVertexInputBindingDescription GetBindingDescription()
 	{
-		glfwInit();
-
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // we don't need to create an OpenGL context
-		// glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-
-		window = glfwCreateWindow(WindowWidth, WindowHeight, WindowTitle, nullptr, nullptr);
+		VkVertexInputBindingDescription BindingDescription = {
+			0,							// binding
+			sizeof(QuantizedVertex),	// stride
+			VK_VERTEX_INPUT_RATE_VERTEX	// inputRate
+		};
 
-		glfwSetWindowUserPointer(window, this);
-		glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+		return BindingDescription;
 	}
 
-	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+	static std::array<VkVertexInputAttributeDescription, 2> GetAttributeDescriptions()
 	{
-		auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
-		app->FramebufferResized = true;
-	}
-
-	// vulkan
-	const std::vector<const char*> layers = { "VK_LAYER_LUNARG_standard_validation" };
-	VkInstance instance;
-	VkSurfaceKHR surface;
-	VkDebugUtilsMessengerEXT messenger;
-	VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+		// three component 16 bit formats are rarely supported for vertex buffers, the fourth component is padding
+		VkVertexInputAttributeDescription PositionDescription = {
+			0,									// location
+			0,									// binding
+			VK_FORMAT_R16G16B16A16_SNORM,		// format
+			offsetof(QuantizedVertex, position)	// offset
+		};
 
-	// MSAA
-	VkSampleCountFlagBits SampleCount = VK_SAMPLE_COUNT_1_BIT;
-	VkImage ColorImage;
-	VkDeviceMemory ColorImageMemory;
-	VkImageView ColorImageView;
+		VkVertexInputAttributeDescription TexCoordDescription = {
+			1,									// location
+			0,									// binding
+			VK_FORMAT_R16G16_UNORM,				// format
+			offsetof(QuantizedVertex, TexCoord)	// offset
+		};
 
-	const std::vector<const char*> extentions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-	VkDevice device;
-	VkQueue GraphicQueue;
-	VkQueue PresentQueue;
+		std::array<VkVertexInputAttributeDescription, 2> AttributeDescriptions = { PositionDescription, TexCoordDescription };
+		return AttributeDescriptions;
+	}
 
-	VkSwapchainKHR SwapChain;
-	std::vector<VkImage> SwapChainImages;
-	VkFormat SwapChainFormat;
-	VkExtent2D SwapChainExtent;
-	std::vector<VkImageView> SwapChainImageViews;
+	static VertexQuantization GetQuantization(const std::vector<Vertex>& vertices)
+	{
+		VertexQuantization quantization;
 
-	VkRenderPass RenderPass;
-	VkPipelineLayout PipelineLayout;
-	VkDescriptorSetLayout DescriptorSetLayout;
-	VkPipeline GraphicsPipeline;
+		if (vertices.empty())
+		{
+			return quantization;
+		}
 
-	std::vector<VkFramebuffer> SwapChainFramebuffers;
+		glm::vec3 PositionMin = vertices[0].position;
+		glm::vec3 PositionMax = vertices[0].position;
+		glm::vec2 TexCoordMin = vertices[0].TexCoord;
+		glm::vec2 TexCoordMax = vertices[0].TexCoord;
 
-	VkCommandPool CommandPool;
-	std::vector<VkCommandBuffer> CommandBuffers;
+		for (const Vertex& vertex : vertices)
+		{
+			PositionMin = glm::min(PositionMin, vertex.position);
+			PositionMax = glm::max(PositionMax, vertex.position);
+			TexCoordMin = glm::min(TexCoordMin, vertex.TexCoord);
+			TexCoordMax = glm::max(TexCoordMax, vertex.TexCoord);
+		}
 
-	const int MAX_FRAMES_IN_FLIGHT = 2;
-	size_t CurrentFrame = 0;
-	std::vector<VkSemaphore> ImageAvailableSemaphore;
-	std::vector<VkSemaphore> RenderFinishedSemaphore;
-	std::vector<VkFence> fences;
+		// flat axes still need a non zero range to divide by
+		quantization.PositionCenter = (PositionMin + PositionMax) * 0.5f;
+		quantization.PositionExtent = glm::max((PositionMax - PositionMin) * 0.5f, glm::vec3(1e-6f));
+		quantization.TexCoordScale = glm::max(TexCoordMax - TexCoordMin, glm::vec2(1e-6f));
+		quantization.TexCoordOffset = TexCoordMin;
 
-	bool FramebufferResized = false;
+		return quantization;
+	}
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	static QuantizedVertex Encode(const Vertex& vertex, const VertexQuantization& quantization)
+	{
+		glm::vec3 position = (vertex.position - quantization.PositionCenter) / quantization.PositionExtent;
+		glm::vec2 TexCoord = (vertex.TexCoord - quantization.TexCoordOffset) / quantization.TexCoordScale;
 
-	VkBuffer VertexBuffer;
-	VkDeviceMemory VertexBufferMemory;
-	VkBuffer IndexBuffer;
-	VkDeviceMemory IndexBufferMemory;
+		QuantizedVertex result = {};
 
-	std::vector<VkBuffer> UniformBuffers;
-	std::vector<VkDeviceMemory> UniformBuffersMemory;
+		for (int i = 0; i < 3; i++)
+		{
+			result.position[i] = static_cast<int16_t>(std::lround(std::min(std::max(position[i], -1.0f), 1.0f) * 32767.0f));
+		}
 
-	VkDescriptorPool DescriptorPool;
-	std::vector<VkDescriptorSet> DescriptorSets;
+		for (int i = 0; i < 2; i++)
+		{
+			result.TexCoord[i] = static_cast<uint16_t>(std::lround(std::min(std::max(TexCoord[i], 0.0f), 1.0f) * 65535.0f));
+		}
 
-	uint32_t MipLevels;
-	VkImage TextureImage;
-	VkDeviceMemory TextureImageMemory;
-	VkImageView TextureImageView;
-	VkSampler TextureSampler;
+		return result;
+	}
+};
 
-	VkImage DepthImage;
-	VkDeviceMemory DepthImageMemory;
-	VkImageView DepthImageView;
+// per instance data streamed from the second vertex binding, also read as std430 by the culling shader
+struct InstanceData
+{
+	glm::mat4 transform;
 
-	void InitVulkan()
+	static VkVertexInputBindingDescription GetBindingDescription()
 	{
-		CreateInstance();
-		SetupDebugMessenger();
-		CreateSurface();
-		PickPhysicalDevice();
-		CreateLogicalDevice();
-		CreateSwapchain();
-		CreateImageViews();
-		CreateRenderPass();
-		CreateDescriptorSetLayout();
-		CreateGraphicsPipeline();
-		CreateCommandPool();
-		CreateColorResources();
-		CreateDepthResources();
-		CreateFramebuffers();
-		CreateTextureImage();
-		CreateTextureImageView();
-		CreateTextureSampler();
-		LoadModel();
-		CreateVertexBuffer();
-		CreateIndexBuffer();
-		CreateUniformBuffers();
-		CreateDescriptorPool();
-		CreateDescriptorSets();
-		CreateCommandBuffers();
-		CreateSemaphoresAndFences();
+		VkVertexInputBindingDescription BindingDescription = {
+			1,								// binding
+			sizeof(InstanceData),			// stride
+			VK_VERTEX_INPUT_RATE_INSTANCE	// inputRate
+		};
+
+		return BindingDescription;
 	}
 
-	void DisplayAvailableLayers()
+	// a matrix attribute takes one location per column, after the ones any vertex layout uses
+	static std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescriptions()
 	{
-		uint32_t count = 0;
-		vkEnumerateInstanceLayerProperties(&count, nullptr);
-
-		std::vector<VkLayerProperties> properties(count);
-		vkEnumerateInstanceLayerProperties(&count, properties.data());
+		std::array<VkVertexInputAttributeDescription, 4> AttributeDescriptions;
 
-		if (count != 0)
+		for (uint32_t column = 0; column < 4; column++)
 		{
-			std::cout << "--- Instance Layer Properties ---" << std::endl;
+			VkVertexInputAttributeDescription ColumnDescription = {
+				3 + column,											// location
+				1,													// binding
+				VK_FORMAT_R32G32B32A32_SFLOAT,						// format
+				offsetof(InstanceData, transform) + column * 16		// offset
+			};
 
-			for (VkLayerProperties property : properties)
-			{
-				std::cout << property.layerName << std::endl;
-			}
+			AttributeDescriptions[column] = ColumnDescription;
 		}
+
+		return AttributeDescriptions;
 	}
+};
 
-	void DisplayAvailableExtensions()
-	{
-		uint32_t count = 0;
-		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+// the cache stores the final vertex and index arrays right after this header
+struct MeshCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t SourceHash;
+	uint32_t VertexSize;
+	uint32_t IndexSize;
+	uint64_t VertexCount;
+	uint64_t IndexCount;
+
+	// the optional optimisation passes that were run, a cache built with other options is stale
+	uint32_t processing;
+
+	// the vertex layout the vertices are encoded in and how to decode them
+	uint32_t layout;
+	float PositionCenter[3];
+	float PositionExtent[3];
+	float TexCoordScale[2];
+	float TexCoordOffset[2];
+
+	// the MeshLevel array comes first, then the MeshChunk and MeshMaterial arrays, then the vertices, then the indices of
+	// IndexSize bytes each
+	uint64_t ChunkCount;
+	uint32_t LevelCount;
+
+	// the level of detail settings the chain was built with
+	uint32_t LodLevels;
+	float LodRatio;
+	float LodError;
+
+	// bounding sphere of the mesh in model units
+	float BoundsCenter[3];
+	float BoundsRadius;
+
+	// materials the chunks index
+	uint32_t MaterialCount;
+};
 
-		std::vector<VkExtensionProperties> properties(count);
-		vkEnumerateInstanceExtensionProperties(nullptr, &count, properties.data());
+// a material as the mesh cache stores it, material 0 is the one of the faces without a usemtl record
+struct MeshMaterial
+{
+	float diffuse[4];
 
-		if (count != 0)
-		{
-			std::cout << "--- Instance Extension Properties ---" << std::endl;
+	// the diffuse map relative to the working directory, empty when the material has none
+	char texture[252];
+};
 
-			for (VkExtensionProperties property : properties)
-			{
-				std::cout << property.extensionName << std::endl;
-			}
-		}
-	}
+// bump whenever the vertex layout or the way the model is processed changes
+const char MeshCacheMagic[4] = { 'M', 'E', 'S', 'H' };
+const uint32_t MeshCacheVersion = 7;
 
-	void CreateInstance()
+const uint32_t MeshProcessingOverdraw = 1 << 0;
+const uint32_t MeshProcessingIndexSplit = 1 << 1;
+
+// read only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
 	{
-		VkResult result;
+		Close();
+	}
 
-		// glfw extensions
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount); // VK_KHR_surface, VK_KHR_win32_surface
+	bool Open(const std::string& path)
+	{
+		Close();
 
-		std::vector<const char*> extensions(glfwExtensionNames, glfwExtensionNames + glfwExtensionCount);
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
 
-		if (EnableValidationLayer)
+		if (file == INVALID_HANDLE_VALUE)
 		{
-			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			return false;
 		}
 
-		VkInstanceCreateInfo InstanceCreateInfo =
+		LARGE_INTEGER FileSize;
+
+		// an empty file can not be mapped
+		if (!GetFileSizeEx(file, &FileSize) || FileSize.QuadPart == 0)
 		{
-			VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,				// sType
-			nullptr,											// pNext
-			0,													// flags
-			nullptr,											// pApplicationInfo
-			EnableValidationLayer ? layers.size() : 0,			// enabledLayerCount
-			EnableValidationLayer ? layers.data() : nullptr,	// ppEnabledLayerNames
-			static_cast<uint32_t>(extensions.size()),			// enabledExtensionCount
-			extensions.data()									// ppEnabledExtensionNames
-		};
+			Close();
+			return false;
+		}
 
-		result = vkCreateInstance(&InstanceCreateInfo, nullptr, &instance);
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
 
-		if (result != VK_SUCCESS)
+		if (mapping == nullptr)
 		{
-			std::string message;
+			Close();
+			return false;
+		}
 
-			switch (result)
-			{
-			case VK_ERROR_EXTENSION_NOT_PRESENT:
-				message = "VK_ERROR_EXTENSION_NOT_PRESENT";
-				break;
-			case VK_ERROR_LAYER_NOT_PRESENT:
-				message = "VK_ERROR_LAYER_NOT_PRESENT";
-				break;
-			default:
-				message = "failed to create instance";
-				break;
-			}
+		address = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
 
-			throw std::runtime_error(message);
+		if (address == nullptr)
+		{
+			Close();
+			return false;
 		}
-	}
 
-	VkResult vkCreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pMessenger)
-	{
-		PFN_vkCreateDebugUtilsMessengerEXT func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-		// PFN_vkCreateDebugUtilsMessengerEXT func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT> (vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+		length = static_cast<size_t>(FileSize.QuadPart);
+#else
+		int descriptor = open(path.c_str(), O_RDONLY);
 
-		if (func != nullptr)
+		if (descriptor < 0)
 		{
-			return func(instance, pCreateInfo, pAllocator, pMessenger);
+			return false;
 		}
-		else
+
+		struct stat status;
+
+		// an empty file can not be mapped
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0)
 		{
-			return VK_ERROR_EXTENSION_NOT_PRESENT;
+			close(descriptor);
+			return false;
 		}
-	}
 
-	void vkDestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT pMessenger, const VkAllocationCallbacks* pAllocator)
-	{
-		PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+		void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
 
-		if (func != nullptr)
+		// the mapping keeps its own reference to the file
+		close(descriptor);
+
+		if (mapped == MAP_FAILED)
 		{
-			func(instance, pMessenger, pAllocator);
+			return false;
 		}
-	}
 
-	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
-	{
-		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-		return VK_FALSE;
+		address = static_cast<const char*>(mapped);
+		length = static_cast<size_t>(status.st_size);
+#endif
+
+		return true;
 	}
 
-	void SetupDebugMessenger()
+	void Close()
 	{
-		VkResult result;
-
-		if (EnableValidationLayer)
+#ifdef _WIN32
+		if (address != nullptr)
 		{
-			VkDebugUtilsMessageSeverityFlagsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-			// VkDebugUtilsMessageSeverityFlagsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-			VkDebugUtilsMessageTypeFlagsEXT type = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+			UnmapViewOfFile(address);
+		}
 
-			VkDebugUtilsMessengerCreateInfoEXT DebugUtilsMessengerCreateInfo = {
-				VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,	// sType
-				nullptr,													// pNext
-				0,															// flags
-				severity,													// messageSeverity
-				type,														// messageType
-				DebugCallback,												// pfnUserCallback
-				nullptr														// pUserData
-			};
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
 
-			result = vkCreateDebugUtilsMessengerEXT(instance, &DebugUtilsMessengerCreateInfo, nullptr, &messenger);
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
 
-			if (result != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to set up debug messenger");
-			}
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (address != nullptr)
+		{
+			munmap(const_cast<char*>(address), length);
 		}
+#endif
+
+		address = nullptr;
+		length = 0;
 	}
 
-	VkSampleCountFlagBits GetMaxUsableSampleCount()
+	bool IsOpen() const
 	{
-		VkPhysicalDeviceProperties PhysicalDeviceProperties;
-		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+		return address != nullptr;
+	}
 
-		VkSampleCountFlags SampleCount = std::min(PhysicalDeviceProperties.limits.framebufferColorSampleCounts, PhysicalDeviceProperties.limits.framebufferDepthSampleCounts);
+	const char* GetData() const
+	{
+		return address;
+	}
 
-		switch (SampleCount)
+	size_t GetSize() const
+	{
+		return length;
+	}
+
+private:
+	const char* address = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// writes a file through a temporary next to it that replaces the file once it is complete, so readers and an
+// interrupted run only ever see the old or the new contents, never a truncated file
+static bool WriteFileReplacing(const std::string& path, const std::function<void(std::ostream&)>& write)
+{
+	std::string TemporaryPath = path + ".tmp";
+
+	{
+		std::ofstream file(TemporaryPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
 		{
-		case VK_SAMPLE_COUNT_64_BIT:
-			return VK_SAMPLE_COUNT_64_BIT;
-		case VK_SAMPLE_COUNT_32_BIT:
-			return VK_SAMPLE_COUNT_32_BIT;
-		case VK_SAMPLE_COUNT_16_BIT:
-			return VK_SAMPLE_COUNT_16_BIT;
-		case VK_SAMPLE_COUNT_8_BIT:
-			return VK_SAMPLE_COUNT_8_BIT;
-		case VK_SAMPLE_COUNT_4_BIT:
-			return VK_SAMPLE_COUNT_4_BIT;
-		case VK_SAMPLE_COUNT_2_BIT:
-			return VK_SAMPLE_COUNT_2_BIT;
+			return false;
 		}
 
-		return VK_SAMPLE_COUNT_1_BIT;
+		write(file);
+		file.flush();
+
+		if (!file.good())
+		{
+			file.close();
+			std::remove(TemporaryPath.c_str());
+			return false;
+		}
 	}
 
-	void PickPhysicalDevice()
+#ifdef _WIN32
+	// rename does not replace an existing file on Windows
+	bool replaced = MoveFileExA(TemporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool replaced = std::rename(TemporaryPath.c_str(), path.c_str()) == 0;
+#endif
+
+	if (!replaced)
 	{
-		uint32_t count = 0;
-		vkEnumeratePhysicalDevices(instance, &count, nullptr);
+		std::remove(TemporaryPath.c_str());
+	}
 
-		if (count != 0)
+	return replaced;
+}
+
+// 64 bit content hash, reads eight bytes at a time so hashing a large model stays well below the cost of parsing it
+static uint64_t HashBytes(const char* data, size_t size)
+{
+	const uint64_t prime = 0x100000001b3ull;
+	uint64_t hash = 0xcbf29ce484222325ull ^ size;
+
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+
+	for (; i < size; i++)
+	{
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+	}
+
+	return hash ^ (hash >> 32);
+}
+
+// fixed set of worker threads that run the iterations of a parallel loop
+class ThreadPool
+{
+public:
+	// the thread calling ParallelFor takes part in the loop, so one worker less than the hardware threads is enough
+	explicit ThreadPool(size_t count = std::max(1u, std::thread::hardware_concurrency()) - 1)
+	{
+		for (size_t i = 0; i < count; i++)
 		{
-			std::vector<VkPhysicalDevice> devices(count);
-			vkEnumeratePhysicalDevices(instance, &count, devices.data());
+			threads.emplace_back(&ThreadPool::Work, this);
+		}
+	}
 
-			for (VkPhysicalDevice device : devices)
-			{
-				if (IsDeviceSuitable(device))
-				{
-					// this->PhysicalDevice = device;
-					PhysicalDevice = device;
-					SampleCount = GetMaxUsableSampleCount();
-					break;
-				}
-			}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
 
-			// if (this->PhysicalDevice == VK_NULL_HANDLE)
-			if (PhysicalDevice == VK_NULL_HANDLE)
-			{
-				throw std::runtime_error("failed to find a suitable device");
-			}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
 		}
-		else
+
+		WorkReady.notify_all();
+
+		for (std::thread& thread : threads)
 		{
-			throw std::runtime_error("failed to find any physical device");
+			thread.join();
 		}
 	}
 
-	bool IsDeviceSuitable(VkPhysicalDevice device)
+	size_t GetThreadCount() const
 	{
-		QueueFamilyIndex index = FindQueueFamilyIndex(device);
+		return threads.size() + 1;
+	}
 
-		bool ExtensionSupport = CheckDeviceExtensionSupport(device);
-		bool SwapChainAdequate = false;
+	// calls function(i) for every i in [0, count) and returns once all of them are done
+	// the first exception thrown by an iteration is rethrown here
+	void ParallelFor(size_t count, const std::function<void(size_t)>& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
 
-		if (ExtensionSupport)
 		{
-			SwapChainSupport support = QuerySwapChainSupport(device);
-			SwapChainAdequate = !support.formats.empty() && !support.modes.empty();
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &function;
+			JobCount = count;
+			next = 0;
+			active = threads.size();
+			error = nullptr;
+			generation++;
 		}
 
-		VkPhysicalDeviceFeatures features;
-		vkGetPhysicalDeviceFeatures(device, &features);
+		WorkReady.notify_all();
 
-		return index.IsComplete() && ExtensionSupport&& SwapChainAdequate&& features.samplerAnisotropy;
-	}
+		Execute();
 
-	QueueFamilyIndex FindQueueFamilyIndex(VkPhysicalDevice device)
-	{
-		QueueFamilyIndex index;
+		std::unique_lock<std::mutex> lock(mutex);
+		WorkDone.wait(lock, [this] { return active == 0; });
 
-		uint32_t count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+		job = nullptr;
 
-		if (count != 0)
+		if (error)
 		{
-			std::vector<VkQueueFamilyProperties> families(count);
-			vkGetPhysicalDeviceQueueFamilyProperties(device, &count, families.data());
+			std::rethrow_exception(error);
+		}
+	}
 
-			for (uint32_t i = 0; i < count; i++)
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable WorkReady;
+	std::condition_variable WorkDone;
+
+	const std::function<void(size_t)>* job = nullptr;
+	size_t JobCount = 0;
+	std::atomic<size_t> next{ 0 };
+	size_t active = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+
+	void Execute()
+	{
+		for (size_t i = next++; i < JobCount; i = next++)
+		{
+			try
 			{
-				const VkQueueFamilyProperties& family = families[i];
+				(*job)(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
 
-				if ((family.queueCount > 0) && (family.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				if (!error)
 				{
-					index.graphic = i;
+					error = std::current_exception();
 				}
+			}
+		}
+	}
+
+	void Work()
+	{
+		uint64_t seen = 0;
 
-				VkBool32 flag = false;
-				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &flag);
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				WorkReady.wait(lock, [this, seen] { return stopping || generation != seen; });
 
-				if ((family.queueCount > 0) && flag)
+				if (stopping)
 				{
-					index.present = i;
+					return;
 				}
 
-				if (index.IsComplete())
-				{
-					break;
-				}
+				seen = generation;
 			}
-		}
 
-		return index;
+			Execute();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				active--;
+			}
+
+			WorkDone.notify_one();
+		}
 	}
+};
 
-	bool CheckDeviceExtensionSupport(VkPhysicalDevice device)
-	{
-		uint32_t count;
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+struct ObjCorner
+{
+	int32_t position;
 
-		std::vector<VkExtensionProperties> available(count);
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &count, available.data());
+	// -1 when the face has no texture coordinates
+	int32_t texcoord;
+};
+
+// the subset of an OBJ file the samples use, faces are triangulated as fans
+struct ObjMesh
+{
+	std::vector<float> positions;
+	std::vector<float> texcoords;
 
-		std::set<std::string> required(extentions.begin(), extentions.end());
+	// three per triangle, in file order
+	std::vector<ObjCorner> corners;
 
-		for (const VkExtensionProperties& extension : available)
-		{
-			required.erase(extension.extensionName);
-		}
+	// the first corner of every shape, a new shape starts at each o or g record that is followed by faces and at each
+	// usemtl record that changes the material
+	std::vector<size_t> shapes;
 
-		return required.empty();
-	}
+	// index into materials of every shape, -1 for the faces before the first usemtl record
+	std::vector<int32_t> ShapeMaterials;
 
-	void CreateLogicalDevice()
+	// material names in the order usemtl records first name them, and the files named by mtllib records
+	std::vector<std::string> materials;
+	std::vector<std::string> libraries;
+};
+
+// parses the OBJ text in line aligned chunks on the thread pool
+// a first pass counts the v and vt records of every chunk so the second one can resolve relative indices
+// and write the attributes straight to their final place, the triangles are then concatenated in chunk order
+class ObjParser
+{
+public:
+	static ObjMesh Parse(const char* data, size_t size, ThreadPool& workers)
 	{
-		VkResult result;
+		std::vector<Chunk> chunks = Split(data, size, workers.GetThreadCount());
 
-		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
-		std::set<uint32_t> families = { index.graphic.value(), index.present.value() };
+		workers.ParallelFor(chunks.size(), [&chunks](size_t i) { Count(chunks[i]); });
 
-		std::vector<VkDeviceQueueCreateInfo> QueueCreateInfos;
-		float QueuePriority = 1.0f;
+		size_t PositionCount = 0;
+		size_t TexCoordCount = 0;
 
-		for (uint32_t family : families)
+		for (Chunk& chunk : chunks)
 		{
-			VkDeviceQueueCreateInfo QueueCreateInfo = {
-				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,	// sType
-				nullptr,									// pNext
-				0,											// flags
-				family,										// queueFamilyIndex
-				1,											// queueCount
-				&QueuePriority								// pQueuePriorities
-			};
-
-			QueueCreateInfos.push_back(QueueCreateInfo);
+			chunk.PositionBase = PositionCount;
+			chunk.TexCoordBase = TexCoordCount;
+			PositionCount += chunk.PositionCount;
+			TexCoordCount += chunk.TexCoordCount;
 		}
 
-		VkPhysicalDeviceFeatures features = {};
-		features.samplerAnisotropy = VK_TRUE;
+		ObjMesh mesh;
+		mesh.positions.resize(3 * PositionCount);
+		mesh.texcoords.resize(2 * TexCoordCount);
 
-		VkDeviceCreateInfo DeviceCreateInfo = {
-			VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,				// sType
-			nullptr,											// pNext
-			0,													// flags
-			QueueCreateInfos.size(),							// queueCreateInfoCount
-			QueueCreateInfos.data(),							// pQueueCreateInfos
-			EnableValidationLayer ? layers.size() : 0,			// enabledLayerCount
-			EnableValidationLayer ? layers.data() : nullptr,	// ppEnabledLayerNames
-			extentions.size(),									// enabledExtensionCount
-			extentions.data(),									// ppEnabledExtensionNames
-			&features											// pEnabledFeatures
-		};
+		workers.ParallelFor(chunks.size(), [&chunks, &mesh](size_t i) { Parse(chunks[i], mesh); });
 
-		result = vkCreateDevice(PhysicalDevice, &DeviceCreateInfo, nullptr, &device);
+		size_t CornerCount = 0;
 
-		if (result != VK_SUCCESS)
+		for (const Chunk& chunk : chunks)
 		{
-			throw std::runtime_error("failed to create logical device");
+			CornerCount += chunk.corners.size();
 		}
 
-		vkGetDeviceQueue(device, index.graphic.value(), 0, &GraphicQueue);
-		vkGetDeviceQueue(device, index.present.value(), 0, &PresentQueue);
-	}
-
-	void CreateSurface()
-	{
-		VkResult result;
+		mesh.corners.reserve(CornerCount);
 
-		/*
-		// Windows platform specific surface creation
+		mesh.shapes.push_back(0);
+		mesh.ShapeMaterials.push_back(-1);
 
-		VkWin32SurfaceCreateInfoKHR SurfaceCreateInfo = {
-			VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR,	// sType
-			nullptr,											// pNext
-			0,													// flags
-			GetModuleHandle(nullptr),							// hinstance
-			glfwGetWin32Window(window)							// hwnd
-		};
+		// a usemtl record applies to the faces after it, whichever chunk they are in
+		std::unordered_map<std::string, int32_t> MaterialIndices;
+		int32_t material = -1;
 
-		result = vkCreateWin32SurfaceKHR(instance, &SurfaceCreateInfo, nullptr, &surface);
-		*/
+		for (const Chunk& chunk : chunks)
+		{
+			for (const Boundary& boundary : chunk.boundaries)
+			{
+				size_t corner = mesh.corners.size() + boundary.corner;
 
-		// platform agnostic surface creation
+				if (boundary.usemtl)
+				{
+					auto inserted = MaterialIndices.emplace(boundary.material, static_cast<int32_t>(mesh.materials.size()));
 
-		result = glfwCreateWindowSurface(instance, window, nullptr, &surface);
+					if (inserted.second)
+					{
+						mesh.materials.push_back(boundary.material);
+					}
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create window surface");
-		}
-	}
+					material = inserted.first->second;
+				}
 
-	SwapChainSupport QuerySwapChainSupport(VkPhysicalDevice device)
-	{
-		SwapChainSupport support;
+				// a record before the first face of the current shape only changes its material
+				if (corner == mesh.shapes.back())
+				{
+					mesh.ShapeMaterials.back() = material;
+				}
+				else if (corner < CornerCount && (!boundary.usemtl || material != mesh.ShapeMaterials.back()))
+				{
+					mesh.shapes.push_back(corner);
+					mesh.ShapeMaterials.push_back(material);
+				}
+			}
 
-		// capabilities
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &support.capabilities);
+			mesh.libraries.insert(mesh.libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+			mesh.corners.insert(mesh.corners.end(), chunk.corners.begin(), chunk.corners.end());
+		}
 
-		// formats
+		for (const ObjCorner& corner : mesh.corners)
 		{
-			uint32_t count;
-			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, nullptr);
+			bool valid = corner.position >= 0 && static_cast<size_t>(corner.position) < PositionCount;
+			valid = valid && corner.texcoord >= -1 && (corner.texcoord == -1 || static_cast<size_t>(corner.texcoord) < TexCoordCount);
 
-			if (count != 0)
+			if (!valid)
 			{
-				support.formats.resize(count);
-				vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, support.formats.data());
+				throw std::runtime_error("OBJ face references a vertex that does not exist");
 			}
 		}
 
-		// present modes
+		return mesh;
+	}
+
+	// the files named by the mtllib records, in file order, without parsing anything else
+	static std::vector<std::string> FindLibraries(const char* data, size_t size)
+	{
+		std::vector<std::string> libraries;
+		const char* end = data + size;
+
+		for (const char* p = data; p < end; p++)
 		{
-			uint32_t count;
-			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, nullptr);
+			p = static_cast<const char*>(memchr(p, 'm', end - p));
 
-			if (count != 0)
+			if (p == nullptr)
 			{
-				support.modes.resize(count);
-				vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, support.modes.data());
+				break;
 			}
-		}
 
-		return support;
-	}
+			// only an m that starts a record, after the line's leading spaces
+			const char* line = p;
 
-	VkSurfaceFormatKHR ChooseSwapChainSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
-	{
-		if (formats.size() == 1 && formats.begin()->format == VK_FORMAT_UNDEFINED)
-		{
-			return { VK_FORMAT_B8G8R8A8_UNORM, VK_COLORSPACE_SRGB_NONLINEAR_KHR };
-		}
+			while (line > data && (line[-1] == ' ' || line[-1] == '\t'))
+			{
+				line--;
+			}
 
-		for (VkSurfaceFormatKHR format : formats)
-		{
-			if (format.format == VK_FORMAT_B8G8R8A8_UNORM && format.colorSpace == VK_COLORSPACE_SRGB_NONLINEAR_KHR)
+			if (line != data && line[-1] != '\n')
 			{
-				return format;
+				continue;
+			}
+
+			const char* last = LineEnd(p, end);
+
+			if (RecordType(line, last) == 'm')
+			{
+				ParseLibraries(line, last, libraries);
 			}
+
+			p = last;
 		}
 
-		return *formats.begin();
+		return libraries;
 	}
 
-	VkPresentModeKHR ChooseSwapChainPresentMode(const std::vector<VkPresentModeKHR>& modes)
+private:
+	// an o, g or usemtl record, at the size corners had when it was read
+	struct Boundary
 	{
-		VkPresentModeKHR available = VK_PRESENT_MODE_FIFO_KHR;
+		size_t corner;
+		bool usemtl;
+		std::string material;
+	};
 
-		for (VkPresentModeKHR mode : modes)
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		size_t PositionCount = 0;
+		size_t TexCoordCount = 0;
+		size_t PositionBase = 0;
+		size_t TexCoordBase = 0;
+		std::vector<ObjCorner> corners;
+		std::vector<Boundary> boundaries;
+		std::vector<std::string> libraries;
+	};
+
+	static std::vector<Chunk> Split(const char* data, size_t size, size_t threads)
+	{
+		// a few chunks per thread balance the load, but not so many that they get tiny
+		const size_t MinimumChunkSize = 1 << 20;
+		size_t count = std::max<size_t>(1, std::min(threads * 4, size / MinimumChunkSize));
+
+		std::vector<Chunk> chunks;
+		const char* begin = data;
+		const char* end = data + size;
+
+		for (size_t i = 1; i <= count && begin < end; i++)
 		{
-			if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
-			{
-				return mode;
-			}
+			const char* split = i == count ? end : data + size / count * i;
 
-			if (mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+			if (split < begin)
 			{
-				available = mode;
+				split = begin;
 			}
+
+			// move the split just past the end of the line it falls in
+			const char* newline = static_cast<const char*>(memchr(split, '\n', end - split));
+			split = newline == nullptr ? end : newline + 1;
+
+			Chunk chunk;
+			chunk.begin = begin;
+			chunk.end = split;
+			chunks.push_back(std::move(chunk));
+
+			begin = split;
 		}
 
-		return available;
+		return chunks;
 	}
 
-	VkExtent2D ChooseSwapChainExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+	static const char* SkipSpaces(const char* p, const char* end)
 	{
-		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		while (p < end && (*p == ' ' || *p == '\t'))
 		{
-			return capabilities.currentExtent;
+			p++;
 		}
-		else
-		{
-			int width;
-			int height;
-
-			glfwGetFramebufferSize(window, &width, &height);
-			VkExtent2D extent = { width, height };
 
-			VkExtent2D min = capabilities.minImageExtent;
-			VkExtent2D max = capabilities.maxImageExtent;
-
-			extent.width = std::max(min.width, std::min(max.width, extent.width));
-			extent.height = std::max(min.height, std::min(max.height, extent.height));
+		return p;
+	}
 
-			return extent;
-		}
+	static const char* LineEnd(const char* p, const char* end)
+	{
+		const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+		return newline == nullptr ? end : newline;
 	}
 
-	void CreateSwapchain()
+	// the record type of a line, 'v' for positions, 't' for texture coordinates, 'f' for faces, 'o' for objects and
+	// groups, 'u' for usemtl, 'm' for mtllib and 0 for anything else
+	static char RecordType(const char*& p, const char* end)
 	{
-		SwapChainSupport support = QuerySwapChainSupport(PhysicalDevice);
-		VkSurfaceFormatKHR format = ChooseSwapChainSurfaceFormat(support.formats);
-		VkPresentModeKHR mode = ChooseSwapChainPresentMode(support.modes);
-		VkExtent2D extent = ChooseSwapChainExtent(support.capabilities);
+		p = SkipSpaces(p, end);
 
-		uint32_t count = support.capabilities.minImageCount + 1;
+		if (end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p += 2;
+			return 'v';
+		}
 
-		if (support.capabilities.maxImageCount > 0 && count > support.capabilities.maxImageCount)
+		if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
 		{
-			count = support.capabilities.maxImageCount;
+			p += 3;
+			return 't';
 		}
 
-		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
-		bool flag = index.graphic == index.present;
-		std::vector<uint32_t> indices = { index.graphic.value(), index.present.value() };
+		if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p += 2;
+			return 'f';
+		}
 
-		VkSwapchainCreateInfoKHR SwapChainCreateInfo = {
-			VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,					// sType
-			nullptr,														// pNext
-			0,																// flags
-			surface,														// surface
-			count,															// minImageCount
-			format.format,													// imageFormat
-			format.colorSpace,												// imageColorSpace
-			extent,															// imageExtent
-			1,																// imageArrayLayers
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,							// imageUsage
-			flag ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT,	// imageSharingMode
-			flag ? indices.size() : 0,										// queueFamilyIndexCount
-			flag ? indices.data() : nullptr,								// pQueueFamilyIndices
-			support.capabilities.currentTransform,							// preTransform
-			VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,								// compositeAlpha
-			mode,															// presentMode
-			VK_TRUE,														// clipped
-			VK_NULL_HANDLE													// oldSwapchain
-		};
+		if (end - p >= 7 && memcmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+		{
+			p += 7;
+			return 'u';
+		}
 
-		VkResult result = vkCreateSwapchainKHR(device, &SwapChainCreateInfo, nullptr, &SwapChain);
+		if (end - p >= 7 && memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+		{
+			p += 7;
+			return 'm';
+		}
 
-		if (result != VK_SUCCESS)
+		// the name is not used
+		if (end - p >= 1 && (p[0] == 'o' || p[0] == 'g') && (end - p == 1 || p[1] == ' ' || p[1] == '\t' || p[1] == '\r'))
 		{
-			throw std::runtime_error("failed to create swap chain");
+			p = end;
+			return 'o';
 		}
 
-		uint32_t ImageCount;
-		vkGetSwapchainImagesKHR(device, SwapChain, &ImageCount, nullptr);
-		SwapChainImages.resize(ImageCount);
-		vkGetSwapchainImagesKHR(device, SwapChain, &ImageCount, SwapChainImages.data());
+		return 0;
+	}
 
-		SwapChainFormat = format.format;
-		SwapChainExtent = extent;
+	static void Count(Chunk& chunk)
+	{
+		for (const char* p = chunk.begin; p < chunk.end;)
+		{
+			const char* line = LineEnd(p, chunk.end);
+			char type = RecordType(p, line);
+
+			chunk.PositionCount += type == 'v';
+			chunk.TexCoordCount += type == 't';
+
+			p = line + 1;
+		}
 	}
 
-	void RecreateSwapchain()
+	static const char* ParseFloat(const char* p, const char* end, float& value)
 	{
-		int width = 0;
-		int height = 0;
+		p = SkipSpaces(p, end);
 
-		while (width == 0 || height == 0)
+		// from_chars does not accept an explicit plus sign
+		if (p < end && *p == '+')
 		{
-			glfwGetFramebufferSize(window, &width, &height);
-			glfwWaitEvents();
+			p++;
 		}
 
-		vkDeviceWaitIdle(device);
+		std::from_chars_result result = std::from_chars(p, end, value);
 
-		CleanupSwapchain();
+		if (result.ec != std::errc())
+		{
+			throw std::runtime_error("failed to parse OBJ number");
+		}
 
-		CreateSwapchain();
-		CreateImageViews();
-		CreateRenderPass();
-		CreateGraphicsPipeline();
-		CreateColorResources();
-		CreateDepthResources();
-		CreateFramebuffers();
-		CreateUniformBuffers();
-		CreateDescriptorPool();
-		CreateDescriptorSets();
-		CreateCommandBuffers();
+		return result.ptr;
 	}
 
-	void CreateImageViews()
+	// the rest of the line without the spaces around it
+	static std::string ParseName(const char* p, const char* end)
 	{
-		// SwapChainImageViews.resize(SwapChainImages.size());
-		SwapChainImageViews.clear();
+		p = SkipSpaces(p, end);
 
-		for (VkImage image : SwapChainImages)
+		while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
 		{
-			VkImageView view = CreateImageView(image, SwapChainFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-			SwapChainImageViews.push_back(view);
+			end--;
 		}
+
+		return std::string(p, end);
 	}
 
-	static std::vector<char> ReadFile(const std::string& FileName)
+	// the file names of an mtllib record, which can not contain spaces
+	static void ParseLibraries(const char* p, const char* end, std::vector<std::string>& libraries)
 	{
-		std::ifstream file(FileName, std::ios::ate | std::ios::binary);
-
-		if (!file.is_open())
+		while (true)
 		{
-			throw std::runtime_error("failed to open file");
-		}
-
-		size_t size = file.tellg();
-		std::vector<char> buffer(size);
+			p = SkipSpaces(p, end);
+			const char* name = p;
 
-		file.seekg(0);
-		file.read(buffer.data(), size);
+			while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+			{
+				p++;
+			}
 
-		file.close();
+			if (p == name)
+			{
+				break;
+			}
 
-		return buffer;
+			libraries.emplace_back(name, p);
+		}
 	}
 
-	VkShaderModule CreateShaderModule(const std::vector<char>& bytecode)
+	// OBJ indices start at 1, negative ones count back from the last record read so far
+	static int32_t ResolveIndex(int32_t index, size_t count)
 	{
-		VkShaderModuleCreateInfo ShaderModuleCreateInfo = {
-			VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,		// sType
-			nullptr,											// pNext
-			0,													// flags
-			bytecode.size(),									// codeSize
-			reinterpret_cast<const uint32_t*>(bytecode.data())	// pCode
-		};
-
-		VkShaderModule module;
-		VkResult result = vkCreateShaderModule(device, &ShaderModuleCreateInfo, nullptr, &module);
-
-		if (result != VK_SUCCESS)
+		if (index > 0)
 		{
-			throw std::runtime_error("failed to create shader module");
+			return index - 1;
 		}
 
-		// the buffer with the code can be freed immediately after creating the shader module
+		if (index < 0)
+		{
+			return static_cast<int32_t>(count) + index;
+		}
 
-		return module;
+		throw std::runtime_error("OBJ face index 0 is not valid");
 	}
 
-	void CreateRenderPass()
+	static void Parse(Chunk& chunk, ObjMesh& mesh)
 	{
-		VkAttachmentDescription ColorAttachment = {
-			0,											// flags
-			SwapChainFormat,							// format
-			SampleCount,								// samples
-			VK_ATTACHMENT_LOAD_OP_CLEAR,				// loadOp
-			VK_ATTACHMENT_STORE_OP_STORE,				// storeOp
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,			// stencilLoadOp
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,			// stencilStoreOp
-			VK_IMAGE_LAYOUT_UNDEFINED,					// initialLayout
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL	// finalLayout
-		};
+		size_t PositionIndex = chunk.PositionBase;
+		size_t TexCoordIndex = chunk.TexCoordBase;
 
-		VkAttachmentDescription DepthAttachment = {
-			0,													// flags
-			FindDepthFormat(),									// format
-			SampleCount,										// samples
-			VK_ATTACHMENT_LOAD_OP_CLEAR,						// loadOp
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,					// storeOp
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,					// stencilLoadOp
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,					// stencilStoreOp
-			VK_IMAGE_LAYOUT_UNDEFINED,							// initialLayout
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL	// finalLayout
-		};
+		std::vector<ObjCorner> face;
 
-		VkAttachmentDescription SolveAttachment = {
-			0,									// flags
-			SwapChainFormat,					// format
-			VK_SAMPLE_COUNT_1_BIT,				// samples
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,	// loadOp
-			VK_ATTACHMENT_STORE_OP_STORE,		// storeOp
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,	// stencilLoadOp
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,	// stencilStoreOp
-			VK_IMAGE_LAYOUT_UNDEFINED,			// initialLayout
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR		// finalLayout
-		};
+		for (const char* p = chunk.begin; p < chunk.end;)
+		{
+			const char* line = LineEnd(p, chunk.end);
+			char type = RecordType(p, line);
 
-		std::vector<VkAttachmentDescription> attachments = { ColorAttachment, DepthAttachment, SolveAttachment };
+			if (type == 'v')
+			{
+				float* position = &mesh.positions[3 * PositionIndex++];
 
-		VkAttachmentReference ColorAttachmentReference = {
-			0,											// attachment
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL	// layout
-		};
+				p = ParseFloat(p, line, position[0]);
+				p = ParseFloat(p, line, position[1]);
+				p = ParseFloat(p, line, position[2]);
+			}
+			else if (type == 't')
+			{
+				float* texcoord = &mesh.texcoords[2 * TexCoordIndex++];
 
-		VkAttachmentReference DepthAttachmentReference = {
-			1,													// attachment
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL	// layout
-		};
+				p = ParseFloat(p, line, texcoord[0]);
 
-		VkAttachmentReference SolveAttachmentReference = {
-			2,											// attachment
+				// the v coordinate is optional
+				texcoord[1] = 0.0f;
+				const char* next = SkipSpaces(p, line);
+
+				if (next < line && *next != '\r')
+				{
+					p = ParseFloat(p, line, texcoord[1]);
+				}
+			}
+			else if (type == 'o')
+			{
+				chunk.boundaries.push_back({ chunk.corners.size(), false, std::string() });
+			}
+			else if (type == 'u')
+			{
+				chunk.boundaries.push_back({ chunk.corners.size(), true, ParseName(p, line) });
+			}
+			else if (type == 'm')
+			{
+				ParseLibraries(p, line, chunk.libraries);
+			}
+			else if (type == 'f')
+			{
+				face.clear();
+
+				while (true)
+				{
+					p = SkipSpaces(p, line);
+
+					if (p >= line || *p == '\r' || *p == '#')
+					{
+						break;
+					}
+
+					// v, v/vt, v//vn or v/vt/vn
+					int32_t position = 0;
+					int32_t texcoord = 0;
+
+					std::from_chars_result result = std::from_chars(p, line, position);
+
+					if (result.ec != std::errc())
+					{
+						throw std::runtime_error("failed to parse OBJ face");
+					}
+
+					p = result.ptr;
+
+					if (p < line && *p == '/' && p + 1 < line && p[1] != '/')
+					{
+						result = std::from_chars(p + 1, line, texcoord);
+
+						if (result.ec != std::errc())
+						{
+							throw std::runtime_error("failed to parse OBJ face");
+						}
+
+						p = result.ptr;
+					}
+
+					// the normal index is not used
+					while (p < line && *p != ' ' && *p != '\t' && *p != '\r')
+					{
+						p++;
+					}
+
+					ObjCorner corner = {
+						ResolveIndex(position, PositionIndex),					// position
+						texcoord == 0 ? -1 : ResolveIndex(texcoord, TexCoordIndex)	// texcoord
+					};
+
+					face.push_back(corner);
+				}
+
+				for (size_t i = 2; i < face.size(); i++)
+				{
+					chunk.corners.push_back(face[0]);
+					chunk.corners.push_back(face[i - 1]);
+					chunk.corners.push_back(face[i]);
+				}
+			}
+
+			p = line + 1;
+		}
+	}
+};
+
+// a material of an MTL file, only the diffuse colour and map are used
+struct ObjMaterial
+{
+	std::string name;
+	glm::vec3 diffuse = glm::vec3(1.0f);
+
+	// relative to the MTL file, empty without a map_Kd record
+	std::string DiffuseMap;
+};
+
+// reads the newmtl, Kd and map_Kd records of an MTL file and skips the others
+class MtlParser
+{
+public:
+	static void Parse(const char* data, size_t size, std::vector<ObjMaterial>& materials)
+	{
+		const char* end = data + size;
+
+		for (const char* p = data; p < end;)
+		{
+			const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+			const char* line = newline == nullptr ? end : newline;
+
+			std::string keyword;
+			std::string argument;
+			Split(p, line, keyword, argument);
+
+			p = line + 1;
+
+			if (keyword == "newmtl")
+			{
+				ObjMaterial material;
+				material.name = argument;
+				materials.push_back(material);
+			}
+			else if (materials.empty())
+			{
+				continue;
+			}
+			else if (keyword == "Kd")
+			{
+				const char* value = argument.c_str();
+				const char* last = value + argument.size();
+
+				for (int i = 0; i < 3; i++)
+				{
+					while (value < last && (*value == ' ' || *value == '\t'))
+					{
+						value++;
+					}
+
+					std::from_chars_result result = std::from_chars(value, last, materials.back().diffuse[i]);
+
+					if (result.ec != std::errc())
+					{
+						throw std::runtime_error("failed to parse MTL colour");
+					}
+
+					value = result.ptr;
+				}
+			}
+			else if (keyword == "map_Kd")
+			{
+				// options such as -s or -o come before the file name, which can not contain spaces
+				size_t start = argument.find_last_of(" \t");
+				materials.back().DiffuseMap = start == std::string::npos ? argument : argument.substr(start + 1);
+			}
+		}
+	}
+
+private:
+	// the first word of the line and the rest of it, without the spaces around them
+	static void Split(const char* p, const char* end, std::string& keyword, std::string& argument)
+	{
+		auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+		while (p < end && space(*p))
+		{
+			p++;
+		}
+
+		while (end > p && space(end[-1]))
+		{
+			end--;
+		}
+
+		const char* word = p;
+
+		while (p < end && !space(*p))
+		{
+			p++;
+		}
+
+		keyword.assign(word, p);
+
+		while (p < end && space(*p))
+		{
+			p++;
+		}
+
+		argument.assign(p, end);
+	}
+};
+
+// collapses bit identical vertices of an expanded mesh into a vertex and an index array
+// vertices keep the order in which they first appear, so the serial and the parallel versions give the same output
+class VertexDeduplicator
+{
+public:
+	static void Deduplicate(const std::vector<Vertex>& expanded, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		size_t count = expanded.size();
+
+		// there are at most as many unique vertices as indices, so the table never goes above half full
+		size_t capacity = NextPowerOfTwo(std::max<size_t>(16, 2 * count));
+		size_t mask = capacity - 1;
+		std::vector<uint32_t> table(capacity, Empty);
+
+		vertices.clear();
+		indices.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t slot = HashVertex(expanded[i]) & mask;
+
+			while (table[slot] != Empty && memcmp(&vertices[table[slot]], &expanded[i], sizeof(Vertex)) != 0)
+			{
+				slot = (slot + 1) & mask;
+			}
+
+			if (table[slot] == Empty)
+			{
+				table[slot] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(expanded[i]);
+			}
+
+			indices[i] = table[slot];
+		}
+	}
+
+	// hashes the vertices in blocks, buckets them into shards by hash so every shard deduplicates independently,
+	// then numbers the first occurrences with a prefix sum over the blocks
+	static void DeduplicateParallel(const std::vector<Vertex>& expanded, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ThreadPool& workers)
+	{
+		const size_t BlockSize = 1 << 16;
+		size_t count = expanded.size();
+
+		if (workers.GetThreadCount() == 1 || count < 4 * BlockSize)
+		{
+			Deduplicate(expanded, vertices, indices);
+			return;
+		}
+
+		size_t blocks = (count + BlockSize - 1) / BlockSize;
+		size_t shards = NextPowerOfTwo(4 * workers.GetThreadCount());
+		int ShardShift = 64;
+
+		for (size_t i = shards; i > 1; i >>= 1)
+		{
+			ShardShift--;
+		}
+
+		auto ShardOf = [ShardShift](uint64_t hash) { return static_cast<size_t>(hash >> ShardShift); };
+		auto BlockEnd = [count](size_t block) { return std::min(count, (block + 1) * BlockSize); };
+
+		std::vector<uint64_t> hashes(count);
+		std::vector<size_t> offsets(blocks * shards, 0);
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			for (size_t i = block * BlockSize; i < BlockEnd(block); i++)
+			{
+				hashes[i] = HashVertex(expanded[i]);
+				offsets[block * shards + ShardOf(hashes[i])]++;
+			}
+		});
+
+		// the shards are laid out one after the other, each one listing its vertices block by block
+		std::vector<size_t> ShardBegin(shards + 1);
+		size_t total = 0;
+
+		for (size_t shard = 0; shard < shards; shard++)
+		{
+			ShardBegin[shard] = total;
+
+			for (size_t block = 0; block < blocks; block++)
+			{
+				size_t size = offsets[block * shards + shard];
+				offsets[block * shards + shard] = total;
+				total += size;
+			}
+		}
+
+		ShardBegin[shards] = total;
+
+		std::vector<uint32_t> order(count);
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			size_t* cursor = &offsets[block * shards];
+
+			for (size_t i = block * BlockSize; i < BlockEnd(block); i++)
+			{
+				order[cursor[ShardOf(hashes[i])]++] = static_cast<uint32_t>(i);
+			}
+		});
+
+		// the first occurrence of every vertex
+		std::vector<uint32_t> first(count);
+
+		workers.ParallelFor(shards, [&](size_t shard)
+		{
+			size_t size = ShardBegin[shard + 1] - ShardBegin[shard];
+			size_t capacity = NextPowerOfTwo(std::max<size_t>(16, 2 * size));
+			size_t mask = capacity - 1;
+			std::vector<uint32_t> table(capacity, Empty);
+
+			for (size_t k = ShardBegin[shard]; k < ShardBegin[shard + 1]; k++)
+			{
+				uint32_t i = order[k];
+				size_t slot = hashes[i] & mask;
+
+				while (table[slot] != Empty && (hashes[table[slot]] != hashes[i] || memcmp(&expanded[table[slot]], &expanded[i], sizeof(Vertex)) != 0))
+				{
+					slot = (slot + 1) & mask;
+				}
+
+				if (table[slot] == Empty)
+				{
+					table[slot] = i;
+				}
+
+				first[i] = table[slot];
+			}
+		});
+
+		std::vector<size_t> UniqueBegin(blocks + 1, 0);
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			for (size_t i = block * BlockSize; i < BlockEnd(block); i++)
+			{
+				UniqueBegin[block + 1] += first[i] == i;
+			}
+		});
+
+		for (size_t block = 0; block < blocks; block++)
+		{
+			UniqueBegin[block + 1] += UniqueBegin[block];
+		}
+
+		vertices.resize(UniqueBegin[blocks]);
+		indices.resize(count);
+
+		// the bucket order is no longer needed, it now maps a first occurrence to its vertex index
+		std::vector<uint32_t>& remap = order;
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			size_t unique = UniqueBegin[block];
+
+			for (size_t i = block * BlockSize; i < BlockEnd(block); i++)
+			{
+				if (first[i] == i)
+				{
+					remap[i] = static_cast<uint32_t>(unique);
+					vertices[unique++] = expanded[i];
+				}
+			}
+		});
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			for (size_t i = block * BlockSize; i < BlockEnd(block); i++)
+			{
+				indices[i] = remap[first[i]];
+			}
+		});
+	}
+
+private:
+	static const uint32_t Empty = std::numeric_limits<uint32_t>::max();
+
+	static uint64_t HashVertex(const Vertex& vertex)
+	{
+		return HashBytes(reinterpret_cast<const char*>(&vertex), sizeof(Vertex));
+	}
+
+	static size_t NextPowerOfTwo(size_t value)
+	{
+		size_t power = 1;
+
+		while (power < value)
+		{
+			power <<= 1;
+		}
+
+		return power;
+	}
+};
+
+struct VertexCacheStatistics
+{
+	// average cache miss ratio, transformed vertices per triangle, 0.5 at best and 3 at worst
+	double acmr;
+
+	// average transformed to vertex ratio, 1 when every vertex is transformed once
+	double atvr;
+};
+
+// a range of the index buffer drawn with its own base vertex, so 16 bit indices can address meshes of any size,
+// chunks never span two shapes of the source file
+struct MeshChunk
+{
+	uint32_t FirstIndex;
+	uint32_t IndexCount;
+	int32_t VertexOffset;
+	uint32_t VertexCount;
+
+	// bounding box in model units
+	glm::vec3 minimum;
+	glm::vec3 maximum;
+
+	// a chunk lies in one shape, so all of its triangles have the same material
+	uint32_t material;
+};
+
+// one level of detail, a chunk for each chunk of the full mesh starting at FirstChunk
+struct MeshLevel
+{
+	uint32_t FirstChunk;
+	uint32_t IndexCount;
+
+	// largest distance in model units between the simplified and the full surface
+	float error;
+};
+
+// the culling shader gets the level table in the uniform buffer, so the chain has a fixed upper length
+const uint32_t MaxLodLevels = 8;
+
+// reorders the triangles of an indexed mesh for the post-transform vertex cache and for overdraw,
+// then reorders the vertices in the order the triangles first use them so the vertex fetches are sequential
+class MeshOptimizer
+{
+public:
+	// FIFO cache of the size used by the analysis, a conservative model of recent GPUs
+	static VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t VertexCount, uint32_t CacheSize = 16)
+	{
+		std::vector<uint32_t> timestamps(VertexCount, 0);
+		uint32_t time = CacheSize + 1;
+		size_t misses = 0;
+
+		for (uint32_t index : indices)
+		{
+			if (time - timestamps[index] > CacheSize)
+			{
+				timestamps[index] = time++;
+				misses++;
+			}
+		}
+
+		size_t used = 0;
+
+		for (uint32_t timestamp : timestamps)
+		{
+			used += timestamp != 0;
+		}
+
+		VertexCacheStatistics statistics = {
+			indices.empty() ? 0.0 : 3.0 * misses / indices.size(),	// acmr
+			used == 0 ? 0.0 : static_cast<double>(misses) / used		// atvr
+		};
+
+		return statistics;
+	}
+
+	// Tom Forsyth's linear speed vertex cache optimisation : greedily emits the triangle with the best score,
+	// scoring vertices by their position in a simulated LRU cache and by how many triangles still use them
+	static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t VertexCount)
+	{
+		size_t TriangleCount = indices.size() / 3;
+
+		// triangles still to be emitted for every vertex, listed in adjacency[offsets[v], offsets[v] + valence[v])
+		std::vector<uint32_t> valence(VertexCount, 0);
+		std::vector<uint32_t> offsets(VertexCount + 1, 0);
+		std::vector<uint32_t> adjacency(indices.size());
+
+		for (uint32_t index : indices)
+		{
+			valence[index]++;
+		}
+
+		for (size_t v = 0; v < VertexCount; v++)
+		{
+			offsets[v + 1] = offsets[v] + valence[v];
+		}
+
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<int32_t> CachePosition(VertexCount, -1);
+		std::vector<float> VertexScore(VertexCount);
+		std::vector<float> TriangleScore(TriangleCount);
+		std::vector<bool> emitted(TriangleCount, false);
+
+		for (size_t v = 0; v < VertexCount; v++)
+		{
+			VertexScore[v] = ScoreVertex(-1, valence[v]);
+		}
+
+		int64_t best = -1;
+		float BestScore = -1.0f;
+
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			TriangleScore[t] = VertexScore[indices[3 * t]] + VertexScore[indices[3 * t + 1]] + VertexScore[indices[3 * t + 2]];
+
+			if (TriangleScore[t] > BestScore)
+			{
+				best = t;
+				BestScore = TriangleScore[t];
+			}
+		}
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		uint32_t cache[ForsythCacheSize + 3];
+		size_t CacheCount = 0;
+		size_t next = 0;
+
+		while (best >= 0)
+		{
+			const uint32_t* triangle = &indices[3 * best];
+
+			result.insert(result.end(), triangle, triangle + 3);
+			emitted[best] = true;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t* list = &adjacency[offsets[triangle[k]]];
+				uint32_t& count = valence[triangle[k]];
+
+				std::swap(*std::find(list, list + count, static_cast<uint32_t>(best)), list[count - 1]);
+				count--;
+			}
+
+			// the triangle's vertices move to the front of the cache, the others are pushed back
+			uint32_t NewCache[ForsythCacheSize + 3];
+			size_t NewCount = 0;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				if (std::find(NewCache, NewCache + NewCount, triangle[k]) == NewCache + NewCount)
+				{
+					NewCache[NewCount++] = triangle[k];
+				}
+			}
+
+			for (size_t i = 0; i < CacheCount; i++)
+			{
+				if (std::find(triangle, triangle + 3, cache[i]) == triangle + 3)
+				{
+					NewCache[NewCount++] = cache[i];
+				}
+			}
+
+			// vertices pushed past the end of the cache are evicted, they still need their scores updated
+			for (size_t i = 0; i < NewCount; i++)
+			{
+				uint32_t v = NewCache[i];
+				CachePosition[v] = i < ForsythCacheSize ? static_cast<int32_t>(i) : -1;
+				VertexScore[v] = ScoreVertex(CachePosition[v], valence[v]);
+			}
+
+			best = -1;
+			BestScore = -1.0f;
+
+			for (size_t i = 0; i < NewCount; i++)
+			{
+				uint32_t v = NewCache[i];
+
+				for (size_t j = offsets[v]; j < offsets[v] + valence[v]; j++)
+				{
+					uint32_t t = adjacency[j];
+					TriangleScore[t] = VertexScore[indices[3 * t]] + VertexScore[indices[3 * t + 1]] + VertexScore[indices[3 * t + 2]];
+
+					if (TriangleScore[t] > BestScore)
+					{
+						best = t;
+						BestScore = TriangleScore[t];
+					}
+				}
+			}
+
+			CacheCount = std::min<size_t>(NewCount, ForsythCacheSize);
+			std::copy(NewCache, NewCache + CacheCount, cache);
+
+			// nothing in the cache has triangles left, continue with the next one in input order
+			if (best < 0)
+			{
+				while (next < TriangleCount && emitted[next])
+				{
+					next++;
+				}
+
+				best = next < TriangleCount ? static_cast<int64_t>(next) : -1;
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" : splits the cache optimised
+	// order into clusters where the cache gets flushed anyway, then draws the clusters facing away from the mesh center first
+	// threshold bounds how much the ACMR of a cluster may degrade to get more, smaller clusters
+	static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+	{
+		const uint32_t CacheSize = 16;
+		size_t TriangleCount = indices.size() / 3;
+
+		if (TriangleCount == 0)
+		{
+			return;
+		}
+
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = CacheSize + 1;
+
+		auto misses = [&](size_t t)
+		{
+			uint32_t count = 0;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t index = indices[3 * t + k];
+
+				if (time - timestamps[index] > CacheSize)
+				{
+					timestamps[index] = time++;
+					count++;
+				}
+			}
+
+			return count;
+		};
+
+		auto flush = [&]() { time += CacheSize + 1; };
+
+		// hard boundaries, where a triangle misses on all three vertices
+		std::vector<size_t> hard = { 0 };
+
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			if (misses(t) == 3 && t != 0)
+			{
+				hard.push_back(t);
+			}
+		}
+
+		hard.push_back(TriangleCount);
+
+		// soft boundaries, wherever the ACMR so far is within the threshold of the whole hard cluster
+		std::vector<size_t> clusters;
+
+		for (size_t c = 0; c + 1 < hard.size(); c++)
+		{
+			size_t start = hard[c];
+			size_t end = hard[c + 1];
+
+			flush();
+			uint32_t ClusterMisses = 0;
+
+			for (size_t t = start; t < end; t++)
+			{
+				ClusterMisses += misses(t);
+			}
+
+			float ClusterThreshold = threshold * ClusterMisses / (end - start);
+
+			flush();
+			uint32_t RunningMisses = 0;
+			size_t RunningTriangles = 0;
+
+			clusters.push_back(start);
+
+			for (size_t t = start; t < end; t++)
+			{
+				RunningMisses += misses(t);
+				RunningTriangles++;
+
+				if (t + 1 < end && RunningMisses <= ClusterThreshold * RunningTriangles)
+				{
+					clusters.push_back(t + 1);
+					flush();
+					RunningMisses = 0;
+					RunningTriangles = 0;
+				}
+			}
+		}
+
+		clusters.push_back(TriangleCount);
+
+		// area weighted centroid and normal of every cluster
+		size_t ClusterCount = clusters.size() - 1;
+		std::vector<glm::vec3> centroids(ClusterCount, glm::vec3(0.0f));
+		std::vector<glm::vec3> normals(ClusterCount, glm::vec3(0.0f));
+		glm::vec3 MeshCentroid(0.0f);
+		float MeshArea = 0.0f;
+
+		for (size_t c = 0; c < ClusterCount; c++)
+		{
+			float ClusterArea = 0.0f;
+
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				const glm::vec3& a = vertices[indices[3 * t + 0]].position;
+				const glm::vec3& b = vertices[indices[3 * t + 1]].position;
+				const glm::vec3& d = vertices[indices[3 * t + 2]].position;
+
+				glm::vec3 normal = glm::cross(b - a, d - a);
+				float area = glm::length(normal);
+
+				centroids[c] += (a + b + d) * (area / 3.0f);
+				normals[c] += normal;
+				ClusterArea += area;
+			}
+
+			MeshCentroid += centroids[c];
+			MeshArea += ClusterArea;
+
+			centroids[c] = ClusterArea > 0.0f ? centroids[c] / ClusterArea : vertices[indices[3 * clusters[c]]].position;
+		}
+
+		MeshCentroid = MeshArea > 0.0f ? MeshCentroid / MeshArea : glm::vec3(0.0f);
+
+		std::vector<float> keys(ClusterCount);
+
+		for (size_t c = 0; c < ClusterCount; c++)
+		{
+			float length = glm::length(normals[c]);
+			keys[c] = length > 0.0f ? glm::dot(centroids[c] - MeshCentroid, normals[c] / length) : 0.0f;
+		}
+
+		std::vector<size_t> order(ClusterCount);
+
+		for (size_t c = 0; c < ClusterCount; c++)
+		{
+			order[c] = c;
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&keys](size_t left, size_t right) { return keys[left] > keys[right]; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		for (size_t c : order)
+		{
+			result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+		}
+
+		indices.swap(result);
+	}
+
+	// numbers the vertices in the order the index buffer first references them, unreferenced vertices are dropped
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == unused)
+			{
+				remap[index] = static_cast<uint32_t>(result.size());
+				result.push_back(vertices[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertices.swap(result);
+	}
+
+	// splits the triangles in order into chunks of at most 65536 vertices, each chunk gets a contiguous copy of the
+	// vertices it uses, so vertices shared across a chunk boundary are duplicated and the order within a chunk is kept.
+	// a new chunk also starts at each of the sorted breaks
+	static void SplitIndices16(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& breaks, std::vector<uint16_t>& ShortIndices, std::vector<MeshChunk>& chunks)
+	{
+		const uint32_t unused = std::numeric_limits<uint32_t>::max();
+		const size_t ChunkVertices = size_t(std::numeric_limits<uint16_t>::max()) + 1;
+
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<uint32_t> used;
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		ShortIndices.resize(indices.size());
+		chunks.clear();
+
+		MeshChunk chunk = {};
+		size_t NextBreak = 0;
+
+		for (size_t first = 0; first + 2 < indices.size(); first += 3)
+		{
+			size_t added = 0;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				added += remap[indices[first + k]] == unused ? 1 : 0;
+			}
+
+			bool boundary = false;
+
+			while (NextBreak < breaks.size() && breaks[NextBreak] <= first)
+			{
+				boundary = boundary || breaks[NextBreak] == first;
+				NextBreak++;
+			}
+
+			if ((used.size() + added > ChunkVertices || boundary) && chunk.IndexCount != 0)
+			{
+				chunks.push_back(chunk);
+
+				for (uint32_t index : used)
+				{
+					remap[index] = unused;
+				}
+
+				used.clear();
+
+				chunk = {
+					static_cast<uint32_t>(first),		// FirstIndex
+					0,									// IndexCount
+					static_cast<int32_t>(result.size()),// VertexOffset
+					0,									// VertexCount
+					glm::vec3(0.0f),					// minimum
+					glm::vec3(0.0f),					// maximum
+					0									// material
+				};
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t index = indices[first + k];
+
+				if (remap[index] == unused)
+				{
+					remap[index] = static_cast<uint32_t>(used.size());
+					used.push_back(index);
+					result.push_back(vertices[index]);
+				}
+
+				ShortIndices[first + k] = static_cast<uint16_t>(remap[index]);
+			}
+
+			chunk.IndexCount += 3;
+			chunk.VertexCount = static_cast<uint32_t>(used.size());
+		}
+
+		if (chunk.IndexCount != 0)
+		{
+			chunks.push_back(chunk);
+		}
+
+		vertices.swap(result);
+	}
+
+private:
+	static const size_t ForsythCacheSize = 32;
+
+	static float ScoreVertex(int32_t position, uint32_t valence)
+	{
+		// no triangles left, the vertex is of no use
+		if (valence == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+
+		if (position >= 0)
+		{
+			// the last triangle's vertices get a fixed score so its neighbours are not favoured over each other
+			if (position < 3)
+			{
+				score = 0.75f;
+			}
+			else
+			{
+				score = std::pow(1.0f - (position - 3) / static_cast<float>(ForsythCacheSize - 3), 1.5f);
+			}
+		}
+
+		// vertices with few triangles left are finished off first
+		return score + 2.0f / std::sqrt(static_cast<float>(valence));
+	}
+};
+
+// symmetric 4x4 error quadric, the area weighted sum of squared distances to a set of planes
+struct Quadric
+{
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+// Garland and Heckbert's quadric error simplification restricted to collapsing edges onto one of their vertices,
+// so every level of detail is a new index buffer over the unchanged vertex buffer
+class MeshSimplifier
+{
+public:
+	// simplifies the triangles in place until at most TargetIndexCount indices remain or the next collapse would move
+	// the surface further than TargetError, and returns the largest error introduced in model units. vertices on an
+	// open edge or on an attribute seam are never moved, so chunk boundaries and uv charts stay closed
+	static float Simplify(const Vertex* vertices, size_t VertexCount, std::vector<uint32_t>& indices, size_t TargetIndexCount, float TargetError)
+	{
+		std::vector<uint32_t> canonical = BuildPositionRemap(vertices, VertexCount);
+		std::vector<char> locked = LockVertices(canonical, indices, VertexCount);
+
+		std::vector<Quadric> quadrics(VertexCount, Quadric());
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			AddTriangle(vertices, indices[i + 0], indices[i + 1], indices[i + 2], quadrics);
+		}
+
+		std::vector<uint32_t> remap(VertexCount);
+		std::vector<char> touched(VertexCount);
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+		std::vector<Collapse> collapses;
+
+		double limit = static_cast<double>(TargetError) * TargetError;
+		double ResultError = 0.0;
+
+		while (indices.size() > TargetIndexCount)
+		{
+			BuildAdjacency(indices, VertexCount, offsets, triangles);
+
+			collapses.clear();
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					uint32_t a = indices[i + k];
+					uint32_t b = indices[i + (k + 1) % 3];
+
+					// interior edges are seen from both of their triangles, open edges only have locked vertices
+					if (a > b || (locked[a] && locked[b]))
+					{
+						continue;
+					}
+
+					double forward = locked[a] ? std::numeric_limits<double>::max() : CollapseError(quadrics[a], quadrics[b], vertices[b].position);
+					double backward = locked[b] ? std::numeric_limits<double>::max() : CollapseError(quadrics[a], quadrics[b], vertices[a].position);
+
+					Collapse collapse = {
+						forward <= backward ? a : b,				// source
+						forward <= backward ? b : a,				// target
+						std::min(forward, backward)					// error
+					};
+
+					collapses.push_back(collapse);
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& left, const Collapse& right) { return left.error < right.error; });
+
+			for (uint32_t i = 0; i < VertexCount; i++)
+			{
+				remap[i] = i;
+			}
+
+			std::fill(touched.begin(), touched.end(), 0);
+
+			size_t TriangleCount = indices.size() / 3;
+			size_t TargetTriangleCount = TargetIndexCount / 3;
+			size_t applied = 0;
+
+			// every vertex takes part in at most one collapse per pass so the error and flip tests stay valid
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapse.error > limit || TriangleCount <= TargetTriangleCount)
+				{
+					break;
+				}
+
+				if (touched[collapse.source] || touched[collapse.target])
+				{
+					continue;
+				}
+
+				size_t removed = 0;
+
+				if (Flips(vertices, indices, canonical, remap, offsets, triangles, collapse, removed))
+				{
+					continue;
+				}
+
+				remap[collapse.source] = collapse.target;
+				Accumulate(quadrics[collapse.target], quadrics[collapse.source]);
+
+				touched[collapse.source] = 1;
+				touched[collapse.target] = 1;
+
+				TriangleCount -= std::min(removed, TriangleCount);
+				ResultError = std::max(ResultError, collapse.error);
+				applied++;
+			}
+
+			if (applied == 0)
+			{
+				break;
+			}
+
+			size_t count = 0;
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				uint32_t a = remap[indices[i + 0]];
+				uint32_t b = remap[indices[i + 1]];
+				uint32_t c = remap[indices[i + 2]];
+
+				// collapsed triangles may still reference different vertices at the same position
+				if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+				{
+					continue;
+				}
+
+				indices[count + 0] = a;
+				indices[count + 1] = b;
+				indices[count + 2] = c;
+				count += 3;
+			}
+
+			indices.resize(count);
+		}
+
+		return static_cast<float>(std::sqrt(ResultError));
+	}
+
+private:
+	struct Collapse
+	{
+		uint32_t source;
+		uint32_t target;
+		double error;
+	};
+
+	// maps every vertex to the first vertex with the same position
+	static std::vector<uint32_t> BuildPositionRemap(const Vertex* vertices, size_t VertexCount)
+	{
+		std::vector<uint32_t> order(VertexCount);
+
+		for (uint32_t i = 0; i < VertexCount; i++)
+		{
+			order[i] = i;
+		}
+
+		auto less = [vertices](uint32_t left, uint32_t right)
+		{
+			const glm::vec3& a = vertices[left].position;
+			const glm::vec3& b = vertices[right].position;
+
+			return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+		};
+
+		std::sort(order.begin(), order.end(), less);
+
+		std::vector<uint32_t> canonical(VertexCount);
+
+		for (size_t i = 0; i < VertexCount; i++)
+		{
+			bool same = i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position;
+			canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+		}
+
+		return canonical;
+	}
+
+	static std::vector<char> LockVertices(const std::vector<uint32_t>& canonical, const std::vector<uint32_t>& indices, size_t VertexCount)
+	{
+		std::vector<char> locked(VertexCount, 0);
+		std::vector<uint32_t> wedges(VertexCount, 0);
+
+		for (size_t i = 0; i < VertexCount; i++)
+		{
+			wedges[canonical[i]]++;
+		}
+
+		for (size_t i = 0; i < VertexCount; i++)
+		{
+			locked[i] = wedges[canonical[i]] > 1;
+		}
+
+		auto key = [&canonical](uint32_t a, uint32_t b)
+		{
+			return (static_cast<uint64_t>(canonical[a]) << 32) | canonical[b];
+		};
+
+		std::unordered_set<uint64_t> edges;
+		edges.reserve(indices.size());
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				edges.insert(key(indices[i + k], indices[i + (k + 1) % 3]));
+			}
+		}
+
+		// an edge whose opposite half edge is missing is on the border
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t a = indices[i + k];
+				uint32_t b = indices[i + (k + 1) % 3];
+
+				if (edges.count(key(b, a)) == 0)
+				{
+					locked[a] = 1;
+					locked[b] = 1;
+				}
+			}
+		}
+
+		return locked;
+	}
+
+	// triangles of each vertex, the ones of vertex i are triangles[offsets[i]] to triangles[offsets[i + 1]]
+	static void BuildAdjacency(const std::vector<uint32_t>& indices, size_t VertexCount, std::vector<uint32_t>& offsets, std::vector<uint32_t>& triangles)
+	{
+		offsets.assign(VertexCount + 1, 0);
+		triangles.resize(indices.size());
+
+		for (uint32_t index : indices)
+		{
+			offsets[index + 1]++;
+		}
+
+		for (size_t i = 0; i < VertexCount; i++)
+		{
+			offsets[i + 1] += offsets[i];
+		}
+
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	// counts the triangles the collapse removes and rejects it when one of the remaining ones would turn over
+	static bool Flips(const Vertex* vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& canonical, const std::vector<uint32_t>& remap,
+		const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& triangles, const Collapse& collapse, size_t& removed)
+	{
+		glm::vec3 target = vertices[collapse.target].position;
+
+		for (uint32_t i = offsets[collapse.source]; i < offsets[collapse.source + 1]; i++)
+		{
+			uint32_t triangle = triangles[i];
+			uint32_t corners[3] = { remap[indices[3 * triangle + 0]], remap[indices[3 * triangle + 1]], remap[indices[3 * triangle + 2]] };
+
+			if (canonical[corners[0]] == canonical[collapse.target] || canonical[corners[1]] == canonical[collapse.target] || canonical[corners[2]] == canonical[collapse.target])
+			{
+				removed++;
+				continue;
+			}
+
+			glm::vec3 before[3];
+			glm::vec3 after[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				before[k] = vertices[corners[k]].position;
+				after[k] = corners[k] == collapse.source ? target : before[k];
+			}
+
+			glm::vec3 BeforeNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 AfterNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+			if (glm::dot(BeforeNormal, AfterNormal) <= 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static void AddTriangle(const Vertex* vertices, uint32_t a, uint32_t b, uint32_t c, std::vector<Quadric>& quadrics)
+	{
+		glm::vec3 p0 = vertices[a].position;
+		glm::vec3 normal = glm::cross(vertices[b].position - p0, vertices[c].position - p0);
+		float length = glm::length(normal);
+
+		if (length == 0.0f)
+		{
+			return;
+		}
+
+		normal = normal / length;
+
+		double x = normal.x;
+		double y = normal.y;
+		double z = normal.z;
+		double d = -glm::dot(normal, p0);
+		double area = 0.5 * length;
+
+		Quadric plane = {
+			area * x * x, area * y * y, area * z * z, area * x * y, area * x * z, area * y * z,	// a00 a11 a22 a01 a02 a12
+			area * x * d, area * y * d, area * z * d,												// b0 b1 b2
+			area * d * d,																			// c
+			area																					// weight
+		};
+
+		Accumulate(quadrics[a], plane);
+		Accumulate(quadrics[b], plane);
+		Accumulate(quadrics[c], plane);
+	}
+
+	static void Accumulate(Quadric& quadric, const Quadric& other)
+	{
+		quadric.a00 += other.a00;
+		quadric.a11 += other.a11;
+		quadric.a22 += other.a22;
+		quadric.a01 += other.a01;
+		quadric.a02 += other.a02;
+		quadric.a12 += other.a12;
+		quadric.b0 += other.b0;
+		quadric.b1 += other.b1;
+		quadric.b2 += other.b2;
+		quadric.c += other.c;
+		quadric.weight += other.weight;
+	}
+
+	// mean squared distance from the position to the planes of both quadrics
+	static double CollapseError(const Quadric& first, const Quadric& second, const glm::vec3& position)
+	{
+		Quadric q = first;
+		Accumulate(q, second);
+
+		double x = position.x;
+		double y = position.y;
+		double z = position.z;
+
+		double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z;
+		error += 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z);
+		error += 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z);
+		error += q.c;
+
+		return q.weight > 0.0 ? std::max(error, 0.0) / q.weight : 0.0;
+	}
+};
+
+// axis aligned boxes as centres and half extents in structure of arrays form, padded to a multiple of four
+struct BoundingBoxes
+{
+	std::vector<float> CenterX;
+	std::vector<float> CenterY;
+	std::vector<float> CenterZ;
+	std::vector<float> ExtentX;
+	std::vector<float> ExtentY;
+	std::vector<float> ExtentZ;
+	size_t count = 0;
+
+	void Assign(const MeshChunk* chunks, size_t ChunkCount)
+	{
+		Resize(ChunkCount);
+
+		for (size_t i = 0; i < ChunkCount; i++)
+		{
+			Set(i, (chunks[i].minimum + chunks[i].maximum) * 0.5f, (chunks[i].maximum - chunks[i].minimum) * 0.5f);
+		}
+	}
+
+	// the padding lanes stay empty boxes at the origin
+	void Resize(size_t BoxCount)
+	{
+		count = BoxCount;
+
+		size_t padded = (BoxCount + 3) & ~size_t(3);
+
+		for (std::vector<float>* values : { &CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ })
+		{
+			values->assign(padded, 0.0f);
+		}
+	}
+
+	void Set(size_t i, const glm::vec3& center, const glm::vec3& extent)
+	{
+		CenterX[i] = center.x;
+		CenterY[i] = center.y;
+		CenterZ[i] = center.z;
+		ExtentX[i] = extent.x;
+		ExtentY[i] = extent.y;
+		ExtentZ[i] = extent.z;
+	}
+};
+
+class FrustumCuller
+{
+public:
+	// the inward facing planes of the view volume of a matrix with Vulkan's 0 to 1 depth range, in the space the
+	// matrix transforms from (Gribb and Hartmann)
+	static std::array<glm::vec4, 6> ExtractPlanes(const glm::mat4& matrix)
+	{
+		glm::vec4 rows[4];
+
+		for (int i = 0; i < 4; i++)
+		{
+			rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+		}
+
+		std::array<glm::vec4, 6> planes = {
+			rows[3] + rows[0],	// left
+			rows[3] - rows[0],	// right
+			rows[3] + rows[1],	// bottom
+			rows[3] - rows[1],	// top
+			rows[2],			// near
+			rows[3] - rows[2]	// far
+		};
+
+		return planes;
+	}
+
+	// writes the indices of the boxes that are not completely behind one of the planes, four boxes at a time with SSE
+	static void Cull(const std::array<glm::vec4, 6>& planes, const BoundingBoxes& boxes, std::vector<uint32_t>& visible)
+	{
+		visible.clear();
+
+#ifdef FRUSTUM_CULLING_SSE
+		for (size_t i = 0; i < boxes.count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&boxes.CenterX[i]);
+			__m128 cy = _mm_loadu_ps(&boxes.CenterY[i]);
+			__m128 cz = _mm_loadu_ps(&boxes.CenterZ[i]);
+			__m128 ex = _mm_loadu_ps(&boxes.ExtentX[i]);
+			__m128 ey = _mm_loadu_ps(&boxes.ExtentY[i]);
+			__m128 ez = _mm_loadu_ps(&boxes.ExtentZ[i]);
+
+			__m128 outside = _mm_setzero_ps();
+
+			for (const glm::vec4& plane : planes)
+			{
+				// signed distance of the centre plus the box's half extent along the plane normal
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y)))),
+					_mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+
+			int mask = ~_mm_movemask_ps(outside) & 0xF;
+
+			for (size_t lane = 0; lane < 4 && i + lane < boxes.count; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					visible.push_back(static_cast<uint32_t>(i + lane));
+				}
+			}
+		}
+#else
+		for (size_t i = 0; i < boxes.count; i++)
+		{
+			bool inside = true;
+
+			for (const glm::vec4& plane : planes)
+			{
+				float distance = boxes.CenterX[i] * plane.x + boxes.CenterY[i] * plane.y + boxes.CenterZ[i] * plane.z + plane.w;
+				float radius = boxes.ExtentX[i] * std::abs(plane.x) + boxes.ExtentY[i] * std::abs(plane.y) + boxes.ExtentZ[i] * std::abs(plane.z);
+
+				inside = inside && distance + radius >= 0.0f;
+			}
+
+			if (inside)
+			{
+				visible.push_back(static_cast<uint32_t>(i));
+			}
+		}
+#endif
+	}
+};
+
+// one image of a decode batch, its encoded bytes and the memory its RGBA8 pixels go to
+struct ImageDecodeJob
+{
+	const char* data;
+	size_t size;
+
+	// ImageDecoder::GetSize bytes, cached memory since the decoder reads back what it has written
+	uint8_t* destination;
+
+	// filled in by ImageDecoder::ReadInfo
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	// the pixels were decoded in place rather than into a buffer of the decoder's own and copied
+	bool direct = false;
+
+	// the body decoded to the size of the header, destination holds nothing usable otherwise
+	bool decoded = false;
+};
+
+// destination of the image a thread decodes, lent to at most one of stb_image's allocations at a time
+struct ImageDecodeTarget
+{
+	uint8_t* data = nullptr;
+
+	// the exact size stb_image allocates the pixels it returns with, 0 when the format's is not known
+	size_t size = 0;
+	bool lent = false;
+};
+
+// decodes JPEG and PNG images with stb_image into memory given by the caller, a batch of them at once on a thread pool.
+// stb_image only returns buffers it allocated itself, so its allocations come here. An STBI_MALLOC of exactly the size
+// the format allocates its returned pixels with is given the destination, every other allocation goes to the heap.
+// These stb_image paths were checked:
+// - JPEG: stbi__load_jpeg_image allocates the output with stbi__malloc_mad3(4, w, h, 1), w * h * 4 + 1 bytes. The
+//   scratch buffers are the decoder itself, the component planes of w2 * h2 + 15 bytes (w2 and h2 multiples of 8), the
+//   w + 3 byte line buffers and the progressive coefficients, none of which can be that size
+// - PNG: the output is allocated with exactly w * h * 4 bytes by stbi__create_png_image, stbi__expand_png_palette,
+//   stbi__convert_format or stbi__convert_16_to_8, whichever runs last, and an interlaced image is allocated before
+//   its smaller passes. The IDAT buffer grows with STBI_REALLOC from nothing and is never lent. The zlib output is the
+//   only scratch buffer that can be that size, for an RGB image one texel wide, and it is still live when the output
+//   is allocated, so that image is copied
+// Other formats are decoded into the heap. Should a scratch buffer still get the destination, it is freed before
+// stb_image returns, the pixels come back in another buffer and are copied, so a mismatch only costs the copy
+class ImageDecoder
+{
+public:
+	// bytes a destination needs, stb_image's JPEG decoder asks for one more than the pixels and never writes it
+	static size_t GetSize(uint32_t width, uint32_t height)
+	{
+		return static_cast<size_t>(width) * height * 4 + 1;
+	}
+
+	// reads the size from the header without decoding anything
+	static bool ReadInfo(ImageDecodeJob& job)
+	{
+		int width;
+		int height;
+		int channels;
+
+		if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(job.data), static_cast<int>(job.size), &width, &height, &channels))
+		{
+			return false;
+		}
+
+		job.width = width;
+		job.height = height;
+
+		return true;
+	}
+
+	// decodes every job of the batch, one image per iteration, a job that fails is left with decoded false and does not
+	// stop the others
+	static void Decode(std::vector<ImageDecodeJob>& jobs, ThreadPool& workers)
+	{
+		workers.ParallelFor(jobs.size(), [&jobs](size_t i) { Decode(jobs[i]); });
+	}
+
+	// a truncated or corrupt body, or one whose size differs from the header, fails the job
+	static bool Decode(ImageDecodeJob& job)
+	{
+		size_t PixelBytes = static_cast<size_t>(job.width) * job.height * 4;
+		target = { job.destination, GetOutputAllocationSize(job), false };
+
+		int width;
+		int height;
+		int channels;
+
+		stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(job.data), static_cast<int>(job.size), &width, &height, &channels, STBI_rgb_alpha);
+
+		target = ImageDecodeTarget();
+
+		job.direct = false;
+		job.decoded = false;
+
+		if (pixels == nullptr)
+		{
+			return false;
+		}
+
+		job.direct = pixels == job.destination;
+		job.decoded = static_cast<uint32_t>(width) == job.width && static_cast<uint32_t>(height) == job.height;
+
+		if (!job.direct)
+		{
+			if (job.decoded)
+			{
+				memcpy(job.destination, pixels, PixelBytes);
+			}
+
+			stbi_image_free(pixels);
+		}
+
+		return job.decoded;
+	}
+
+private:
+	static inline thread_local ImageDecodeTarget target;
+
+	// the size stb_image allocates the pixels it returns with, by the format's signature, see the class comment
+	static size_t GetOutputAllocationSize(const ImageDecodeJob& job)
+	{
+		static const uint8_t JpegSignature[] = { 0xFF, 0xD8 };
+		static const uint8_t PngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		size_t PixelBytes = static_cast<size_t>(job.width) * job.height * 4;
+
+		if (job.size >= sizeof(JpegSignature) && memcmp(job.data, JpegSignature, sizeof(JpegSignature)) == 0)
+		{
+			return PixelBytes + 1;
+		}
+
+		if (job.size >= sizeof(PngSignature) && memcmp(job.data, PngSignature, sizeof(PngSignature)) == 0)
+		{
+			return PixelBytes;
+		}
+
+		return 0;
+	}
+
+	friend void* DecoderMalloc(size_t size);
+	friend void* DecoderRealloc(void* pointer, size_t size);
+	friend void DecoderFree(void* pointer);
+};
+
+void* DecoderMalloc(size_t size)
+{
+	ImageDecodeTarget& target = ImageDecoder::target;
+
+	if (target.data != nullptr && !target.lent && size == target.size)
+	{
+		target.lent = true;
+		return target.data;
+	}
+
+	return malloc(size);
+}
+
+void* DecoderRealloc(void* pointer, size_t size)
+{
+	ImageDecodeTarget& target = ImageDecoder::target;
+
+	// stb_image grows its IDAT and zlib buffers from nothing this way, the pixels it returns are never reallocated
+	if (pointer == nullptr)
+	{
+		return malloc(size);
+	}
+
+	if (pointer != target.data)
+	{
+		return realloc(pointer, size);
+	}
+
+	if (size <= target.size)
+	{
+		return pointer;
+	}
+
+	// grown past the destination, the contents move to the heap
+	void* moved = malloc(size);
+
+	if (moved != nullptr)
+	{
+		memcpy(moved, pointer, target.size);
+		target.lent = false;
+	}
+
+	return moved;
+}
+
+void DecoderFree(void* pointer)
+{
+	ImageDecodeTarget& target = ImageDecoder::target;
+
+	if (pointer != nullptr && pointer == target.data)
+	{
+		target.lent = false;
+		return;
+	}
+
+	free(pointer);
+}
+
+// formats the texture can be stored in, in order of preference
+struct TextureEncoding
+{
+	VkFormat format;
+
+	// file suffix of the converted texture and value of --texture-format
+	const char* name;
+
+	// texels along each side of a block and bytes per block
+	uint32_t BlockDimension;
+	uint32_t BlockBytes;
+
+	// there is no ASTC or ETC2 encoder here, those formats are only used when a KTX2 file converted offline is present
+	bool encodable;
+};
+
+const TextureEncoding TextureEncodings[] = {
+	{ VK_FORMAT_BC7_UNORM_BLOCK,			"bc7",		4,	16,	true },
+	{ VK_FORMAT_ASTC_4x4_UNORM_BLOCK,		"astc",		4,	16,	false },
+	{ VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK,	"etc2",		4,	8,	false },
+	{ VK_FORMAT_BC1_RGB_UNORM_BLOCK,		"bc1",		4,	8,	true },
+	{ VK_FORMAT_R8G8B8A8_UNORM,				"rgba8",	1,	4,	true }
+};
+
+// the kernels the CPU mip chain can be filtered with, from the cheapest to the sharpest
+enum class MipFilter
+{
+	box,
+	kaiser,
+	lanczos
+};
+
+const char* const MipFilterNames[] = { "box", "kaiser", "lanczos" };
+
+// CPU mip chain of an RGBA8 image. Each level is filtered from the previous one with a separable kernel, one band of
+// output rows per task: the source rows are decoded to linear floats once, filtered vertically into a row and then
+// horizontally into the output. The small levels at the end of the chain are filtered on one thread. With srgb the
+// colour channels are decoded to linear light before filtering and encoded again after, alpha is always linear
+class MipGenerator
+{
+public:
+	MipGenerator(MipFilter filter, bool srgb) : IntegerBox(filter == MipFilter::box && !srgb), SrgbColor(srgb)
+	{
+		// half width of the kernel in output texels
+		float support = filter == MipFilter::box ? 0.5f : filter == MipFilter::kaiser ? 2.0f : 3.0f;
+
+		// source texel 2x + t covers the output texel x centred between source texels 2x and 2x + 1
+		radius = static_cast<int>(std::ceil(support * 2.0f));
+		float sum = 0.0f;
+
+		for (int t = 1 - radius; t <= radius; t++)
+		{
+			float distance = (t - 0.5f) / 2.0f;
+			float weight = 1.0f;
+
+			if (filter == MipFilter::kaiser)
+			{
+				float x = distance / support;
+				weight = Sinc(distance) * BesselI0(KaiserAlpha * std::sqrt(std::max(1.0f - x * x, 0.0f))) / BesselI0(KaiserAlpha);
+			}
+			else if (filter == MipFilter::lanczos)
+			{
+				weight = Sinc(distance) * Sinc(distance / support);
+			}
+
+			weights.push_back(weight);
+			sum += weight;
+		}
+
+		for (float& weight : weights)
+		{
+			weight /= sum;
+		}
+
+		// a byte is the number of thresholds at or below the filtered value, which rounds to the nearest code
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			ToLinear[i][0] = ToLinear[i][1] = ToLinear[i][2] = srgb ? SrgbToLinear(i / 255.0f) : i / 255.0f;
+			ToLinear[i][3] = i / 255.0f;
+
+			thresholds[0][i] = thresholds[1][i] = thresholds[2][i] = srgb ? SrgbToLinear((i + 0.5f) / 255.0f) : (i + 0.5f) / 255.0f;
+			thresholds[3][i] = (i + 0.5f) / 255.0f;
+		}
+
+		// the count of thresholds below each step of a coarse table, the search goes on linearly from there
+		for (int c = 0; c < 4; c++)
+		{
+			thresholds[c][255] = std::numeric_limits<float>::max();
+
+			for (uint32_t i = 0; i < QuantizationSteps; i++)
+			{
+				float value = i / static_cast<float>(QuantizationSteps);
+				QuantizationStart[c][i] = static_cast<uint8_t>(std::lower_bound(thresholds[c], thresholds[c] + 255, value) - thresholds[c]);
+			}
+		}
+	}
+
+	static uint32_t GetLevelCount(uint32_t width, uint32_t height)
+	{
+		uint32_t count = 1;
+
+		while (width > 1 || height > 1)
+		{
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+			count++;
+		}
+
+		return count;
+	}
+
+	// fills levels[1] and up from levels[0], each pointing to enough memory for its level, e.g. in a staging buffer
+	void Generate(const std::vector<uint8_t*>& levels, uint32_t width, uint32_t height, ThreadPool& workers) const
+	{
+		size_t i = 1;
+
+		for (; i < levels.size() && std::max(height / 2, 1u) >= workers.GetThreadCount(); i++)
+		{
+			Downsample(levels[i - 1], width, height, levels[i], workers);
+
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+
+		// the levels left have fewer rows than there are threads, waking the pool for a few rows per level costs more
+		// than filtering the rest of the chain on this thread
+		for (; i < levels.size(); i++)
+		{
+			DownsampleRows(levels[i - 1], width, height, levels[i], 0, std::max(height / 2, 1u));
+
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+	}
+
+	// writes the next level of a width x height image, edge texels repeat outwards
+	void Downsample(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* destination, ThreadPool& workers) const
+	{
+		uint32_t LevelHeight = std::max(height / 2, 1u);
+
+		// a few contiguous bands per thread, the source rows two neighbouring output rows share are only decoded again
+		// where one band ends and the next one starts
+		uint32_t BandRows = static_cast<uint32_t>((LevelHeight + 4 * workers.GetThreadCount() - 1) / (4 * workers.GetThreadCount()));
+		uint32_t BandCount = (LevelHeight + BandRows - 1) / BandRows;
+
+		workers.ParallelFor(BandCount, [&](size_t band)
+		{
+			uint32_t first = static_cast<uint32_t>(band) * BandRows;
+			DownsampleRows(source, width, height, destination, first, std::min(first + BandRows, LevelHeight));
+		});
+	}
+
+	// writes output rows [first, last) of the next level
+	void DownsampleRows(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* destination, uint32_t first, uint32_t last) const
+	{
+		if (IntegerBox)
+		{
+			for (uint32_t y = first; y < last; y++)
+			{
+				DownsampleBoxRow(source, width, height, y, destination);
+			}
+
+			return;
+		}
+
+		uint32_t LevelWidth = std::max(width / 2, 1u);
+		size_t taps = weights.size();
+		size_t stride = static_cast<size_t>(width) * 4;
+
+		// the source rows decoded to linear floats, row r in slot r % taps. The kernel of an output row covers taps
+		// consecutive rows, so they never share a slot, and moving to the next output row only decodes two new ones
+		thread_local std::vector<float> decoded;
+		decoded.resize(taps * stride);
+
+		int64_t SlotRows[MaxTaps];
+		std::fill(SlotRows, SlotRows + taps, int64_t(-1));
+
+		// the vertically filtered row, with radius texels on either side repeating its edges so the horizontal pass
+		// never clamps
+		thread_local std::vector<float> row;
+		row.resize((static_cast<size_t>(width) + 2 * radius) * 4);
+		float* centre = &row[radius * 4];
+
+		for (uint32_t y = first; y < last; y++)
+		{
+			const float* inputs[MaxTaps];
+
+			for (size_t k = 0; k < taps; k++)
+			{
+				int64_t SourceY = std::min(std::max(2 * static_cast<int64_t>(y) + 1 - radius + static_cast<int64_t>(k), int64_t(0)), int64_t(height) - 1);
+				size_t slot = static_cast<size_t>(SourceY) % taps;
+
+				if (SlotRows[slot] != SourceY)
+				{
+					DecodeRow(source + static_cast<size_t>(SourceY) * stride, width, &decoded[slot * stride]);
+					SlotRows[slot] = SourceY;
+				}
+
+				inputs[k] = &decoded[slot * stride];
+			}
+
+			// every channel of every texel is independent here, so the row is summed four floats at a time
+			size_t n = 0;
+
+#ifdef MIP_GENERATOR_SSE
+			for (; n < stride; n += 4)
+			{
+				__m128 sum = _mm_setzero_ps();
+
+				for (size_t k = 0; k < taps; k++)
+				{
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&inputs[k][n]), _mm_set1_ps(weights[k])));
+				}
+
+				_mm_storeu_ps(&centre[n], sum);
+			}
+#endif
+
+			for (; n < stride; n++)
+			{
+				float sum = 0.0f;
+
+				for (size_t k = 0; k < taps; k++)
+				{
+					sum += inputs[k][n] * weights[k];
+				}
+
+				centre[n] = sum;
+			}
+
+			for (int i = 1; i <= radius; i++)
+			{
+				std::copy(centre, centre + 4, centre - i * 4);
+				std::copy(centre + (width - 1) * 4, centre + width * 4, centre + (width - 1 + i) * 4);
+			}
+
+			uint8_t* output = destination + static_cast<size_t>(y) * LevelWidth * 4;
+
+			for (uint32_t x = 0; x < LevelWidth; x++)
+			{
+				const float* input = centre + (2 * static_cast<int64_t>(x) + 1 - radius) * 4;
+				float texel[4];
+
+#ifdef MIP_GENERATOR_SSE
+				__m128 sum = _mm_setzero_ps();
+
+				for (size_t k = 0; k < taps; k++)
+				{
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&input[k * 4]), _mm_set1_ps(weights[k])));
+				}
+
+				_mm_storeu_ps(texel, sum);
+#else
+				for (int c = 0; c < 4; c++)
+				{
+					texel[c] = 0.0f;
+
+					for (size_t k = 0; k < taps; k++)
+					{
+						texel[c] += input[k * 4 + c] * weights[k];
+					}
+				}
+#endif
+
+				for (int c = 0; c < 4; c++)
+				{
+					output[x * 4 + c] = Quantize(texel[c], c);
+				}
+			}
+		}
+	}
+
+	// integer 2x2 box filter of output row y, two texels at a time with SSE2
+	static void DownsampleBoxRow(const uint8_t* source, uint32_t width, uint32_t height, uint32_t y, uint8_t* destination)
+	{
+		uint32_t LevelWidth = std::max(width / 2, 1u);
+
+		const uint8_t* row0 = source + static_cast<size_t>(std::min(2 * y, height - 1)) * width * 4;
+		const uint8_t* row1 = source + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4;
+		uint8_t* output = destination + static_cast<size_t>(y) * LevelWidth * 4;
+
+		uint32_t x = 0;
+
+#ifdef MIP_GENERATOR_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+
+		// four source texels of each row make two output texels, the sums of the two halves of each register
+		for (; width >= 2 && x + 1 < LevelWidth; x += 2)
+		{
+			__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row0[x * 8]));
+			__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row1[x * 8]));
+
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&output[x * 4]), _mm_packus_epi16(sum, sum));
+		}
+#endif
+
+		for (; x < LevelWidth; x++)
+		{
+			uint32_t x0 = std::min(2 * x, width - 1) * 4;
+			uint32_t x1 = std::min(2 * x + 1, width - 1) * 4;
+
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				output[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+
+	// integer 2x2 box filter on one thread without SIMD, the reference the mip benchmark compares with
+	static void DownsampleBox(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* destination)
+	{
+		uint32_t LevelWidth = std::max(width / 2, 1u);
+		uint32_t LevelHeight = std::max(height / 2, 1u);
+
+		for (uint32_t y = 0; y < LevelHeight; y++)
+		{
+			const uint8_t* row0 = source + static_cast<size_t>(std::min(2 * y, height - 1)) * width * 4;
+			const uint8_t* row1 = source + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4;
+			uint8_t* output = destination + static_cast<size_t>(y) * LevelWidth * 4;
+
+			for (uint32_t x = 0; x < LevelWidth; x++)
+			{
+				uint32_t x0 = std::min(2 * x, width - 1) * 4;
+				uint32_t x1 = std::min(2 * x + 1, width - 1) * 4;
+
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					output[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+				}
+			}
+		}
+	}
+
+private:
+	static constexpr float KaiserAlpha = 4.0f;
+
+	// the normalised weights of source texels 2x + 1 - radius to 2x + radius
+	static const int MaxTaps = 12;
+	int radius;
+
+	// the box filter on encoded values needs no float conversion, it averages the bytes like a blit would
+	bool IntegerBox;
+
+	// the colour channels are decoded from and encoded to sRGB
+	bool SrgbColor;
+	std::vector<float> weights;
+
+	static const uint32_t QuantizationSteps = 4096;
+
+	float ToLinear[256][4];
+	float thresholds[4][256];
+	uint8_t QuantizationStart[4][QuantizationSteps];
+
+	// the nearest code of a filtered value, sRGB codes are spaced at least a table step apart so the walk is short
+	uint8_t Quantize(float value, int channel) const
+	{
+		int step = static_cast<int>(std::min(std::max(value, 0.0f), 1.0f) * (QuantizationSteps - 1));
+		uint32_t code = QuantizationStart[channel][step];
+
+		while (thresholds[channel][code] <= value)
+		{
+			code++;
+		}
+
+		return static_cast<uint8_t>(code);
+	}
+
+	// the linear values of a row of width texels, without a table lookup per byte when nothing is sRGB encoded
+	void DecodeRow(const uint8_t* input, uint32_t width, float* output) const
+	{
+		size_t count = static_cast<size_t>(width) * 4;
+		size_t i = 0;
+
+#ifdef MIP_GENERATOR_SSE2
+		if (!SrgbColor)
+		{
+			const __m128i zero = _mm_setzero_si128();
+
+			// a division rather than a multiply by 1 / 255, so the values are the ones in ToLinear
+			const __m128 scale = _mm_set1_ps(255.0f);
+
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&input[i]));
+				__m128i low = _mm_unpacklo_epi8(bytes, zero);
+				__m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+				_mm_storeu_ps(&output[i + 0], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+				_mm_storeu_ps(&output[i + 4], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+				_mm_storeu_ps(&output[i + 8], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+				_mm_storeu_ps(&output[i + 12], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			output[i] = ToLinear[input[i]][i & 3];
+		}
+	}
+
+	static float Sinc(float x)
+	{
+		const float pi = 3.14159265358979f;
+		return std::abs(x) < 1e-6f ? 1.0f : std::sin(pi * x) / (pi * x);
+	}
+
+	// modified Bessel function of the first kind of order zero, by its power series
+	static float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+
+		return sum;
+	}
+
+	static float SrgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+};
+
+// encodes RGBA8 images into BC1 or BC7 blocks, both fit the block's colours with a line along their principal axis
+class TextureCompressor
+{
+public:
+	// bytes of a width x height image in the encoding
+	static size_t GetSize(const TextureEncoding& encoding, uint32_t width, uint32_t height)
+	{
+		uint32_t BlocksX = (width + encoding.BlockDimension - 1) / encoding.BlockDimension;
+		uint32_t BlocksY = (height + encoding.BlockDimension - 1) / encoding.BlockDimension;
+
+		return static_cast<size_t>(BlocksX) * BlocksY * encoding.BlockBytes;
+	}
+
+	// writes the image in the layout of the encoding to destination, which holds GetSize bytes
+	static void Encode(const TextureEncoding& encoding, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* destination, ThreadPool& workers)
+	{
+		if (!encoding.encodable)
+		{
+			throw std::runtime_error(std::string("no encoder for texture format ") + encoding.name);
+		}
+
+		if (encoding.BlockDimension == 1)
+		{
+			if (destination != pixels)
+			{
+				memcpy(destination, pixels, GetSize(encoding, width, height));
+			}
+
+			return;
+		}
+
+		uint32_t BlocksX = (width + 3) / 4;
+		uint32_t BlocksY = (height + 3) / 4;
+
+		workers.ParallelFor(BlocksY, [&](size_t y)
+		{
+			uint8_t texels[64];
+
+			for (uint32_t x = 0; x < BlocksX; x++)
+			{
+				FetchBlock(pixels, width, height, x, static_cast<uint32_t>(y), texels);
+
+				uint8_t* block = &destination[(y * BlocksX + x) * encoding.BlockBytes];
+
+				if (encoding.format == VK_FORMAT_BC7_UNORM_BLOCK)
+				{
+					EncodeBC7(texels, block);
+				}
+				else
+				{
+					EncodeBC1(texels, block);
+				}
+			}
+		});
+	}
+
+	// opaque four colour block: two RGB565 endpoints and a 2 bit index per texel
+	static void EncodeBC1(const uint8_t texels[64], uint8_t block[8])
+	{
+		float low[4];
+		float high[4];
+		FitLine(texels, 3, low, high);
+
+		uint16_t color0 = PackRGB565(high);
+		uint16_t color1 = PackRGB565(low);
+
+		// the four colour mode is selected by color0 > color1
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+
+		uint32_t indices = 0;
+
+		if (color0 != color1)
+		{
+			float palette[4][3];
+			UnpackRGB565(color0, palette[0]);
+			UnpackRGB565(color1, palette[1]);
+
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+				palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+			}
+
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				indices |= NearestColor(&texels[i * 4], &palette[0][0], 4, 3) << (2 * i);
+			}
+		}
+
+		block[0] = static_cast<uint8_t>(color0);
+		block[1] = static_cast<uint8_t>(color0 >> 8);
+		block[2] = static_cast<uint8_t>(color1);
+		block[3] = static_cast<uint8_t>(color1 >> 8);
+
+		for (int i = 0; i < 4; i++)
+		{
+			block[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+		}
+	}
+
+	// mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, and a 4 bit index per texel
+	static void EncodeBC7(const uint8_t texels[64], uint8_t block[16])
+	{
+		static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		float line[2][4];
+		FitLine(texels, 4, line[0], line[1]);
+
+		uint32_t endpoints[2][4];
+		uint32_t pbits[2];
+
+		for (int e = 0; e < 2; e++)
+		{
+			QuantizeBC7Endpoint(line[e], endpoints[e], pbits[e]);
+		}
+
+		float palette[16][4];
+
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				uint32_t e0 = (endpoints[0][c] << 1) | pbits[0];
+				uint32_t e1 = (endpoints[1][c] << 1) | pbits[1];
+
+				palette[i][c] = static_cast<float>(((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6);
+			}
+		}
+
+		uint32_t indices[16];
+
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			indices[i] = NearestColor(&texels[i * 4], &palette[0][0], 16, 4);
+		}
+
+		// the first index is stored with 3 bits, so its top bit has to be clear
+		if (indices[0] & 8)
+		{
+			std::swap(endpoints[0], endpoints[1]);
+			std::swap(pbits[0], pbits[1]);
+
+			for (uint32_t& index : indices)
+			{
+				index = 15 - index;
+			}
+		}
+
+		uint64_t bits[2] = { 0, 0 };
+		uint32_t position = 0;
+
+		auto put = [&](uint64_t value, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++, position++)
+			{
+				bits[position / 64] |= ((value >> i) & 1) << (position % 64);
+			}
+		};
+
+		put(1 << 6, 7);
+
+		for (int c = 0; c < 4; c++)
+		{
+			put(endpoints[0][c], 7);
+			put(endpoints[1][c], 7);
+		}
+
+		put(pbits[0], 1);
+		put(pbits[1], 1);
+		put(indices[0], 3);
+
+		for (int i = 1; i < 16; i++)
+		{
+			put(indices[i], 4);
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			block[i] = static_cast<uint8_t>(bits[i / 8] >> (8 * (i % 8)));
+		}
+	}
+
+private:
+	// the texels of block (x, y), those past the right or bottom edge repeat the last column or row
+	static void FetchBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t x, uint32_t y, uint8_t texels[64])
+	{
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			uint32_t py = std::min(y * 4 + row, height - 1);
+
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				uint32_t px = std::min(x * 4 + column, width - 1);
+
+				memcpy(&texels[(row * 4 + column) * 4], &pixels[(static_cast<size_t>(py) * width + px) * 4], 4);
+			}
+		}
+	}
+
+	// the extremes of the texels projected on the principal axis of their first channels, found by power iteration
+	// on the covariance matrix
+	static void FitLine(const uint8_t texels[64], int channels, float low[4], float high[4])
+	{
+		float mean[4] = {};
+		float minimum[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+		float maximum[4] = {};
+
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				float value = texels[i * 4 + c];
+
+				mean[c] += value / 16.0f;
+				minimum[c] = std::min(minimum[c], value);
+				maximum[c] = std::max(maximum[c], value);
+			}
+		}
+
+		float covariance[4][4] = {};
+
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					covariance[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+				}
+			}
+		}
+
+		float axis[4] = {};
+
+		for (int c = 0; c < channels; c++)
+		{
+			axis[c] = maximum[c] - minimum[c];
+		}
+
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					next[a] += covariance[a][b] * axis[b];
+				}
+
+				length = std::max(length, std::abs(next[a]));
+			}
+
+			// a flat block has no axis to follow
+			if (length == 0.0f)
+			{
+				break;
+			}
+
+			for (int c = 0; c < channels; c++)
+			{
+				axis[c] = next[c] / length;
+			}
+		}
+
+		float LengthSquared = 0.0f;
+
+		for (int c = 0; c < channels; c++)
+		{
+			LengthSquared += axis[c] * axis[c];
+		}
+
+		float lowest = 0.0f;
+		float highest = 0.0f;
+
+		if (LengthSquared > 0.0f)
+		{
+			lowest = std::numeric_limits<float>::max();
+			highest = -std::numeric_limits<float>::max();
+
+			for (int i = 0; i < 16; i++)
+			{
+				float t = 0.0f;
+
+				for (int c = 0; c < channels; c++)
+				{
+					t += (texels[i * 4 + c] - mean[c]) * axis[c];
+				}
+
+				lowest = std::min(lowest, t / LengthSquared);
+				highest = std::max(highest, t / LengthSquared);
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			low[c] = c < channels ? std::min(std::max(mean[c] + axis[c] * lowest, 0.0f), 255.0f) : 255.0f;
+			high[c] = c < channels ? std::min(std::max(mean[c] + axis[c] * highest, 0.0f), 255.0f) : 255.0f;
+		}
+	}
+
+	static uint32_t NearestColor(const uint8_t* texel, const float* palette, uint32_t count, int channels)
+	{
+		uint32_t best = 0;
+		float BestError = std::numeric_limits<float>::max();
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float error = 0.0f;
+
+			for (int c = 0; c < channels; c++)
+			{
+				float difference = texel[c] - palette[i * channels + c];
+				error += difference * difference;
+			}
+
+			if (error < BestError)
+			{
+				BestError = error;
+				best = i;
+			}
+		}
+
+		return best;
+	}
+
+	static uint16_t PackRGB565(const float color[4])
+	{
+		uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+		uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+		uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	static void UnpackRGB565(uint16_t color, float rgb[3])
+	{
+		uint32_t r = (color >> 11) & 31;
+		uint32_t g = (color >> 5) & 63;
+		uint32_t b = color & 31;
+
+		rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+		rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+		rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+	}
+
+	// the 7 bit endpoint and shared low bit that reconstruct the colour best
+	static void QuantizeBC7Endpoint(const float color[4], uint32_t endpoint[4], uint32_t& pbit)
+	{
+		float BestError = std::numeric_limits<float>::max();
+
+		for (uint32_t p = 0; p < 2; p++)
+		{
+			uint32_t candidate[4];
+			float error = 0.0f;
+
+			for (int c = 0; c < 4; c++)
+			{
+				long value = std::lround((color[c] - p) / 2.0f);
+				candidate[c] = static_cast<uint32_t>(std::min(std::max(value, 0l), 127l));
+
+				float difference = static_cast<float>((candidate[c] << 1) | p) - color[c];
+				error += difference * difference;
+			}
+
+			if (error < BestError)
+			{
+				BestError = error;
+				pbit = p;
+				std::copy(candidate, candidate + 4, endpoint);
+			}
+		}
+	}
+};
+
+// reader and writer for the subset of KTX2 the converted textures use: one 2D image with its whole mip chain, no
+// supercompression, and the source image's hash in the key/value data so a stale file is noticed
+class Ktx2File
+{
+public:
+	struct Level
+	{
+		const char* data;
+		size_t size;
+	};
+
+	struct Image
+	{
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		std::vector<Level> levels;
+
+		// zero when the file has no SourceHash key
+		uint64_t SourceHash;
+
+		// how the mip chain was filtered, empty when the file has no MipFilter key
+		std::string filter;
+	};
+
+	// the level pointers point into data, false when the file is not a texture this class can read
+	static bool Parse(const char* data, size_t size, Image& image)
+	{
+		if (size < HeaderSize || memcmp(data, Identifier, sizeof(Identifier)) != 0)
+		{
+			return false;
+		}
+
+		uint32_t depth = Read32(data + 28);
+		uint32_t layers = Read32(data + 32);
+		uint32_t faces = Read32(data + 36);
+		uint32_t LevelCount = Read32(data + 40);
+		uint32_t supercompression = Read32(data + 44);
+		uint32_t KeyValueOffset = Read32(data + 56);
+		uint32_t KeyValueLength = Read32(data + 60);
+
+		if (depth > 1 || layers > 1 || faces != 1 || LevelCount == 0 || supercompression != 0)
+		{
+			return false;
+		}
+
+		if (size < HeaderSize + static_cast<size_t>(LevelCount) * 24 || KeyValueOffset > size || KeyValueLength > size - KeyValueOffset)
+		{
+			return false;
+		}
+
+		image.format = static_cast<VkFormat>(Read32(data + 12));
+		image.width = Read32(data + 20);
+		image.height = Read32(data + 24);
+		image.levels.resize(LevelCount);
+		image.SourceHash = 0;
+		image.filter.clear();
+
+		for (uint32_t i = 0; i < LevelCount; i++)
+		{
+			uint64_t offset = Read64(data + HeaderSize + i * 24);
+			uint64_t length = Read64(data + HeaderSize + i * 24 + 8);
+
+			if (offset > size || length > size - offset)
+			{
+				return false;
+			}
+
+			image.levels[i] = { data + offset, static_cast<size_t>(length) };
+		}
+
+		// each entry is a 4 byte length followed by a null terminated key and the value, padded to 4 bytes
+		const char* entry = data + KeyValueOffset;
+		const char* end = entry + KeyValueLength;
+
+		while (end - entry >= 4)
+		{
+			uint32_t length = Read32(entry);
+			entry += 4;
+
+			if (length > static_cast<size_t>(end - entry))
+			{
+				break;
+			}
+
+			size_t KeyLength = strnlen(entry, length);
+
+			if (KeyLength + 1 + sizeof(uint64_t) == length && strcmp(entry, SourceHashKey) == 0)
+			{
+				image.SourceHash = Read64(entry + KeyLength + 1);
+			}
+
+			if (KeyLength < length && strcmp(entry, MipFilterKey) == 0)
+			{
+				image.filter.assign(entry + KeyLength + 1, strnlen(entry + KeyLength + 1, length - KeyLength - 1));
+			}
+
+			entry += (length + 3) & ~3u;
+		}
+
+		return true;
+	}
+
+	// levels are ordered from the full image down, the file stores them from the smallest up as the format asks
+	static bool Write(const std::string& path, const TextureEncoding& encoding, uint32_t width, uint32_t height, const std::vector<Level>& levels, uint64_t hash, const std::string& filter)
+	{
+		std::vector<uint32_t> descriptor = DataFormatDescriptor(encoding);
+
+		std::vector<char> KeyValues;
+		AppendKeyValue(KeyValues, "KTXwriter", "09_VulkanMultisampling", strlen("09_VulkanMultisampling") + 1);
+		AppendKeyValue(KeyValues, SourceHashKey, reinterpret_cast<const char*>(&hash), sizeof(hash));
+		AppendKeyValue(KeyValues, MipFilterKey, filter.c_str(), filter.size() + 1);
+
+		size_t DescriptorOffset = HeaderSize + levels.size() * 24;
+		size_t KeyValueOffset = DescriptorOffset + descriptor.size() * sizeof(uint32_t);
+		size_t end = KeyValueOffset + KeyValues.size();
+
+		// every level starts on a multiple of the block size, and of 4 for uncompressed formats
+		size_t alignment = std::max<size_t>(encoding.BlockBytes, 4);
+
+		std::vector<uint64_t> offsets(levels.size());
+
+		for (size_t i = levels.size(); i-- > 0;)
+		{
+			offsets[i] = (end + alignment - 1) / alignment * alignment;
+			end = offsets[i] + levels[i].size;
+		}
+
+		std::vector<char> file(end, 0);
+
+		memcpy(file.data(), Identifier, sizeof(Identifier));
+		Write32(&file[12], encoding.format);
+		Write32(&file[16], 1);
+		Write32(&file[20], width);
+		Write32(&file[24], height);
+		Write32(&file[36], 1);
+		Write32(&file[40], static_cast<uint32_t>(levels.size()));
+		Write32(&file[48], static_cast<uint32_t>(DescriptorOffset));
+		Write32(&file[52], static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t)));
+		Write32(&file[56], static_cast<uint32_t>(KeyValueOffset));
+		Write32(&file[60], static_cast<uint32_t>(KeyValues.size()));
+
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			Write64(&file[HeaderSize + i * 24], offsets[i]);
+			Write64(&file[HeaderSize + i * 24 + 8], levels[i].size);
+			Write64(&file[HeaderSize + i * 24 + 16], levels[i].size);
+
+			memcpy(&file[offsets[i]], levels[i].data, levels[i].size);
+		}
+
+		memcpy(&file[DescriptorOffset], descriptor.data(), descriptor.size() * sizeof(uint32_t));
+		memcpy(&file[KeyValueOffset], KeyValues.data(), KeyValues.size());
+
+		return WriteFileReplacing(path, [&](std::ostream& stream) { stream.write(file.data(), file.size()); });
+	}
+
+private:
+	static constexpr uint8_t Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	static constexpr size_t HeaderSize = 80;
+	static constexpr const char* SourceHashKey = "SourceHash";
+	static constexpr const char* MipFilterKey = "MipFilter";
+
+	// the basic block of the Khronos data format: colour model, sRGB primaries, linear transfer and one sample per
+	// channel, or a single sample covering the whole block for compressed formats
+	static std::vector<uint32_t> DataFormatDescriptor(const TextureEncoding& encoding)
+	{
+		struct Sample
+		{
+			uint32_t offset;
+			uint32_t length;
+			uint32_t channel;
+		};
+
+		std::vector<Sample> samples;
+		uint32_t model;
+
+		if (encoding.format == VK_FORMAT_R8G8B8A8_UNORM)
+		{
+			model = 1;
+			samples = { { 0, 8, 0 }, { 8, 8, 1 }, { 16, 8, 2 }, { 24, 8, 15 } };
+		}
+		else
+		{
+			// BC1, BC7, ETC2 and ASTC colour models, their only sample spans the block
+			model = encoding.format == VK_FORMAT_BC1_RGB_UNORM_BLOCK ? 128 : encoding.format == VK_FORMAT_BC7_UNORM_BLOCK ? 134 : encoding.format == VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK ? 161 : 162;
+			samples = { { 0, encoding.BlockBytes * 8, 0 } };
+		}
+
+		uint32_t BlockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+		uint32_t dimension = encoding.BlockDimension - 1;
+
+		std::vector<uint32_t> words = {
+			4 + BlockSize,								// totalSize
+			0,											// vendorId and descriptorType
+			2 | (BlockSize << 16),						// versionNumber and descriptorBlockSize
+			model | (1 << 8) | (1 << 16),				// colorModel, colorPrimaries, transferFunction, flags
+			dimension | (dimension << 8),				// texelBlockDimension
+			encoding.BlockBytes,						// bytesPlane0
+			0											// bytesPlane4
+		};
+
+		for (const Sample& sample : samples)
+		{
+			words.push_back(sample.offset | ((sample.length - 1) << 16) | (sample.channel << 24));
+			words.push_back(0);
+			words.push_back(0);
+			words.push_back(sample.length >= 32 ? UINT32_MAX : (1u << sample.length) - 1);
+		}
+
+		return words;
+	}
+
+	static void AppendKeyValue(std::vector<char>& KeyValues, const char* key, const char* value, size_t size)
+	{
+		uint32_t length = static_cast<uint32_t>(strlen(key) + 1 + size);
+
+		KeyValues.insert(KeyValues.end(), reinterpret_cast<const char*>(&length), reinterpret_cast<const char*>(&length) + 4);
+		KeyValues.insert(KeyValues.end(), key, key + strlen(key) + 1);
+		KeyValues.insert(KeyValues.end(), value, value + size);
+		KeyValues.resize((KeyValues.size() + 3) & ~static_cast<size_t>(3), 0);
+	}
+
+	static uint32_t Read32(const char* data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	static uint64_t Read64(const char* data)
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	static void Write32(char* data, uint32_t value)
+	{
+		memcpy(data, &value, sizeof(value));
+	}
+
+	static void Write64(char* data, uint64_t value)
+	{
+		memcpy(data, &value, sizeof(value));
+	}
+};
+
+struct UniformBufferObject
+{
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 proj;
+
+	// scale in xy and offset in zw applied to quantised texture coordinates
+	glm::vec4 TexCoordTransform;
+
+	// read by the culling shader: the world space frustum planes, the camera position with the pixels per unit at
+	// unit distance in w, the mesh bounding sphere, and the first chunk and error of each level packed four per vector
+	glm::vec4 planes[6];
+	glm::vec4 camera;
+	glm::vec4 bounds;
+	glm::vec4 LevelErrors[MaxLodLevels / 4];
+	glm::uvec4 LevelChunks[MaxLodLevels / 4];
+	uint32_t LevelCount;
+	uint32_t ChunkCount;
+	uint32_t InstanceCount;
+	float LodThreshold;
+};
+
+// std430 layout of a chunk in the storage buffer the culling shader reads
+struct GpuChunk
+{
+	glm::vec4 minimum;
+	glm::vec4 maximum;
+	uint32_t FirstIndex;
+	uint32_t IndexCount;
+	int32_t VertexOffset;
+	uint32_t material;
+};
+
+// std430 layout of a material in the storage buffer the fragment shader reads
+struct GpuMaterial
+{
+	glm::vec4 diffuse;
+
+	// slot in the texture array, NoTextureSlot when the material has no diffuse map
+	uint32_t texture;
+	uint32_t padding[3];
+};
+
+const uint32_t NoTextureSlot = ~0u;
+
+// an indirect draw and the material of its chunk, which the vertex shader reads back at the draw's gl_DrawID
+struct DrawRecord
+{
+	VkDrawIndexedIndirectCommand command;
+	uint32_t material;
+};
+
+struct ApplicationOptions
+{
+	// render into offscreen images without a window, surface or swap chain
+	bool headless = false;
+
+	// number of frames to draw before leaving the main loop, 0 runs until the window is closed
+	uint32_t frames = 0;
+
+	// time every frame and write the statistics to the report file once the main loop ends
+	bool bench = false;
+	std::string report = "bench.json";
+
+	// reorder the model's triangles for overdraw after optimising them for the vertex cache
+	bool overdraw = true;
+
+	// render with the 12 byte QuantizedVertex layout instead of the 32 byte float Vertex
+	bool quantize = true;
+
+	// split meshes with more than 65536 vertices into chunks so they can still use 16 bit indices
+	bool split = true;
+
+	// level of detail chain: number of levels including the full mesh, share of the triangles each level keeps of the
+	// previous one, and the largest simplification error as a fraction of the mesh radius
+	uint32_t LodLevels = 5;
+	float LodRatio = 0.5f;
+	float LodError = 0.05f;
+
+	// the coarsest level whose error projects to at most this many pixels is drawn
+	float LodThreshold = 1.0f;
+
+	// skip the chunks whose bounding box is outside the view frustum
+	bool culling = true;
+
+	// cull on the CPU and write the draws from there even when the device can cull in a compute shader
+	bool CpuCulling = false;
+
+	// stress scene: copies of the model on a square grid, each with its own transform in the instance stream
+	uint32_t instances = 1;
+
+	// number of tasks recording the secondary command buffers of a frame, 0 uses one per worker thread
+	uint32_t RecordTasks = 0;
+
+	// frames the CPU may prepare ahead of the GPU, from 1 to 4: fewer lowers the input latency, more absorbs stalls
+	uint32_t FramesInFlight = 2;
+
+	// texture format by name (bc7, astc, etc2, bc1 or rgba8), empty picks the first one the device supports
+	std::string TextureFormat;
+
+	// kernel the CPU mip chain of a converted texture is filtered with, and whether colours are filtered in linear
+	// light rather than on their sRGB encoded values
+	MipFilter MipFiltering = MipFilter::kaiser;
+	bool SrgbMips = true;
+
+	// upload the smallest mip levels before the first frame and stream the others in from a loader thread
+	bool TextureStreaming = true;
+
+	// draw the materials through one texture array when the device supports descriptor indexing
+	bool bindless = true;
+
+	// parse a synthetic OBJ with N x N vertices with tinyobjloader and with ObjParser, then exit
+	uint32_t BenchObj = 0;
+
+	// deduplicate the corners of a synthetic N x N grid with std::unordered_map and with VertexDeduplicator, then exit
+	uint32_t BenchDedup = 0;
+
+	// build the mip chain of a synthetic N x N image with every filter and with the scalar box filter, then exit
+	uint32_t BenchMips = 0;
+
+	// decode the texture N times one after the other with a copy out of stb_image's buffer and as one batch with
+	// ImageDecoder, then exit
+	uint32_t BenchDecode = 0;
+};
+
+// command recording state of one frame in flight, its pools are transient and reset as a whole once the frame's fence
+// has signalled, so the buffers allocated from them are reused rather than freed
+struct FrameCommands
+{
+	VkCommandPool pool;
+	VkCommandBuffer primary;
+
+	// one pool and one secondary buffer per recording task, a task only ever touches its own pool
+	std::vector<VkCommandPool> TaskPools;
+	std::vector<VkCommandBuffer> secondaries;
+};
+
+struct FrameTiming
+{
+	// CPU milliseconds spent in DrawFrame and in each of its phases
+	double total;
+	double fence;
+	double acquire;
+
+	// recording and submitting the texture stream bands, apart from the uniform update
+	double stream;
+	double update;
+	double record;
+	double submit;
+	double present;
+};
+
+struct MemoryBlock;
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	// host address of the allocation when the memory type is host visible, blocks stay mapped while they live
+	char* data = nullptr;
+
+	MemoryBlock* block = nullptr;
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t type;
+	bool linear;
+	bool dedicated;
+	char* data;
+	size_t allocations;
+
+	// free ranges keyed by offset, adjacent ranges are always merged
+	std::map<VkDeviceSize, VkDeviceSize> FreeRanges;
+};
+
+struct MemoryStatistics
+{
+	size_t blocks = 0;
+	size_t allocations = 0;
+	size_t FreeRanges = 0;
+	VkDeviceSize reserved = 0;
+	VkDeviceSize used = 0;
+	VkDeviceSize LargestFreeRange = 0;
+
+	// 0 when all the free space is one range, close to 1 when it is scattered in small ranges
+	double fragmentation() const
+	{
+		VkDeviceSize free = reserved - used;
+		return free == 0 ? 0.0 : 1.0 - static_cast<double>(LargestFreeRange) / free;
+	}
+};
+
+struct UploadBatch
+{
+	uint64_t ticket = 0;
+
+	// the same command buffer when there is no dedicated transfer queue
+	VkCommandBuffer transfer = VK_NULL_HANDLE;
+	VkCommandBuffer graphic = VK_NULL_HANDLE;
+
+	// signaled by the transfer submission and waited on by the graphic one
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+
+	// the batch brackets its graphic command buffer with the upload timestamp queries
+	bool timed = false;
+
+	// staging buffers are released once the batch has completed
+	std::vector<std::pair<VkBuffer, MemoryAllocation>> staging;
+};
+
+enum class TextureStreamState
+{
+	free,
+	filling,
+	ready,
+	pending
+};
+
+// staging buffer for one band of block rows of a streamed mip level. The loader thread takes a free slot, fills it
+// and marks it ready, the main thread records its copy and keeps it pending until the upload completes
+struct TextureStreamSlot
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation memory;
+	TextureStreamState state = TextureStreamState::free;
+
+	// order in which the loader filled the slots, the bands of a level are submitted in that order
+	uint64_t sequence = 0;
+
+	uint32_t level = 0;
+	uint32_t FirstRow = 0;
+	VkExtent3D extent = {};
+
+	// the band completes its level
+	bool last = false;
+
+	uint64_t ticket = 0;
+};
+
+// sub-allocates buffers and images from large VkDeviceMemory blocks instead of one vkAllocateMemory per resource
+class MemoryAllocator
+{
+public:
+	void Initialize(VkPhysicalDevice PhysicalDevice, VkDevice device)
+	{
+		this->device = device;
+
+		vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &MemoryProperties);
+
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		BufferImageGranularity = PhysicalDeviceProperties.limits.bufferImageGranularity;
+	}
+
+	uint32_t FindMemoryType(uint32_t TypeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount; i++)
+		{
+			bool suitable = (MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties;
+
+			if (TypeFilter & (1 << i) && suitable)
+			{
+				return i;
+			}
+		}
+
+		throw std::runtime_error("failed to find suitable memory type");
+	}
+
+	// whether any memory type has all of the properties
+	bool HasMemoryType(VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount; i++)
+		{
+			if ((MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// linear is true for buffers and linear images, false for optimal images
+	MemoryAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint32_t type = FindMemoryType(requirements.memoryTypeBits, properties);
+
+		// linear and optimal resources never share a block, so neighbours can not violate bufferImageGranularity
+		bool separate = BufferImageGranularity > 1;
+
+		for (const std::unique_ptr<MemoryBlock>& block : blocks)
+		{
+			if (block->type != type || block->dedicated || (separate && block->linear != linear))
+			{
+				continue;
+			}
+
+			MemoryAllocation allocation;
+
+			if (Allocate(*block, requirements.size, requirements.alignment, allocation))
+			{
+				return allocation;
+			}
+		}
+
+		// resources larger than a block get a block of their own which is released as soon as they are freed
+		VkDeviceSize HeapSize = MemoryProperties.memoryHeaps[MemoryProperties.memoryTypes[type].heapIndex].size;
+		VkDeviceSize size = std::min(BlockSize, HeapSize / 8);
+		bool dedicated = requirements.size > size;
+
+		MemoryBlock& block = CreateBlock(dedicated ? requirements.size : size, type, linear, dedicated);
+
+		MemoryAllocation allocation;
+		Allocate(block, requirements.size, requirements.alignment, allocation);
+
+		return allocation;
+	}
+
+	void Free(MemoryAllocation& allocation)
+	{
+		if (allocation.block == nullptr)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryBlock& block = *allocation.block;
+		block.allocations--;
+
+		auto next = block.FreeRanges.emplace(allocation.offset, allocation.size).first;
+
+		// merge with the following range
+		auto after = std::next(next);
+
+		if (after != block.FreeRanges.end() && next->first + next->second == after->first)
+		{
+			next->second += after->second;
+			block.FreeRanges.erase(after);
+		}
+
+		// merge with the preceding range
+		if (next != block.FreeRanges.begin())
+		{
+			auto before = std::prev(next);
+
+			if (before->first + before->second == next->first)
+			{
+				before->second += next->second;
+				block.FreeRanges.erase(next);
+			}
+		}
+
+		// an empty block is kept as the spare of its kind so the next staging buffers do not allocate again, any other
+		// empty block of that kind is released
+		if (block.allocations == 0 && (block.dedicated || FindEmptyBlock(block) != nullptr))
+		{
+			DestroyBlock(block);
+		}
+
+		allocation = MemoryAllocation();
+	}
+
+	// releases the spare blocks, once the startup uploads are done they hold nothing the frames need
+	void Trim()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (size_t i = blocks.size(); i > 0; i--)
+		{
+			if (blocks[i - 1]->allocations == 0)
+			{
+				DestroyBlock(*blocks[i - 1]);
+			}
+		}
+	}
+
+	MemoryStatistics GetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryStatistics statistics;
+
+		for (const std::unique_ptr<MemoryBlock>& block : blocks)
+		{
+			statistics.blocks++;
+			statistics.allocations += block->allocations;
+			statistics.FreeRanges += block->FreeRanges.size();
+			statistics.reserved += block->size;
+			statistics.used += block->size;
+
+			for (const auto& range : block->FreeRanges)
+			{
+				statistics.used -= range.second;
+				statistics.LargestFreeRange = std::max(statistics.LargestFreeRange, range.second);
+			}
+		}
+
+		return statistics;
+	}
+
+	void Destroy()
+	{
+		while (!blocks.empty())
+		{
+			DestroyBlock(*blocks.back());
+		}
+	}
+
+private:
+	const VkDeviceSize BlockSize = 64 * 1024 * 1024;
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties MemoryProperties;
+	VkDeviceSize BufferImageGranularity;
+
+	std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	std::mutex mutex;
+
+	// first fit in the block's free list
+	bool Allocate(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation& allocation)
+	{
+		for (auto range = block.FreeRanges.begin(); range != block.FreeRanges.end(); range++)
+		{
+			VkDeviceSize start = range->first;
+			VkDeviceSize end = range->first + range->second;
+			VkDeviceSize offset = (start + alignment - 1) / alignment * alignment;
+
+			if (offset + size > end)
+			{
+				continue;
+			}
+
+			block.FreeRanges.erase(range);
+
+			// the alignment padding and the tail stay on the free list
+			if (offset > start)
+			{
+				block.FreeRanges.emplace(start, offset - start);
+			}
+
+			if (offset + size < end)
+			{
+				block.FreeRanges.emplace(offset + size, end - offset - size);
+			}
+
+			block.allocations++;
+
+			allocation.memory = block.memory;
+			allocation.offset = offset;
+			allocation.size = size;
+			allocation.data = block.data == nullptr ? nullptr : block.data + offset;
+			allocation.block = &block;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	MemoryBlock& CreateBlock(VkDeviceSize size, uint32_t type, bool linear, bool dedicated)
+	{
+		VkMemoryAllocateInfo MemoryAllocateInfo = {
+			VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,	// sType
+			nullptr,								// pNext
+			size,									// allocationSize
+			type									// memoryTypeIndex
+		};
+
+		VkDeviceMemory memory;
+		VkResult result = vkAllocateMemory(device, &MemoryAllocateInfo, nullptr, &memory);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate memory block");
+		}
+
+		// a VkDeviceMemory can only be mapped once, so host visible blocks are mapped whole for their lifetime
+		void* data = nullptr;
+
+		if (MemoryProperties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to map memory block");
+			}
+		}
+
+		std::unique_ptr<MemoryBlock> block(new MemoryBlock{ memory, size, type, linear, dedicated, static_cast<char*>(data), 0 });
+		block->FreeRanges.emplace(0, size);
+
+		blocks.push_back(std::move(block));
+
+		return *blocks.back();
+	}
+
+	// another empty block of the same memory type and kind of resource
+	MemoryBlock* FindEmptyBlock(const MemoryBlock& block)
+	{
+		for (const std::unique_ptr<MemoryBlock>& candidate : blocks)
+		{
+			if (candidate.get() != &block && candidate->allocations == 0 && !candidate->dedicated && candidate->type == block.type && candidate->linear == block.linear)
+			{
+				return candidate.get();
+			}
+		}
+
+		return nullptr;
+	}
+
+	void DestroyBlock(MemoryBlock& block)
+	{
+		if (block.data != nullptr)
+		{
+			vkUnmapMemory(device, block.memory);
+		}
+
+		vkFreeMemory(device, block.memory, nullptr);
+
+		blocks.erase(std::find_if(blocks.begin(), blocks.end(), [&block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == &block; }));
+	}
+};
+
+// the vertex layout is a compile time choice, it provides the vertex input descriptions, the vertex shader and the
+// encoding from the full precision Vertex the loader produces
+template<typename VertexLayout>
+class VulkanApplication
+{
+public:
+	explicit VulkanApplication(const ApplicationOptions& options) : options(options), FramesInFlight(options.FramesInFlight)
+	{
+	}
+
+	void run()
+	{
+		if (!options.headless)
+		{
+			InitWindow();
+		}
+
+		InitVulkan();
+
+		FrameTimings.reserve(options.bench ? options.frames : 0);
+
+		MainLoop();
+
+		if (options.bench)
+		{
+			WriteBenchReport();
+		}
+
+		cleanup();
+	}
+
+private:
+	ApplicationOptions options;
+
+	// glfw
+	GLFWwindow* window = nullptr;
+	const int WindowWidth = 800;
+	const int WindowHeight = 600;
+	const char* WindowTitle = "Vulkan Tutorial 09 : Multisampling";
+
+	const std::string ModelPath = "models/chalet.obj";
+	const std::string MeshCachePath = "models/chalet.obj.cache";
+	const std::string TexturePath = "textures/chalet.jpg";
+	const std::string PipelineCachePath = "pipeline_cache.bin";
+
+	void InitWindow()
+	{
+		glfwInit();
+
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // we don't need to create an OpenGL context
+		// glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+		window = glfwCreateWindow(WindowWidth, WindowHeight, WindowTitle, nullptr, nullptr);
+
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+	}
+
+	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+	{
+		auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
+		app->FramebufferResized = true;
+	}
+
+	// vulkan
+	const std::vector<const char*> layers = { "VK_LAYER_LUNARG_standard_validation" };
+	VkInstance instance;
+	VkSurfaceKHR surface;
+	VkDebugUtilsMessengerEXT messenger;
+	VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+
+	MemoryAllocator allocator;
+
+	ThreadPool workers;
+
+	// MSAA
+	VkSampleCountFlagBits SampleCount = VK_SAMPLE_COUNT_1_BIT;
+	VkImage ColorImage;
+	MemoryAllocation ColorImageMemory;
+	VkImageView ColorImageView;
+
+	const std::vector<const char*> extentions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+	// the material textures are one runtime sized array indexed per draw, and the vertex shader finds the draw's record
+	// with gl_DrawID
+	const std::vector<const char*> BindlessExtensions = {
+		VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+		VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+		VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME
+	};
+
+	// the descriptor indexing features can only be queried through VK_KHR_get_physical_device_properties2, and
+	// without them every draw uses material 0 and the set holds the streamed texture alone
+	bool PhysicalDeviceProperties2 = false;
+	bool BindlessTextures = false;
+
+	VkDevice device;
+	VkQueue GraphicQueue;
+	VkQueue PresentQueue;
+	VkQueue TransferQueue;
+
+	VkSwapchainKHR SwapChain;
+	std::vector<VkImage> SwapChainImages;
+	VkFormat SwapChainFormat;
+	VkExtent2D SwapChainExtent;
+	std::vector<VkImageView> SwapChainImageViews;
+
+	VkRenderPass RenderPass;
+	VkPipelineLayout PipelineLayout;
+	VkDescriptorSetLayout DescriptorSetLayout;
+	VkPipeline GraphicsPipeline;
+
+	VkPipelineCache PipelineCache;
+	bool PipelineCacheLoaded = false;
+	bool PipelineCacheWarm = false;
+	double PipelineCreationTime = 0.0;
+
+	std::vector<VkFramebuffer> SwapChainFramebuffers;
+
+	VkCommandPool CommandPool;
+
+	// every frame is recorded from scratch into the buffers of its frame in flight, its draws split between tasks of
+	// at least MinTaskDraws draws each
+	std::vector<FrameCommands> FrameCommandBuffers;
+	const uint32_t MinTaskDraws = 64;
+
+	// frames the CPU prepares while the GPU still works on earlier ones, each owns a slot of the per frame resources
+	const uint32_t FramesInFlight;
+	size_t CurrentFrame = 0;
+	std::vector<VkSemaphore> ImageAvailableSemaphore;
+	std::vector<VkSemaphore> RenderFinishedSemaphore;
+	std::vector<VkFence> fences;
+
+	// fence of the frame that last rendered to each swap chain image, there can be more frames in flight than images
+	std::vector<VkFence> ImagesInFlight;
+
+	bool FramebufferResized = false;
+
+	std::vector<FrameTiming> FrameTimings;
+
+	// GPU timestamps
+	// queries 0 and 1 bracket the graphic command buffer of an upload batch
+	// each frame in flight owns the next pair, written by two small command buffers submitted around the draw
+	VkQueryPool TimestampQueryPool = VK_NULL_HANDLE;
+	bool TimestampSupported = false;
+	uint64_t TimestampMask = 0;
+	float TimestampPeriod = 0.0f;
+	std::vector<VkCommandBuffer> TimestampCommandBuffers;
+	std::vector<bool> TimestampWritten;
+	double GpuFrameTime = 0.0;
+	std::vector<double> GpuFrameTimes;
+
+	// with a dedicated transfer queue the graphic command buffer of a batch waits for the copies before it starts, and
+	// the query pool cannot be reset on a transfer queue, so the uploads are not timed
+	bool UploadTimestamps = false;
+	double UploadGpuTime = 0.0;
+	uint32_t UploadCount = 0;
+
+	// upload context
+	// copies, layout transitions and mip generation are recorded into the open batch and submitted together
+	// each submission returns a ticket, waiting on a ticket retires its batch and every batch submitted before it
+	bool DedicatedTransfer = false;
+	uint32_t GraphicFamily;
+	uint32_t TransferFamily;
+	VkCommandPool TransferCommandPool = VK_NULL_HANDLE;
+	bool UploadOpen = false;
+	UploadBatch OpenUpload;
+	std::vector<UploadBatch> PendingUploads;
+	uint64_t UploadTicket = 0;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	// the first index of every shape of the source file, each shape keeps a contiguous range of triangles, and the
+	// index of its material in materials
+	std::vector<uint32_t> shapes;
+	std::vector<uint32_t> ShapeMaterials;
+	std::vector<MeshMaterial> materials;
+
+	// vertices converted to the layout the application renders with
+	std::vector<VertexLayout> EncodedVertices;
+	VertexQuantization quantization;
+
+	// indices relative to the vertex offset of their chunk, only used when the mesh is drawn with 16 bit indices
+	std::vector<uint16_t> ShortIndices;
+
+	// the draw ranges of every level of detail, the full mesh is a single range unless it was split
+	std::vector<MeshChunk> chunks;
+	std::vector<MeshLevel> levels;
+	uint32_t CurrentLevel = 0;
+
+	// bounding sphere used to project the simplification error of a level to the screen
+	glm::vec3 BoundsCenter = glm::vec3(0.0f);
+	float BoundsRadius = 0.0f;
+
+	// the boxes of the chunks of a level, every level shares the boxes of the full mesh, and the chunks that passed
+	// the frustum test for the frame being prepared
+	BoundingBoxes ChunkBoxes;
+	std::vector<uint32_t> VisibleChunks;
+
+	// stress scene: the transform of every instance for the frame being prepared, their world space boxes built from
+	// the box around the full mesh, and the instances that passed the frustum test with the level each one is drawn at
+	glm::vec3 MeshMinimum = glm::vec3(0.0f);
+	glm::vec3 MeshMaximum = glm::vec3(0.0f);
+	std::vector<glm::mat4> InstanceTransforms;
+	BoundingBoxes InstanceBoxes;
+	std::vector<uint32_t> VisibleInstances;
+	std::vector<uint32_t> InstanceLevels;
+
+	// non empty indirect draws of the last frame the CPU wrote, or the last count read back from the culling pass, and
+	// their sum over the benchmarked frames whose count is known, the compute path reads it back a few frames late
+	uint32_t FrameDraws = 0;
+	uint64_t BenchDraws = 0;
+	uint32_t BenchDrawFrames = 0;
+
+	// indirect calls and recording tasks of the last recorded frame
+	uint32_t FrameDrawCalls = 0;
+	uint32_t FrameRecordTasks = 0;
+
+	// final mesh data, pointing either into the vectors above or straight into the mapped mesh cache
+	MappedFile MeshCache;
+	const VertexLayout* MeshVertices = nullptr;
+	size_t VertexCount = 0;
+	const void* MeshIndices = nullptr;
+	size_t IndexCount = 0;
+	uint32_t IndexSize = sizeof(uint32_t);
+
+	VkBuffer VertexBuffer;
+	MemoryAllocation VertexBufferMemory;
+	VkBuffer IndexBuffer;
+	MemoryAllocation IndexBufferMemory;
+
+	// one persistently mapped uniform buffer with a slice per frame in flight, selected with a dynamic offset
+	VkBuffer UniformBuffer;
+	MemoryAllocation UniformBufferMemory;
+	char* UniformBufferData = nullptr;
+	VkDeviceSize UniformBufferStride;
+
+	// the same for the indirect draws, rewritten with the chunks of the selected level of detail every frame
+	VkBuffer IndirectBuffer;
+	MemoryAllocation IndirectBufferMemory;
+	char* IndirectBufferData = nullptr;
+	VkDeviceSize IndirectBufferStride;
+
+	// without multiDrawIndirect every chunk is drawn with its own indirect call
+	bool MultiDrawIndirect = false;
+
+	// without drawIndirectFirstInstance every draw starts at the first instance, so all instances share one level
+	bool DrawIndirectFirstInstance = false;
+
+	// GPU driven path: a compute pass culls the chunks of every instance and writes the draws and their count into the
+	// frame's indirect slice, which starts with the count padded to DrawCountSize bytes
+	bool ComputeCulling = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCount = nullptr;
+	const VkDeviceSize DrawCountSize = 16;
+
+	// the culling pass copies the draw count of each frame in flight here, it is read once the frame's fence has signalled
+	VkBuffer DrawCountBuffer = VK_NULL_HANDLE;
+	MemoryAllocation DrawCountBufferMemory;
+	const uint32_t* DrawCountData = nullptr;
+	std::vector<bool> DrawCountWritten;
+
+	VkDescriptorSetLayout CullDescriptorSetLayout;
+	VkPipelineLayout CullPipelineLayout;
+	VkPipeline CullPipeline;
+	VkDescriptorSet CullDescriptorSet;
+
+	// the chunks of every level, uploaded once
+	VkBuffer ChunkBuffer;
+	MemoryAllocation ChunkBufferMemory;
+
+	// host visible ring of instance transforms with a slice per frame in flight, bound as the instance rate vertex
+	// stream and read by the culling shader
+	VkBuffer InstanceBuffer;
+	MemoryAllocation InstanceBufferMemory;
+	char* InstanceBufferData = nullptr;
+	VkDeviceSize InstanceBufferStride;
+
+	VkDescriptorPool DescriptorPool;
+	std::vector<VkDescriptorSet> DescriptorSets;
+
+	// the texture's format as loaded, and the bytes of all its levels
+	uint32_t MipLevels;
+	VkFormat TextureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	const char* TextureFormatName = "rgba8";
+	uint32_t TextureBlockDimension = 1;
+	VkDeviceSize TextureBytes = 0;
+	VkImage TextureImage;
+	MemoryAllocation TextureImageMemory;
+	VkSampler TextureSampler = VK_NULL_HANDLE;
+
+	// one view and one descriptor set per level the frames may start sampling from while the texture streams in, view i
+	// holds level i and the smaller ones, so no bound view covers a level that is still being copied
+	std::vector<VkImageView> TextureImageViews;
+
+	// bindless materials: the material table is a storage buffer and the textures are one variable sized array of the
+	// descriptor set, with the streamed texture in slot 0 and the RGBA8 diffuse maps of the materials after it
+	VkBuffer MaterialBuffer;
+	MemoryAllocation MaterialBufferMemory;
+	std::vector<uint32_t> MaterialTextureSlots;
+	std::vector<VkImage> MaterialImages;
+	std::vector<MemoryAllocation> MaterialImageMemories;
+	std::vector<VkImageView> MaterialImageViews;
+	VkDeviceSize MaterialTextureBytes = 0;
+
+	// the size the texture array is declared with in the set layout, from the device's descriptor limits
+	uint32_t MaxTextureSlots = 1;
+
+	// texture streaming
+	// the finest level the frames may sample, every level from it down to 1x1 is in the image
+	// the levels above it are copied out of the mapped file into the stream slots by the loader thread, and recorded
+	// and submitted from DrawFrame so only the main thread touches the queues
+	uint32_t ResidentLevel = 0;
+	const VkDeviceSize TextureStreamSlotSize = 1 << 20;
+	const uint32_t TextureStreamSlotCount = 2;
+	MappedFile TextureFile;
+	Ktx2File::Image TextureSource;
+	std::vector<TextureStreamSlot> StreamSlots;
+	std::thread TextureLoader;
+	std::mutex StreamMutex;
+	std::condition_variable StreamSlotFree;
+	bool StreamStopping = false;
+	uint64_t NextStreamBand = 0;
+
+	// time and frames from the start of the loader thread until the whole chain is resident, and the most staging
+	// memory the texture held at once
+	std::chrono::high_resolution_clock::time_point StreamStart;
+	uint32_t StreamFrames = 0;
+	double TextureStreamTime = 0.0;
+	VkDeviceSize TextureStagingBytes = 0;
+
+	VkImage DepthImage;
+	MemoryAllocation DepthImageMemory;
+	VkImageView DepthImageView;
+
+	// headless
+	std::vector<MemoryAllocation> OffscreenImagesMemory;
+
+	void InitVulkan()
+	{
+		CreateInstance();
+		SetupDebugMessenger();
+
+		if (options.headless)
+		{
+			PickPhysicalDevice();
+			CreateLogicalDevice();
+			CreateOffscreenImages();
+		}
+		else
+		{
+			CreateSurface();
+			PickPhysicalDevice();
+			CreateLogicalDevice();
+			CreateSwapchain();
+		}
+
+		CreatePipelineCache();
+		CreateImageViews();
+		CreateRenderPass();
+		CreateDescriptorSetLayout();
+		CreateGraphicsPipeline();
+		CreateCullPipeline();
+		CreateCommandPool();
+		CreateTimestampQueries();
+		CreateColorResources();
+		CreateDepthResources();
+		CreateFramebuffers();
+		CreateTextureImage();
+		CreateTextureImageView();
+		CreateTextureSampler();
+		LoadModel();
+		CreateVertexBuffer();
+		CreateIndexBuffer();
+		CreateChunkBuffer();
+		CreateMaterialTextures();
+		CreateMaterialBuffer();
+
+		// the mesh has been copied into the staging buffers, so the cache mapping is no longer needed
+		if (MeshCache.IsOpen())
+		{
+			MeshCache.Close();
+			MeshVertices = nullptr;
+			MeshIndices = nullptr;
+		}
+
+		// every upload so far goes out in one batch, the remaining setup overlaps with it
+		uint64_t ticket = SubmitUploads();
+
+		CreateUniformBuffers();
+		CreateIndirectBuffers();
+		CreateDescriptorPool();
+		CreateDescriptorSets();
+		CreateCommandBuffers();
+		CreateSemaphoresAndFences();
+
+		WaitUpload(ticket);
+
+		// the staging buffers of the startup uploads are gone, the blocks they left empty are not needed by the frames
+		allocator.Trim();
+
+		if (UploadTimestamps)
+		{
+			std::cout << "GPU upload time: " << UploadGpuTime << " ms over " << UploadCount << " batches" << std::endl;
+		}
+		else if (TimestampSupported)
+		{
+			std::cout << "GPU upload time: not measured on the dedicated transfer queue" << std::endl;
+		}
+
+		MemoryStatistics memory = allocator.GetStatistics();
+
+		std::cout << "device memory: " << memory.allocations << " allocations in " << memory.blocks << " blocks, ";
+		std::cout << memory.used / 1024 << " KiB used of " << memory.reserved / 1024 << " KiB, ";
+		std::cout << "fragmentation " << memory.fragmentation() << std::endl;
+	}
+
+	void DisplayAvailableLayers()
+	{
+		uint32_t count = 0;
+		vkEnumerateInstanceLayerProperties(&count, nullptr);
+
+		std::vector<VkLayerProperties> properties(count);
+		vkEnumerateInstanceLayerProperties(&count, properties.data());
+
+		if (count != 0)
+		{
+			std::cout << "--- Instance Layer Properties ---" << std::endl;
+
+			for (VkLayerProperties property : properties)
+			{
+				std::cout << property.layerName << std::endl;
+			}
+		}
+	}
+
+	void DisplayAvailableExtensions()
+	{
+		uint32_t count = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+
+		std::vector<VkExtensionProperties> properties(count);
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, properties.data());
+
+		if (count != 0)
+		{
+			std::cout << "--- Instance Extension Properties ---" << std::endl;
+
+			for (VkExtensionProperties property : properties)
+			{
+				std::cout << property.extensionName << std::endl;
+			}
+		}
+	}
+
+	void CreateInstance()
+	{
+		VkResult result;
+
+		std::vector<const char*> extensions;
+
+		// glfw extensions, a headless instance does not need any surface extension
+		if (!options.headless)
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount); // VK_KHR_surface, VK_KHR_win32_surface / VK_KHR_xcb_surface
+
+			extensions.assign(glfwExtensionNames, glfwExtensionNames + glfwExtensionCount);
+		}
+
+		if (EnableValidationLayer)
+		{
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+
+		// the instance is created for Vulkan 1.0, the descriptor indexing features are queried through the extension when
+		// the instance offers it, and bindless textures are off without it
+		uint32_t count = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+
+		std::vector<VkExtensionProperties> available(count);
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, available.data());
+
+		for (const VkExtensionProperties& extension : available)
+		{
+			if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+			{
+				extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+				PhysicalDeviceProperties2 = true;
+			}
+		}
+
+		VkInstanceCreateInfo InstanceCreateInfo =
+		{
+			VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,				// sType
+			nullptr,											// pNext
+			0,													// flags
+			nullptr,											// pApplicationInfo
+			EnableValidationLayer ? layers.size() : 0,			// enabledLayerCount
+			EnableValidationLayer ? layers.data() : nullptr,	// ppEnabledLayerNames
+			static_cast<uint32_t>(extensions.size()),			// enabledExtensionCount
+			extensions.data()									// ppEnabledExtensionNames
+		};
+
+		result = vkCreateInstance(&InstanceCreateInfo, nullptr, &instance);
+
+		if (result != VK_SUCCESS)
+		{
+			std::string message;
+
+			switch (result)
+			{
+			case VK_ERROR_EXTENSION_NOT_PRESENT:
+				message = "VK_ERROR_EXTENSION_NOT_PRESENT";
+				break;
+			case VK_ERROR_LAYER_NOT_PRESENT:
+				message = "VK_ERROR_LAYER_NOT_PRESENT";
+				break;
+			default:
+				message = "failed to create instance";
+				break;
+			}
+
+			throw std::runtime_error(message);
+		}
+	}
+
+	VkResult vkCreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pMessenger)
+	{
+		PFN_vkCreateDebugUtilsMessengerEXT func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+		// PFN_vkCreateDebugUtilsMessengerEXT func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT> (vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+
+		if (func != nullptr)
+		{
+			return func(instance, pCreateInfo, pAllocator, pMessenger);
+		}
+		else
+		{
+			return VK_ERROR_EXTENSION_NOT_PRESENT;
+		}
+	}
+
+	void vkDestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT pMessenger, const VkAllocationCallbacks* pAllocator)
+	{
+		PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+
+		if (func != nullptr)
+		{
+			func(instance, pMessenger, pAllocator);
+		}
+	}
+
+	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
+	{
+		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+		return VK_FALSE;
+	}
+
+	void SetupDebugMessenger()
+	{
+		VkResult result;
+
+		if (EnableValidationLayer)
+		{
+			VkDebugUtilsMessageSeverityFlagsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+			// VkDebugUtilsMessageSeverityFlagsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+			VkDebugUtilsMessageTypeFlagsEXT type = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+
+			VkDebugUtilsMessengerCreateInfoEXT DebugUtilsMessengerCreateInfo = {
+				VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,	// sType
+				nullptr,													// pNext
+				0,															// flags
+				severity,													// messageSeverity
+				type,														// messageType
+				DebugCallback,												// pfnUserCallback
+				nullptr														// pUserData
+			};
+
+			result = vkCreateDebugUtilsMessengerEXT(instance, &DebugUtilsMessengerCreateInfo, nullptr, &messenger);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to set up debug messenger");
+			}
+		}
+	}
+
+	VkSampleCountFlagBits GetMaxUsableSampleCount()
+	{
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		VkSampleCountFlags SampleCount = std::min(PhysicalDeviceProperties.limits.framebufferColorSampleCounts, PhysicalDeviceProperties.limits.framebufferDepthSampleCounts);
+
+		switch (SampleCount)
+		{
+		case VK_SAMPLE_COUNT_64_BIT:
+			return VK_SAMPLE_COUNT_64_BIT;
+		case VK_SAMPLE_COUNT_32_BIT:
+			return VK_SAMPLE_COUNT_32_BIT;
+		case VK_SAMPLE_COUNT_16_BIT:
+			return VK_SAMPLE_COUNT_16_BIT;
+		case VK_SAMPLE_COUNT_8_BIT:
+			return VK_SAMPLE_COUNT_8_BIT;
+		case VK_SAMPLE_COUNT_4_BIT:
+			return VK_SAMPLE_COUNT_4_BIT;
+		case VK_SAMPLE_COUNT_2_BIT:
+			return VK_SAMPLE_COUNT_2_BIT;
+		}
+
+		return VK_SAMPLE_COUNT_1_BIT;
+	}
+
+	void PickPhysicalDevice()
+	{
+		uint32_t count = 0;
+		vkEnumeratePhysicalDevices(instance, &count, nullptr);
+
+		if (count != 0)
+		{
+			std::vector<VkPhysicalDevice> devices(count);
+			vkEnumeratePhysicalDevices(instance, &count, devices.data());
+
+			for (VkPhysicalDevice device : devices)
+			{
+				if (IsDeviceSuitable(device))
+				{
+					// this->PhysicalDevice = device;
+					PhysicalDevice = device;
+					SampleCount = GetMaxUsableSampleCount();
+					break;
+				}
+			}
+
+			// if (this->PhysicalDevice == VK_NULL_HANDLE)
+			if (PhysicalDevice == VK_NULL_HANDLE)
+			{
+				throw std::runtime_error("failed to find a suitable device");
+			}
+		}
+		else
+		{
+			throw std::runtime_error("failed to find any physical device");
+		}
+	}
+
+	bool IsDeviceSuitable(VkPhysicalDevice device)
+	{
+		QueueFamilyIndex index = FindQueueFamilyIndex(device);
+
+		bool ExtensionSupport = CheckDeviceExtensionSupport(device);
+		bool SwapChainAdequate = options.headless;
+
+		if (ExtensionSupport && !options.headless)
+		{
+			SwapChainSupport support = QuerySwapChainSupport(device);
+			SwapChainAdequate = !support.formats.empty() && !support.modes.empty();
+		}
+
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures(device, &features);
+
+		return index.IsComplete() && ExtensionSupport&& SwapChainAdequate&& features.samplerAnisotropy;
+	}
+
+	// the texture array is sized per set, only partly written and indexed with a value that varies across draws
+	bool CheckBindlessSupport()
+	{
+		if (!PhysicalDeviceProperties2)
+		{
+			return false;
+		}
+
+		for (const char* extension : BindlessExtensions)
+		{
+			if (!CheckOptionalExtension(extension))
+			{
+				return false;
+			}
+		}
+
+		PFN_vkGetPhysicalDeviceFeatures2KHR GetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+
+		if (GetPhysicalDeviceFeatures2 == nullptr)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing = {};
+		indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2KHR features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features.pNext = &indexing;
+
+		GetPhysicalDeviceFeatures2(PhysicalDevice, &features);
+
+		return indexing.runtimeDescriptorArray && indexing.descriptorBindingPartiallyBound && indexing.descriptorBindingVariableDescriptorCount && indexing.shaderSampledImageArrayNonUniformIndexing;
+	}
+
+	QueueFamilyIndex FindQueueFamilyIndex(VkPhysicalDevice device)
+	{
+		QueueFamilyIndex index;
+
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+
+		if (count != 0)
+		{
+			std::vector<VkQueueFamilyProperties> families(count);
+			vkGetPhysicalDeviceQueueFamilyProperties(device, &count, families.data());
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const VkQueueFamilyProperties& family = families[i];
+
+				if ((family.queueCount > 0) && (family.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				{
+					index.graphic = i;
+				}
+
+				if (options.headless)
+				{
+					// nothing is presented in headless mode, the graphic queue stands in for the present queue
+					index.present = index.graphic;
+				}
+				else
+				{
+					VkBool32 flag = false;
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &flag);
+
+					if ((family.queueCount > 0) && flag)
+					{
+						index.present = i;
+					}
+				}
+
+				if (index.IsComplete())
+				{
+					break;
+				}
+			}
+
+			// prefer a transfer only family, usually backed by a DMA engine, over one that also does compute
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const VkQueueFamilyProperties& family = families[i];
+
+				bool transfer = (family.queueCount > 0) && (family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(family.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+
+				if (transfer && (!index.transfer.has_value() || !(family.queueFlags & VK_QUEUE_COMPUTE_BIT)))
+				{
+					index.transfer = i;
+				}
+			}
+		}
+
+		return index;
+	}
+
+	std::vector<const char*> GetDeviceExtensions()
+	{
+		// the swap chain extension is only needed when presenting to a window
+		if (options.headless)
+		{
+			return {};
+		}
+
+		return extentions;
+	}
+
+	bool CheckDeviceExtensionSupport(VkPhysicalDevice device)
+	{
+		uint32_t count;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+
+		std::vector<VkExtensionProperties> available(count);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &count, available.data());
+
+		std::vector<const char*> DeviceExtensions = GetDeviceExtensions();
+		std::set<std::string> required(DeviceExtensions.begin(), DeviceExtensions.end());
+
+		for (const VkExtensionProperties& extension : available)
+		{
+			required.erase(extension.extensionName);
+		}
+
+		return required.empty();
+	}
+
+	void CreateLogicalDevice()
+	{
+		VkResult result;
+
+		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
+		std::set<uint32_t> families = { index.graphic.value(), index.present.value() };
+
+		if (index.transfer.has_value())
+		{
+			families.insert(index.transfer.value());
+		}
+
+		std::vector<VkDeviceQueueCreateInfo> QueueCreateInfos;
+		float QueuePriority = 1.0f;
+
+		for (uint32_t family : families)
+		{
+			VkDeviceQueueCreateInfo QueueCreateInfo = {
+				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,	// sType
+				nullptr,									// pNext
+				0,											// flags
+				family,										// queueFamilyIndex
+				1,											// queueCount
+				&QueuePriority								// pQueuePriorities
+			};
+
+			QueueCreateInfos.push_back(QueueCreateInfo);
+		}
+
+		VkPhysicalDeviceFeatures supported;
+		vkGetPhysicalDeviceFeatures(PhysicalDevice, &supported);
+
+		VkPhysicalDeviceFeatures features = {};
+		features.samplerAnisotropy = VK_TRUE;
+		features.multiDrawIndirect = supported.multiDrawIndirect;
+		features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+
+		MultiDrawIndirect = supported.multiDrawIndirect == VK_TRUE;
+		DrawIndirectFirstInstance = supported.drawIndirectFirstInstance == VK_TRUE;
+
+		std::vector<const char*> DeviceExtensions = GetDeviceExtensions();
+
+		// the GPU driven path needs the count draw, draws that start at their instance and compute on the graphic queue,
+		// otherwise the CPU culls
+		uint32_t FamilyCount;
+		vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &FamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> FamilyProperties(FamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &FamilyCount, FamilyProperties.data());
+
+		bool compute = (FamilyProperties[index.graphic.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+		ComputeCulling = options.culling && !options.CpuCulling && compute && DrawIndirectFirstInstance && CheckOptionalExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+		if (ComputeCulling)
+		{
+			DeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+
+		BindlessTextures = options.bindless && CheckBindlessSupport();
+
+		if (BindlessTextures)
+		{
+			DeviceExtensions.insert(DeviceExtensions.end(), BindlessExtensions.begin(), BindlessExtensions.end());
+		}
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing = {};
+		indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		indexing.runtimeDescriptorArray = VK_TRUE;
+		indexing.descriptorBindingPartiallyBound = VK_TRUE;
+		indexing.descriptorBindingVariableDescriptorCount = VK_TRUE;
+		indexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+		VkDeviceCreateInfo DeviceCreateInfo = {
+			VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,				// sType
+			BindlessTextures ? &indexing : nullptr,				// pNext
+			0,													// flags
+			QueueCreateInfos.size(),							// queueCreateInfoCount
+			QueueCreateInfos.data(),							// pQueueCreateInfos
+			EnableValidationLayer ? layers.size() : 0,			// enabledLayerCount
+			EnableValidationLayer ? layers.data() : nullptr,	// ppEnabledLayerNames
+			DeviceExtensions.size(),							// enabledExtensionCount
+			DeviceExtensions.data(),							// ppEnabledExtensionNames
+			&features											// pEnabledFeatures
+		};
+
+		result = vkCreateDevice(PhysicalDevice, &DeviceCreateInfo, nullptr, &device);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create logical device");
+		}
+
+		vkGetDeviceQueue(device, index.graphic.value(), 0, &GraphicQueue);
+		vkGetDeviceQueue(device, index.present.value(), 0, &PresentQueue);
+
+		// without a dedicated transfer family the uploads go through the graphic queue
+		DedicatedTransfer = index.transfer.has_value();
+		GraphicFamily = index.graphic.value();
+		TransferFamily = DedicatedTransfer ? index.transfer.value() : GraphicFamily;
+
+		vkGetDeviceQueue(device, TransferFamily, 0, &TransferQueue);
+
+		if (ComputeCulling)
+		{
+			CmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+			ComputeCulling = CmdDrawIndexedIndirectCount != nullptr;
+		}
+
+		std::cout << "culling: " << (ComputeCulling ? "compute" : options.culling ? "CPU" : "off") << std::endl;
+		std::cout << "materials: " << (BindlessTextures ? "bindless texture array" : "material 0 only, the device has no descriptor indexing") << std::endl;
+
+		allocator.Initialize(PhysicalDevice, device);
+	}
+
+	bool CheckOptionalExtension(const char* name)
+	{
+		uint32_t count;
+		vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &count, nullptr);
+
+		std::vector<VkExtensionProperties> available(count);
+		vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &count, available.data());
+
+		for (const VkExtensionProperties& extension : available)
+		{
+			if (strcmp(extension.extensionName, name) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void CreateSurface()
+	{
+		VkResult result;
+
+		/*
+		// Windows platform specific surface creation
+
+		VkWin32SurfaceCreateInfoKHR SurfaceCreateInfo = {
+			VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR,	// sType
+			nullptr,											// pNext
+			0,													// flags
+			GetModuleHandle(nullptr),							// hinstance
+			glfwGetWin32Window(window)							// hwnd
+		};
+
+		result = vkCreateWin32SurfaceKHR(instance, &SurfaceCreateInfo, nullptr, &surface);
+		*/
+
+		// platform agnostic surface creation
+
+		result = glfwCreateWindowSurface(instance, window, nullptr, &surface);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create window surface");
+		}
+	}
+
+	SwapChainSupport QuerySwapChainSupport(VkPhysicalDevice device)
+	{
+		SwapChainSupport support;
+
+		// capabilities
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &support.capabilities);
+
+		// formats
+		{
+			uint32_t count;
+			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, nullptr);
+
+			if (count != 0)
+			{
+				support.formats.resize(count);
+				vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, support.formats.data());
+			}
+		}
+
+		// present modes
+		{
+			uint32_t count;
+			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, nullptr);
+
+			if (count != 0)
+			{
+				support.modes.resize(count);
+				vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, support.modes.data());
+			}
+		}
+
+		return support;
+	}
+
+	VkSurfaceFormatKHR ChooseSwapChainSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
+	{
+		if (formats.size() == 1 && formats.begin()->format == VK_FORMAT_UNDEFINED)
+		{
+			return { VK_FORMAT_B8G8R8A8_UNORM, VK_COLORSPACE_SRGB_NONLINEAR_KHR };
+		}
+
+		for (VkSurfaceFormatKHR format : formats)
+		{
+			if (format.format == VK_FORMAT_B8G8R8A8_UNORM && format.colorSpace == VK_COLORSPACE_SRGB_NONLINEAR_KHR)
+			{
+				return format;
+			}
+		}
+
+		return *formats.begin();
+	}
+
+	VkPresentModeKHR ChooseSwapChainPresentMode(const std::vector<VkPresentModeKHR>& modes)
+	{
+		VkPresentModeKHR available = VK_PRESENT_MODE_FIFO_KHR;
+
+		for (VkPresentModeKHR mode : modes)
+		{
+			if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+			{
+				return mode;
+			}
+
+			if (mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+			{
+				available = mode;
+			}
+		}
+
+		return available;
+	}
+
+	VkExtent2D ChooseSwapChainExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+	{
+		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		{
+			return capabilities.currentExtent;
+		}
+		else
+		{
+			int width;
+			int height;
+
+			glfwGetFramebufferSize(window, &width, &height);
+			VkExtent2D extent = { width, height };
+
+			VkExtent2D min = capabilities.minImageExtent;
+			VkExtent2D max = capabilities.maxImageExtent;
+
+			extent.width = std::max(min.width, std::min(max.width, extent.width));
+			extent.height = std::max(min.height, std::min(max.height, extent.height));
+
+			return extent;
+		}
+	}
+
+	void CreateSwapchain()
+	{
+		SwapChainSupport support = QuerySwapChainSupport(PhysicalDevice);
+		VkSurfaceFormatKHR format = ChooseSwapChainSurfaceFormat(support.formats);
+		VkPresentModeKHR mode = ChooseSwapChainPresentMode(support.modes);
+		VkExtent2D extent = ChooseSwapChainExtent(support.capabilities);
+
+		uint32_t count = support.capabilities.minImageCount + 1;
+
+		if (support.capabilities.maxImageCount > 0 && count > support.capabilities.maxImageCount)
+		{
+			count = support.capabilities.maxImageCount;
+		}
+
+		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
+		bool flag = index.graphic == index.present;
+		std::vector<uint32_t> indices = { index.graphic.value(), index.present.value() };
+
+		VkSwapchainCreateInfoKHR SwapChainCreateInfo = {
+			VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,					// sType
+			nullptr,														// pNext
+			0,																// flags
+			surface,														// surface
+			count,															// minImageCount
+			format.format,													// imageFormat
+			format.colorSpace,												// imageColorSpace
+			extent,															// imageExtent
+			1,																// imageArrayLayers
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,							// imageUsage
+			flag ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT,	// imageSharingMode
+			flag ? indices.size() : 0,										// queueFamilyIndexCount
+			flag ? indices.data() : nullptr,								// pQueueFamilyIndices
+			support.capabilities.currentTransform,							// preTransform
+			VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,								// compositeAlpha
+			mode,															// presentMode
+			VK_TRUE,														// clipped
+			VK_NULL_HANDLE													// oldSwapchain
+		};
+
+		VkResult result = vkCreateSwapchainKHR(device, &SwapChainCreateInfo, nullptr, &SwapChain);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create swap chain");
+		}
+
+		uint32_t ImageCount;
+		vkGetSwapchainImagesKHR(device, SwapChain, &ImageCount, nullptr);
+		SwapChainImages.resize(ImageCount);
+		vkGetSwapchainImagesKHR(device, SwapChain, &ImageCount, SwapChainImages.data());
+
+		SwapChainFormat = format.format;
+		SwapChainExtent = extent;
+
+		ImagesInFlight.assign(SwapChainImages.size(), VK_NULL_HANDLE);
+	}
+
+	void CreateOffscreenImages()
+	{
+		// headless mode renders into plain images in place of the swap chain images
+		// there is one image per frame in flight and frame i always renders to image i
+
+		SwapChainFormat = VK_FORMAT_B8G8R8A8_UNORM;
+		SwapChainExtent = { static_cast<uint32_t>(WindowWidth), static_cast<uint32_t>(WindowHeight) };
+
+		SwapChainImages.resize(FramesInFlight);
+		OffscreenImagesMemory.resize(FramesInFlight);
+
+		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		for (size_t i = 0; i < SwapChainImages.size(); i++)
+		{
+			CreateImage(SwapChainExtent.width, SwapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, SwapChainFormat, tiling, usage, properties, SwapChainImages[i], OffscreenImagesMemory[i]);
+		}
+
+		ImagesInFlight.assign(SwapChainImages.size(), VK_NULL_HANDLE);
+	}
+
+	void RecreateSwapchain()
+	{
+		int width = 0;
+		int height = 0;
+
+		while (width == 0 || height == 0)
+		{
+			glfwGetFramebufferSize(window, &width, &height);
+			glfwWaitEvents();
+		}
+
+		vkDeviceWaitIdle(device);
+
+		// viewport and scissor are dynamic so only the objects that depend on the surface size are rebuilt, the per frame
+		// buffers do not depend on the swap chain at all
+		VkFormat format = SwapChainFormat;
+
+		CleanupSwapchain();
+
+		CreateSwapchain();
+		CreateImageViews();
+
+		// the render pass and the pipeline only need rebuilding if the surface format changed
+		if (SwapChainFormat != format)
+		{
+			CleanupPipeline();
+			CreateRenderPass();
+			CreateGraphicsPipeline();
+		}
+
+		CreateColorResources();
+		CreateDepthResources();
+		CreateFramebuffers();
+
+		WaitUpload(SubmitUploads());
+	}
+
+	void CreateImageViews()
+	{
+		// SwapChainImageViews.resize(SwapChainImages.size());
+		SwapChainImageViews.clear();
+
+		for (VkImage image : SwapChainImages)
+		{
+			VkImageView view = CreateImageView(image, SwapChainFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+			SwapChainImageViews.push_back(view);
+		}
+	}
+
+	static std::vector<char> ReadFile(const std::string& FileName)
+	{
+		std::ifstream file(FileName, std::ios::ate | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open file");
+		}
+
+		size_t size = file.tellg();
+		std::vector<char> buffer(size);
+
+		file.seekg(0);
+		file.read(buffer.data(), size);
+
+		file.close();
+
+		return buffer;
+	}
+
+	VkShaderModule CreateShaderModule(const std::vector<char>& bytecode)
+	{
+		VkShaderModuleCreateInfo ShaderModuleCreateInfo = {
+			VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,		// sType
+			nullptr,											// pNext
+			0,													// flags
+			bytecode.size(),									// codeSize
+			reinterpret_cast<const uint32_t*>(bytecode.data())	// pCode
+		};
+
+		VkShaderModule module;
+		VkResult result = vkCreateShaderModule(device, &ShaderModuleCreateInfo, nullptr, &module);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shader module");
+		}
+
+		// the buffer with the code can be freed immediately after creating the shader module
+
+		return module;
+	}
+
+	void CreateRenderPass()
+	{
+		VkAttachmentDescription ColorAttachment = {
+			0,											// flags
+			SwapChainFormat,							// format
+			SampleCount,								// samples
+			VK_ATTACHMENT_LOAD_OP_CLEAR,				// loadOp
+			VK_ATTACHMENT_STORE_OP_STORE,				// storeOp
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,			// stencilLoadOp
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,			// stencilStoreOp
+			VK_IMAGE_LAYOUT_UNDEFINED,					// initialLayout
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL	// finalLayout
+		};
+
+		VkAttachmentDescription DepthAttachment = {
+			0,													// flags
+			FindDepthFormat(),									// format
+			SampleCount,										// samples
+			VK_ATTACHMENT_LOAD_OP_CLEAR,						// loadOp
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,					// storeOp
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,					// stencilLoadOp
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,					// stencilStoreOp
+			VK_IMAGE_LAYOUT_UNDEFINED,							// initialLayout
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL	// finalLayout
+		};
+
+		// offscreen images are never presented, they are left ready to be copied out
+		VkImageLayout SolveLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkAttachmentDescription SolveAttachment = {
+			0,									// flags
+			SwapChainFormat,					// format
+			VK_SAMPLE_COUNT_1_BIT,				// samples
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,	// loadOp
+			VK_ATTACHMENT_STORE_OP_STORE,		// storeOp
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,	// stencilLoadOp
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,	// stencilStoreOp
+			VK_IMAGE_LAYOUT_UNDEFINED,			// initialLayout
+			SolveLayout							// finalLayout
+		};
+
+		std::vector<VkAttachmentDescription> attachments = { ColorAttachment, DepthAttachment, SolveAttachment };
+
+		VkAttachmentReference ColorAttachmentReference = {
+			0,											// attachment
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL	// layout
+		};
+
+		VkAttachmentReference DepthAttachmentReference = {
+			1,													// attachment
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL	// layout
+		};
+
+		VkAttachmentReference SolveAttachmentReference = {
+			2,											// attachment
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL	// layout
 		};
 
-		VkSubpassDescription SubpassDescription = {
-			0,									// flags
-			VK_PIPELINE_BIND_POINT_GRAPHICS,	// pipelineBindPoint
-			0,									// inputAttachmentCount
-			nullptr,							// pInputAttachments
-			1,									// colorAttachmentCount
-			&ColorAttachmentReference,			// pColorAttachments
-			&SolveAttachmentReference,			// pResolveAttachments
-			&DepthAttachmentReference,			// pDepthStencilAttachment
-			0,									// preserveAttachmentCount
-			nullptr								// pPreserveAttachments
+		VkSubpassDescription SubpassDescription = {
+			0,									// flags
+			VK_PIPELINE_BIND_POINT_GRAPHICS,	// pipelineBindPoint
+			0,									// inputAttachmentCount
+			nullptr,							// pInputAttachments
+			1,									// colorAttachmentCount
+			&ColorAttachmentReference,			// pColorAttachments
+			&SolveAttachmentReference,			// pResolveAttachments
+			&DepthAttachmentReference,			// pDepthStencilAttachment
+			0,									// preserveAttachmentCount
+			nullptr								// pPreserveAttachments
+		};
+
+		VkAccessFlags flags = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		VkSubpassDependency dependecy = {
+			VK_SUBPASS_EXTERNAL,							// srcSubpass
+			0,												// dstSubpass
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,	// srcStageMask
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,	// dstStageMask
+			0,												// srcAccessMask
+			flags,											// dstAccessMask
+			0												// dependencyFlags
+		};
+
+		VkRenderPassCreateInfo RenderPassCreateInfo = {
+			VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,	// sType
+			nullptr,									// pNext
+			0,											// flags
+			attachments.size(),							// attachmentCount
+			attachments.data(),							// pAttachments
+			1,											// subpassCount
+			&SubpassDescription,						// pSubpasses
+			1,											// dependencyCount
+			&dependecy									// pDependencies
+		};
+
+		VkResult result = vkCreateRenderPass(device, &RenderPassCreateInfo, nullptr, &RenderPass);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render pass");
+		}
+	}
+
+	std::vector<char> LoadPipelineCacheData()
+	{
+		std::ifstream file(PipelineCachePath, std::ios::ate | std::ios::binary);
+
+		if (!file.is_open())
+		{
+			std::cout << "no pipeline cache found, pipelines will be compiled from scratch" << std::endl;
+			return {};
+		}
+
+		size_t size = file.tellg();
+		std::vector<char> data(size);
+
+		file.seekg(0);
+		file.read(data.data(), size);
+
+		// a blob written by another driver or device is useless at best, validate it before handing it to the driver
+		VkPipelineCacheHeaderVersionOne header;
+
+		if (size < sizeof(header))
+		{
+			std::cout << "pipeline cache is truncated, discarding it" << std::endl;
+			return {};
+		}
+
+		memcpy(&header, data.data(), sizeof(header));
+
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		bool valid = header.headerSize >= sizeof(header) && header.headerSize <= size;
+		valid = valid && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+		valid = valid && header.vendorID == PhysicalDeviceProperties.vendorID;
+		valid = valid && header.deviceID == PhysicalDeviceProperties.deviceID;
+		valid = valid && memcmp(header.pipelineCacheUUID, PhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+		if (!valid)
+		{
+			std::cout << "pipeline cache was written by another device or driver, discarding it" << std::endl;
+			return {};
+		}
+
+		return data;
+	}
+
+	void CreatePipelineCache()
+	{
+		std::vector<char> data = LoadPipelineCacheData();
+
+		VkPipelineCacheCreateInfo PipelineCacheCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,	// sType
+			nullptr,										// pNext
+			0,												// flags
+			data.size(),									// initialDataSize
+			data.empty() ? nullptr : data.data()			// pInitialData
+		};
+
+		VkResult result = vkCreatePipelineCache(device, &PipelineCacheCreateInfo, nullptr, &PipelineCache);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache");
+		}
+
+		PipelineCacheLoaded = !data.empty();
+		PipelineCacheWarm = PipelineCacheLoaded;
+	}
+
+	void SavePipelineCache()
+	{
+		size_t size = 0;
+		VkResult result = vkGetPipelineCacheData(device, PipelineCache, &size, nullptr);
+
+		if (result != VK_SUCCESS || size == 0)
+		{
+			return;
+		}
+
+		std::vector<char> data(size);
+		result = vkGetPipelineCacheData(device, PipelineCache, &size, data.data());
+
+		if (result != VK_SUCCESS)
+		{
+			return;
+		}
+
+		if (!WriteFileReplacing(PipelineCachePath, [&](std::ostream& file) { file.write(data.data(), size); }))
+		{
+			std::cerr << "failed to write pipeline cache " << PipelineCachePath << std::endl;
+		}
+	}
+
+	void CreateGraphicsPipeline()
+	{
+		VkResult result;
+
+		std::vector<char> VertCode = ReadFile(VertexLayout::GetVertexShaderPath(BindlessTextures));
+		std::vector<char> FragCode = ReadFile(BindlessTextures ? "shaders/frag.spv" : "shaders/frag_single.spv");
+
+		VkShaderModule VertModule = CreateShaderModule(VertCode);
+		VkShaderModule FragModule = CreateShaderModule(FragCode);
+
+		// the buffer with the code can be freed immediately after creating the shader module
+
+		VkPipelineShaderStageCreateInfo VertStageCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			VK_SHADER_STAGE_VERTEX_BIT,								// stage
+			VertModule,												// module
+			"main",													// pName
+			nullptr													// pSpecializationInfo
+		};
+
+		VkPipelineShaderStageCreateInfo FragStageCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			VK_SHADER_STAGE_FRAGMENT_BIT,							// stage
+			FragModule,												// module
+			"main",													// pName
+			nullptr													// pSpecializationInfo
+		};
+
+		std::vector<VkPipelineShaderStageCreateInfo> stages = { VertStageCreateInfo, FragStageCreateInfo };
+
+		// binding 0 advances per vertex, binding 1 per instance
+		std::vector<VkVertexInputBindingDescription> BindingDescriptions = { VertexLayout::GetBindingDescription(), InstanceData::GetBindingDescription() };
+
+		auto VertexAttributeDescriptions = VertexLayout::GetAttributeDescriptions();
+		auto InstanceAttributeDescriptions = InstanceData::GetAttributeDescriptions();
+
+		std::vector<VkVertexInputAttributeDescription> AttributeDescriptions(VertexAttributeDescriptions.begin(), VertexAttributeDescriptions.end());
+		AttributeDescriptions.insert(AttributeDescriptions.end(), InstanceAttributeDescriptions.begin(), InstanceAttributeDescriptions.end());
+
+		VkPipelineVertexInputStateCreateInfo VertexInputStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,	// sType
+			nullptr,													// pNext
+			0,															// flags
+			BindingDescriptions.size(),									// vertexBindingDescriptionCount
+			BindingDescriptions.data(),									// pVertexBindingDescriptions
+			AttributeDescriptions.size(),								// vertexAttributeDescriptionCount
+			AttributeDescriptions.data()								// pVertexAttributeDescriptions
+		};
+
+		VkPipelineInputAssemblyStateCreateInfo InputAssemblyStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,	// sType
+			nullptr,														// pNext
+			0,																// flags
+			VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,							// topology
+			VK_FALSE														// primitiveRestartEnable
+		};
+
+		// viewport and scissor are set when recording the command buffers so the pipeline does not depend on the swap chain extent
+
+		VkPipelineViewportStateCreateInfo ViewportStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			1,														// viewportCount
+			nullptr,												// pViewports
+			1,														// scissorCount
+			nullptr													// pScissors
+		};
+
+		VkPipelineRasterizationStateCreateInfo RasterizationStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,	// sType
+			nullptr,													// pNext
+			0,															// flags
+			VK_FALSE,													// depthClampEnable
+			VK_FALSE,													// rasterizerDiscardEnable
+			VK_POLYGON_MODE_FILL,										// polygonMode
+			VK_CULL_MODE_BACK_BIT,										// cullMode
+			VK_FRONT_FACE_COUNTER_CLOCKWISE,							// frontFace
+			VK_FALSE,													// depthBiasEnable
+			0.0f,														// depthBiasConstantFactor
+			0.0f,														// depthBiasClamp
+			0.0f,														// depthBiasSlopeFactor
+			1.0f														// lineWidth
+		};
+
+		VkPipelineMultisampleStateCreateInfo MultisampleStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,	// sType
+			nullptr,													// pNext
+			0,															// flags
+			SampleCount,												// rasterizationSamples;
+			VK_FALSE,													// sampleShadingEnable
+			1.0f,														// minSampleShading
+			nullptr,													// pSampleMask
+			VK_FALSE,													// alphaToCoverageEnable
+			VK_FALSE													// alphaToOneEnable
+		};
+
+		VkPipelineDepthStencilStateCreateInfo DepthStencilStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,	// sType
+			nullptr,													// pNext
+			0,															// flags
+			VK_TRUE,													// depthTestEnable
+			VK_TRUE,													// depthWriteEnable
+			VK_COMPARE_OP_LESS,											// depthCompareOp
+			VK_FALSE,													// depthBoundsTestEnable
+			VK_FALSE,													// stencilTestEnable
+			{},															// front
+			{},															// back
+			0.0f,														// minDepthBounds
+			1.0f														// maxDepthBounds
+		};
+
+		VkColorComponentFlags ColorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+		VkPipelineColorBlendAttachmentState ColorBlendAttachmentState = {
+			VK_FALSE,				// blendEnable
+			VK_BLEND_FACTOR_ONE,	// srcColorBlendFactor
+			VK_BLEND_FACTOR_ZERO,	// dstColorBlendFactor
+			VK_BLEND_OP_ADD,		// colorBlendOp
+			VK_BLEND_FACTOR_ONE,	// srcAlphaBlendFactor
+			VK_BLEND_FACTOR_ZERO,	// dstAlphaBlendFactor
+			VK_BLEND_OP_ADD,		// alphaBlendOp
+			ColorWriteMask			// colorWriteMask
+		};
+
+		/*
+		// alpha blending : new color blended with old color based on its opacity
+		VkPipelineColorBlendAttachmentState AlphaBlending = {
+			VK_TRUE,								// blendEnable
+			VK_BLEND_FACTOR_SRC_ALPHA,				// srcColorBlendFactor
+			VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,	// dstColorBlendFactor
+			VK_BLEND_OP_ADD,						// colorBlendOp
+			VK_BLEND_FACTOR_ONE,					// srcAlphaBlendFactor
+			VK_BLEND_FACTOR_ZERO,					// dstAlphaBlendFactor
+			VK_BLEND_OP_ADD,						// alphaBlendOp
+			ColorWriteMask							// colorWriteMask
+		};
+		*/
+
+		VkPipelineColorBlendStateCreateInfo ColorBlendStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,	// sType
+			nullptr,													// pNext
+			0,															// flags
+			VK_FALSE,													// logicOpEnable
+			VK_LOGIC_OP_COPY,											// logicOp
+			1,															// attachmentCount
+			&ColorBlendAttachmentState,									// pAttachments
+			{0.0f, 0.0f, 0.0f, 0.0f}									// blendConstants
+		};
+
+		std::vector<VkDynamicState> DynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo DynamicStateCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			DynamicStates.size(),									// dynamicStateCount
+			DynamicStates.data()									// pDynamicStates
+		};
+
+		// the index of a call's first draw record, gl_DrawID counts from the start of each indirect call
+		VkPushConstantRange PushConstantRange = {
+			VK_SHADER_STAGE_VERTEX_BIT,	// stageFlags
+			0,							// offset
+			sizeof(uint32_t)			// size
+		};
+
+		VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,	// sType
+			nullptr,										// pNext
+			0,												// flags
+			1,												// setLayoutCount
+			&DescriptorSetLayout,							// pSetLayouts
+			1,												// pushConstantRangeCount
+			&PushConstantRange								// pPushConstantRanges
+		};
+
+		result = vkCreatePipelineLayout(device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+
+		VkGraphicsPipelineCreateInfo GraphicsPipelineCreateInfo = {
+			VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,	// sType
+			nullptr,											// pNext
+			0,													// flags
+			2,													// stageCount
+			stages.data(),										// pStages
+			&VertexInputStateCreateInfo,						// pVertexInputState
+			&InputAssemblyStateCreateInfo,						// pInputAssemblyState
+			nullptr,											// pTessellationState
+			&ViewportStateCreateInfo,							// pViewportState
+			&RasterizationStateCreateInfo,						// pRasterizationState
+			&MultisampleStateCreateInfo,						// pMultisampleState
+			&DepthStencilStateCreateInfo,						// pDepthStencilState
+			&ColorBlendStateCreateInfo,							// pColorBlendState
+			&DynamicStateCreateInfo,							// pDynamicState
+			PipelineLayout,										// layout
+			RenderPass,											// renderPass
+			0,													// subpass
+			VK_NULL_HANDLE,										// basePipelineHandle
+			-1													// basePipelineIndex
+		};
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		result = vkCreateGraphicsPipelines(device, PipelineCache, 1, &GraphicsPipelineCreateInfo, nullptr, &GraphicsPipeline);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create graphics pipeline");
+		}
+
+		PipelineCreationTime = Milliseconds(start, std::chrono::high_resolution_clock::now());
+
+		std::cout << "graphics pipeline created in " << PipelineCreationTime << " ms (" << (PipelineCacheWarm ? "warm" : "cold") << " cache)" << std::endl;
+
+		// whatever was compiled now lives in the in-memory cache for the following pipelines
+		PipelineCacheWarm = true;
+
+		// bytecode compilation and linking happens during graphics pipeline creation
+		// so we can destroy shader modules as soon as pipeline creation is finished
+
+		vkDestroyShaderModule(device, VertModule, nullptr);
+		vkDestroyShaderModule(device, FragModule, nullptr);
+	}
+
+	void CreateCullPipeline()
+	{
+		if (!ComputeCulling)
+		{
+			return;
+		}
+
+		VkDescriptorSetLayoutBinding UniformLayoutBinding = {
+			0,											// binding
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_COMPUTE_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding ChunkLayoutBinding = {
+			1,											// binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_COMPUTE_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding InstanceLayoutBinding = {
+			2,											// binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,	// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_COMPUTE_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding DrawLayoutBinding = {
+			3,											// binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,	// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_COMPUTE_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings = { UniformLayoutBinding, ChunkLayoutBinding, InstanceLayoutBinding, DrawLayoutBinding };
+
+		VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCreateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			bindings.size(),										// bindingCount
+			bindings.data()											// pBindings
+		};
+
+		VkResult result = vkCreateDescriptorSetLayout(device, &DescriptorSetLayoutCreateInfo, nullptr, &CullDescriptorSetLayout);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create culling descriptor set layout");
+		}
+
+		VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,	// sType
+			nullptr,										// pNext
+			0,												// flags
+			1,												// setLayoutCount
+			&CullDescriptorSetLayout,						// pSetLayouts
+			0,												// pushConstantRangeCount
+			nullptr											// pPushConstantRanges
+		};
+
+		result = vkCreatePipelineLayout(device, &PipelineLayoutCreateInfo, nullptr, &CullPipelineLayout);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create culling pipeline layout");
+		}
+
+		VkShaderModule CullModule = CreateShaderModule(ReadFile("shaders/cull.spv"));
+
+		VkPipelineShaderStageCreateInfo CullStageCreateInfo = {
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,	// sType
+			nullptr,												// pNext
+			0,														// flags
+			VK_SHADER_STAGE_COMPUTE_BIT,							// stage
+			CullModule,												// module
+			"main",													// pName
+			nullptr													// pSpecializationInfo
+		};
+
+		VkComputePipelineCreateInfo ComputePipelineCreateInfo = {
+			VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,	// sType
+			nullptr,										// pNext
+			0,												// flags
+			CullStageCreateInfo,							// stage
+			CullPipelineLayout,								// layout
+			VK_NULL_HANDLE,									// basePipelineHandle
+			-1												// basePipelineIndex
+		};
+
+		result = vkCreateComputePipelines(device, PipelineCache, 1, &ComputePipelineCreateInfo, nullptr, &CullPipeline);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create culling pipeline");
+		}
+
+		vkDestroyShaderModule(device, CullModule, nullptr);
+	}
+
+	void CreateFramebuffers()
+	{
+		SwapChainFramebuffers.clear();
+
+		for (VkImageView view : SwapChainImageViews)
+		{
+			VkFramebuffer framebuffer;
+			// std::vector<VkImageView> attachments = { view, DepthImageView };
+			std::vector<VkImageView> attachments = { ColorImageView, DepthImageView, view };
+
+			VkFramebufferCreateInfo FramebufferCreateInfo = {
+				VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,	// sType
+				nullptr,									// pNext
+				0,											// flags
+				RenderPass,									// renderPass
+				attachments.size(),							// attachmentCount
+				attachments.data(),							// pAttachments
+				SwapChainExtent.width,						// width
+				SwapChainExtent.height,						// height
+				1											// layers
+			};
+
+			VkResult result = vkCreateFramebuffer(device, &FramebufferCreateInfo, nullptr, &framebuffer);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create framebuffer");
+			}
+
+			SwapChainFramebuffers.push_back(framebuffer);
+		}
+	}
+
+	void CreateCommandPool()
+	{
+		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
+
+		// upload batches and the timestamp command buffers come from this pool, the frames have their own
+		VkCommandPoolCreateInfo CommandPoolCreateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,			// sType
+			nullptr,											// pNext
+			VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,	// flags
+			index.graphic.value()								// queueFamilyIndex
+		};
+
+		VkResult result = vkCreateCommandPool(device, &CommandPoolCreateInfo, nullptr, &CommandPool);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool");
+		}
+
+		if (DedicatedTransfer)
+		{
+			VkCommandPoolCreateInfo TransferCommandPoolCreateInfo = {
+				VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,	// sType
+				nullptr,									// pNext
+				VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,		// flags
+				TransferFamily								// queueFamilyIndex
+			};
+
+			result = vkCreateCommandPool(device, &TransferCommandPoolCreateInfo, nullptr, &TransferCommandPool);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create transfer command pool");
+			}
+		}
+	}
+
+	void CreateTimestampQueries()
+	{
+		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
+
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &count, nullptr);
+
+		std::vector<VkQueueFamilyProperties> families(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &count, families.data());
+
+		uint32_t ValidBits = families.at(index.graphic.value()).timestampValidBits;
+
+		if (ValidBits == 0)
+		{
+			std::cout << "timestamp queries are not supported by the graphic queue, GPU timings are disabled" << std::endl;
+			return;
+		}
+
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		TimestampMask = ValidBits >= 64 ? std::numeric_limits<uint64_t>::max() : (1ull << ValidBits) - 1;
+		TimestampPeriod = PhysicalDeviceProperties.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo QueryPoolCreateInfo = {
+			VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,	// sType
+			nullptr,									// pNext
+			0,											// flags
+			VK_QUERY_TYPE_TIMESTAMP,					// queryType
+			2 + 2 * FramesInFlight,						// queryCount
+			0											// pipelineStatistics
+		};
+
+		VkResult result = vkCreateQueryPool(device, &QueryPoolCreateInfo, nullptr, &TimestampQueryPool);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool");
+		}
+
+		// two command buffers per frame in flight : one resets the pair and writes the first timestamp, the other writes the last one
+		TimestampCommandBuffers.resize(2 * FramesInFlight);
+		TimestampWritten.assign(FramesInFlight, false);
+
+		VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,	// sType
+			nullptr,										// pNext
+			CommandPool,									// commandPool
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,				// level
+			TimestampCommandBuffers.size()					// commandBufferCount
+		};
+
+		result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, TimestampCommandBuffers.data());
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate timestamp command buffers");
+		}
+
+		for (uint32_t i = 0; i < FramesInFlight; i++)
+		{
+			uint32_t query = 2 + 2 * i;
+
+			VkCommandBufferBeginInfo CommandBufferBeginInfo = {
+				VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,	// sType
+				nullptr,										// pNext
+				0,												// flags
+				nullptr											// pInheritanceInfo
+			};
+
+			VkCommandBuffer begin = TimestampCommandBuffers.at(2 * i);
+			VkCommandBuffer end = TimestampCommandBuffers.at(2 * i + 1);
+
+			vkBeginCommandBuffer(begin, &CommandBufferBeginInfo);
+			vkCmdResetQueryPool(begin, TimestampQueryPool, query, 2);
+			vkCmdWriteTimestamp(begin, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TimestampQueryPool, query);
+			result = vkEndCommandBuffer(begin);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to record timestamp command buffer");
+			}
+
+			vkBeginCommandBuffer(end, &CommandBufferBeginInfo);
+			vkCmdWriteTimestamp(end, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TimestampQueryPool, query + 1);
+			result = vkEndCommandBuffer(end);
+
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to record timestamp command buffer");
+			}
+		}
+
+		TimestampSupported = true;
+		UploadTimestamps = !DedicatedTransfer;
+	}
+
+	bool ReadTimestamps(uint32_t query, VkQueryResultFlags flags, double& milliseconds)
+	{
+		uint64_t timestamps[2];
+
+		VkResult result = vkGetQueryPoolResults(device, TimestampQueryPool, query, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | flags);
+
+		if (result != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		uint64_t ticks = (timestamps[1] - timestamps[0]) & TimestampMask;
+		milliseconds = ticks * static_cast<double>(TimestampPeriod) / 1000000.0;
+
+		return true;
+	}
+
+	void CreateColorResources()
+	{
+		VkFormat format = SwapChainFormat;
+		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		CreateImage(SwapChainExtent.width, SwapChainExtent.height, 1, SampleCount, format, tiling, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ColorImage, ColorImageMemory);
+
+		ColorImageView = CreateImageView(ColorImage, format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+		TransitionImageLayout(ColorImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
+	}
+
+	void CreateDepthResources()
+	{
+		uint32_t width = SwapChainExtent.width;
+		uint32_t height = SwapChainExtent.height;
+		VkFormat format = FindDepthFormat();
+		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		CreateImage(width, height, 1, SampleCount, format, tiling, usage, properties, DepthImage, DepthImageMemory);
+		DepthImageView = CreateImageView(DepthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+		TransitionImageLayout(DepthImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+	}
+
+	VkFormat FindSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags feature)
+	{
+		for (VkFormat format : formats)
+		{
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(PhysicalDevice, format, &properties);
+
+			if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & feature) == feature)
+			{
+				return format;
+			}
+			else if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & feature) == feature)
+			{
+				return format;
+			}
+		}
+
+		throw std::runtime_error("failed to find supported format");
+	}
+
+	VkFormat FindDepthFormat()
+	{
+		std::vector<VkFormat> formats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+		return FindSupportedFormat(formats, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	}
+
+	bool HasStencilComponent(VkFormat format)
+	{
+		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+	}
+
+	// the first format of TextureEncodings the device samples with linear filtering that is either encodable here or
+	// has a converted file next to the source image, narrowed to one format by --texture-format
+	const TextureEncoding& SelectTextureEncoding()
+	{
+		std::vector<VkFormat> candidates;
+
+		for (const TextureEncoding& encoding : TextureEncodings)
+		{
+			if (!options.TextureFormat.empty() && options.TextureFormat != encoding.name)
+			{
+				continue;
+			}
+
+			if (encoding.encodable || std::ifstream(GetTexturePath(encoding)).good())
+			{
+				candidates.push_back(encoding.format);
+			}
+		}
+
+		if (candidates.empty())
+		{
+			throw std::runtime_error("unknown texture format " + options.TextureFormat);
+		}
+
+		VkFormat format = FindSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+		return *std::find_if(std::begin(TextureEncodings), std::end(TextureEncodings), [format](const TextureEncoding& encoding) { return encoding.format == format; });
+	}
+
+	std::string GetTexturePath(const TextureEncoding& encoding)
+	{
+		return TexturePath.substr(0, TexturePath.rfind('.')) + "." + encoding.name + ".ktx2";
+	}
+
+	// the texture is read from a KTX2 file holding every mip level already encoded, converted from the source image
+	// when it is missing, older than the image or filtered differently. Only the smallest levels of a file read from
+	// disk are uploaded here, the loader thread streams the others in while the frames are drawn
+	void CreateTextureImage()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		const TextureEncoding& encoding = SelectTextureEncoding();
+		std::string path = GetTexturePath(encoding);
+		std::string filter = std::string(MipFilterNames[static_cast<int>(options.MipFiltering)]) + (options.SrgbMips ? " srgb" : "");
+
+		MappedFile source;
+		uint64_t hash = 0;
+
+		if (encoding.encodable)
+		{
+			if (!source.Open(TexturePath))
+			{
+				throw std::runtime_error("failed to load texture image");
+			}
+
+			hash = HashBytes(source.GetData(), source.GetSize());
+		}
+
+		Ktx2File::Image& image = TextureSource;
+		image = {};
+
+		bool cached = TextureFile.Open(path) && Ktx2File::Parse(TextureFile.GetData(), TextureFile.GetSize(), image) && image.format == encoding.format;
+
+		// a file converted offline is used as it is, one converted here has to match the source image and the filter
+		if (cached && encoding.encodable && (image.SourceHash != hash || image.filter != filter))
+		{
+			cached = false;
+		}
+
+		// the streamed bands are cut from the levels assuming they are tightly packed
+		for (uint32_t i = 0; cached && i < image.levels.size(); i++)
+		{
+			cached = image.levels[i].size == TextureCompressor::GetSize(encoding, std::max(image.width >> i, 1u), std::max(image.height >> i, 1u));
+		}
+
+		if (!cached)
+		{
+			if (!encoding.encodable)
+			{
+				throw std::runtime_error("failed to read texture " + path);
+			}
+
+			TextureFile.Close();
+
+			ImageDecodeJob job = { source.GetData(), source.GetSize(), nullptr };
+
+			if (!ImageDecoder::ReadInfo(job))
+			{
+				throw std::runtime_error("failed to load texture image");
+			}
+
+			image.format = encoding.format;
+			image.width = job.width;
+			image.height = job.height;
+			image.levels.assign(MipGenerator::GetLevelCount(job.width, job.height), {});
+
+			for (uint32_t i = 0; i < image.levels.size(); i++)
+			{
+				image.levels[i].size = TextureCompressor::GetSize(encoding, std::max(image.width >> i, 1u), std::max(image.height >> i, 1u));
+			}
+		}
+
+		MipLevels = static_cast<uint32_t>(image.levels.size());
+		TextureFormat = encoding.format;
+		TextureFormatName = encoding.name;
+		TextureBlockDimension = encoding.BlockDimension;
+		TextureBytes = 0;
+
+		for (const Ktx2File::Level& level : image.levels)
+		{
+			TextureBytes += level.size;
+		}
+
+		// a converted texture already sits in staging memory as a whole, from a file only the smallest levels that fit
+		// in one stream slot are uploaded now
+		ResidentLevel = 0;
+
+		if (cached && options.TextureStreaming)
+		{
+			VkDeviceSize TailSize = 0;
+			ResidentLevel = MipLevels;
+
+			while (ResidentLevel > 0 && TailSize + image.levels[ResidentLevel - 1].size <= TextureStreamSlotSize)
+			{
+				ResidentLevel--;
+				TailSize += image.levels[ResidentLevel].size;
+			}
+		}
+
+		// an uncompressed chain is decoded and filtered right where it is uploaded from, which reads it back and is only
+		// worth it in cached memory
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		bool InPlace = !cached && encoding.BlockDimension == 1 && allocator.HasMemoryType(properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+		if (InPlace)
+		{
+			properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+
+		// the uploaded levels go into one staging buffer, at offsets aligned for the copy of a compressed block
+		std::vector<VkDeviceSize> offsets(MipLevels - ResidentLevel);
+		VkDeviceSize size = 0;
+
+		for (uint32_t i = ResidentLevel; i < MipLevels; i++)
+		{
+			offsets[i - ResidentLevel] = (size + 15) & ~static_cast<VkDeviceSize>(15);
+			size = offsets[i - ResidentLevel] + (InPlace && i == 0 ? ImageDecoder::GetSize(image.width, image.height) : image.levels[i].size);
+		}
+
+		TextureStagingBytes = size;
+
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, StagingBuffer, StagingBufferMemory);
+
+		if (cached)
+		{
+			for (uint32_t i = ResidentLevel; i < MipLevels; i++)
+			{
+				memcpy(StagingBufferMemory.data + offsets[i - ResidentLevel], image.levels[i].data, image.levels[i].size);
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < MipLevels; i++)
+			{
+				image.levels[i].data = StagingBufferMemory.data + offsets[i];
+			}
+
+			ConvertTexture(encoding, source, image.width, image.height, StagingBufferMemory.data, offsets, InPlace);
+
+			if (!Ktx2File::Write(path, encoding, image.width, image.height, image.levels, hash, filter))
+			{
+				std::cerr << "failed to write texture " << path << std::endl;
+			}
+		}
+
+		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		CreateImage(image.width, image.height, MipLevels, VK_SAMPLE_COUNT_1_BIT, TextureFormat, tiling, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, TextureImage, TextureImageMemory);
+
+		// the levels still to stream stay undefined until their first band is recorded, no view a frame binds covers them
+		uint32_t LoadedLevels = MipLevels - ResidentLevel;
+
+		TransitionImageLayout(TextureImage, TextureFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, LoadedLevels, ResidentLevel);
+		CopyBufferToImage(StagingBuffer, TextureImage, image.width, image.height, offsets, ResidentLevel);
+
+		TransferImageOwnership(TextureImage, LoadedLevels, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, ResidentLevel);
+		TransitionImageLayout(TextureImage, TextureFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, LoadedLevels, ResidentLevel);
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << "texture " << path << (cached ? "" : " converted") << ": " << TextureFormatName << ", " << image.width << "x" << image.height << ", " << MipLevels << " levels, " << TextureBytes << " bytes, ";
+		std::cout << LoadedLevels << " levels loaded in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+		if (ResidentLevel > 0)
+		{
+			StartTextureStreaming();
+		}
+		else
+		{
+			TextureFile.Close();
+			image.levels.clear();
+		}
+	}
+
+	// decodes the source image, filters its mip chain on the CPU and encodes level i at destination + offsets[i].
+	// The next level and the encoder read the RGBA8 chain back, so it is kept in system memory and only the encoded
+	// bytes go to the write combined staging memory, unless the destination is cached and holds the chain as it is
+	void ConvertTexture(const TextureEncoding& encoding, const MappedFile& source, uint32_t width, uint32_t height, char* destination, const std::vector<VkDeviceSize>& offsets, bool InPlace)
+	{
+		std::vector<uint8_t> chain;
+		std::vector<uint8_t*> levels;
+
+		if (InPlace)
+		{
+			for (VkDeviceSize offset : offsets)
+			{
+				levels.push_back(reinterpret_cast<uint8_t*>(destination + offset));
+			}
+		}
+		else
+		{
+			std::vector<size_t> starts = { 0 };
+			chain.resize(ImageDecoder::GetSize(width, height));
+
+			for (uint32_t i = 1; i < offsets.size(); i++)
+			{
+				starts.push_back(chain.size());
+				chain.resize(chain.size() + static_cast<size_t>(std::max(width >> i, 1u)) * std::max(height >> i, 1u) * 4);
+			}
+
+			for (size_t start : starts)
+			{
+				levels.push_back(chain.data() + start);
+			}
+		}
+
+		ImageDecodeJob job = { source.GetData(), source.GetSize(), levels[0], width, height };
+
+		if (!ImageDecoder::Decode(job))
+		{
+			throw std::runtime_error("failed to decode texture image");
+		}
+
+		MipGenerator generator(options.MipFiltering, options.SrgbMips);
+		generator.Generate(levels, width, height, workers);
+
+		// an RGBA8 level already in place is left as it is by the encoder
+		for (uint32_t i = 0; i < offsets.size(); i++)
+		{
+			uint8_t* encoded = reinterpret_cast<uint8_t*>(destination + offsets[i]);
+			TextureCompressor::Encode(encoding, levels[i], std::max(width >> i, 1u), std::max(height >> i, 1u), encoded, workers);
+		}
+	}
+
+	// allocates the stream slots and starts the loader thread on the levels below ResidentLevel
+	void StartTextureStreaming()
+	{
+		// a slot holds at least one row of blocks of the full image
+		uint32_t BlockRows = (TextureSource.height + TextureBlockDimension - 1) / TextureBlockDimension;
+		VkDeviceSize SlotSize = std::max<VkDeviceSize>(TextureStreamSlotSize, TextureSource.levels[0].size / BlockRows);
+
+		StreamSlots.resize(TextureStreamSlotCount);
+
+		for (TextureStreamSlot& slot : StreamSlots)
+		{
+			VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			CreateBuffer(SlotSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, slot.buffer, slot.memory);
+		}
+
+		TextureStagingBytes += SlotSize * TextureStreamSlotCount;
+		StreamStopping = false;
+		NextStreamBand = 0;
+		StreamStart = std::chrono::high_resolution_clock::now();
+		StreamFrames = 0;
+
+		TextureLoader = std::thread(&VulkanApplication::LoadTextureLevels, this, ResidentLevel, SlotSize);
+	}
+
+	// loader thread: copies the levels from FirstLevel - 1 up to the full image out of the mapped file into the free
+	// slots, one band of block rows at a time, so the file is only read from disk here
+	void LoadTextureLevels(uint32_t FirstLevel, VkDeviceSize SlotSize)
+	{
+		uint64_t sequence = 0;
+
+		for (uint32_t level = FirstLevel; level-- > 0;)
+		{
+			uint32_t LevelWidth = std::max(TextureSource.width >> level, 1u);
+			uint32_t LevelHeight = std::max(TextureSource.height >> level, 1u);
+			uint32_t BlockRows = (LevelHeight + TextureBlockDimension - 1) / TextureBlockDimension;
+			size_t RowBytes = TextureSource.levels[level].size / BlockRows;
+			uint32_t BandRows = static_cast<uint32_t>(std::max<VkDeviceSize>(SlotSize / RowBytes, 1));
+
+			for (uint32_t row = 0; row < BlockRows; row += BandRows)
+			{
+				TextureStreamSlot* slot = nullptr;
+
+				{
+					std::unique_lock<std::mutex> lock(StreamMutex);
+
+					StreamSlotFree.wait(lock, [this, &slot]
+					{
+						for (TextureStreamSlot& candidate : StreamSlots)
+						{
+							if (candidate.state == TextureStreamState::free)
+							{
+								slot = &candidate;
+								break;
+							}
+						}
+
+						return StreamStopping || slot != nullptr;
+					});
+
+					if (StreamStopping)
+					{
+						return;
+					}
+
+					slot->state = TextureStreamState::filling;
+				}
+
+				uint32_t count = std::min(BandRows, BlockRows - row);
+				memcpy(slot->memory.data, TextureSource.levels[level].data + row * RowBytes, count * RowBytes);
+
+				std::lock_guard<std::mutex> lock(StreamMutex);
+
+				slot->sequence = sequence++;
+				slot->level = level;
+				slot->extent = { LevelWidth, std::min(count * TextureBlockDimension, LevelHeight - row * TextureBlockDimension), 1 };
+				slot->FirstRow = row * TextureBlockDimension;
+				slot->last = row + count == BlockRows;
+				slot->state = TextureStreamState::ready;
+			}
+		}
+	}
+
+	// called once per frame: retires the bands whose copies completed, lowering ResidentLevel when a level is done,
+	// and submits the bands the loader staged since the last frame in the order it staged them
+	void StreamTexture()
+	{
+		if (!TextureLoader.joinable())
+		{
+			return;
+		}
+
+		StreamFrames++;
+
+		bool freed = false;
+
+		{
+			std::lock_guard<std::mutex> lock(StreamMutex);
+
+			for (TextureStreamSlot& slot : StreamSlots)
+			{
+				if (slot.state == TextureStreamState::pending && IsUploadComplete(slot.ticket))
+				{
+					WaitUpload(slot.ticket);
+
+					if (slot.last)
+					{
+						ResidentLevel = std::min(ResidentLevel, slot.level);
+					}
+
+					slot.state = TextureStreamState::free;
+					freed = true;
+				}
+			}
+
+			std::vector<TextureStreamSlot*> recorded;
+
+			for (bool found = true; found;)
+			{
+				found = false;
+
+				for (TextureStreamSlot& slot : StreamSlots)
+				{
+					if (slot.state == TextureStreamState::ready && slot.sequence == NextStreamBand)
+					{
+						RecordTextureBand(slot);
+						recorded.push_back(&slot);
+						NextStreamBand++;
+						found = true;
+					}
+				}
+			}
+
+			if (!recorded.empty())
+			{
+				uint64_t ticket = SubmitUploads();
+
+				for (TextureStreamSlot* slot : recorded)
+				{
+					slot->ticket = ticket;
+					slot->state = TextureStreamState::pending;
+				}
+			}
+		}
+
+		if (freed)
+		{
+			StreamSlotFree.notify_one();
+		}
+
+		if (ResidentLevel == 0)
+		{
+			TextureStreamTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - StreamStart).count();
+			StopTextureStreaming();
+
+			std::cout << "texture streamed in " << TextureStreamTime << " ms over " << StreamFrames << " frames, " << TextureStagingBytes / 1024 << " KiB of staging memory" << std::endl;
+		}
+	}
+
+	// the first band of a level discards it and the last one hands it to the fragment shader
+	void RecordTextureBand(const TextureStreamSlot& slot)
+	{
+		if (slot.FirstRow == 0)
+		{
+			TransitionImageLayout(TextureImage, TextureFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, slot.level);
+		}
+
+		VkBufferImageCopy region = {
+			0,												// bufferOffset
+			0,												// bufferRowLength
+			0,												// bufferImageHeight
+			{ VK_IMAGE_ASPECT_COLOR_BIT, slot.level, 0, 1 },	// imageSubresource
+			{ 0, static_cast<int32_t>(slot.FirstRow), 0 },	// imageOffset
+			slot.extent										// imageExtent
+		};
+
+		vkCmdCopyBufferToImage(GetTransferUploadCommands(), slot.buffer, TextureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		if (slot.last)
+		{
+			TransferImageOwnership(TextureImage, 1, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, slot.level);
+			TransitionImageLayout(TextureImage, TextureFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, slot.level);
+		}
+	}
+
+	// stops the loader thread and frees the slots once their copies are done, the texture stays as resident as it got
+	void StopTextureStreaming()
+	{
+		if (!TextureLoader.joinable())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(StreamMutex);
+			StreamStopping = true;
+		}
+
+		StreamSlotFree.notify_all();
+		TextureLoader.join();
+
+		for (TextureStreamSlot& slot : StreamSlots)
+		{
+			if (slot.state == TextureStreamState::pending)
+			{
+				WaitUpload(slot.ticket);
+			}
+
+			vkDestroyBuffer(device, slot.buffer, nullptr);
+			allocator.Free(slot.memory);
+		}
+
+		StreamSlots.clear();
+		TextureFile.Close();
+		TextureSource.levels.clear();
+
+		allocator.Trim();
+	}
+
+	void CreateImage(uint32_t width, uint32_t height, uint32_t MipLevels, VkSampleCountFlagBits SampleCount, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& memory)
+	{
+		VkResult result;
+
+		VkExtent3D extent = {
+			width,	// width
+			height,	// height
+			1		// depth
+		};
+
+		// QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
+		// std::vector<uint32_t> indices = { index.graphic.value() };
+
+		VkImageCreateInfo ImageCreateInfo = {
+			VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,	// sType
+			nullptr,								// pNext
+			0,										// flags
+			VK_IMAGE_TYPE_2D,						// imageType
+			format,									// format
+			extent,									// extent
+			MipLevels,								// mipLevels
+			1,										// arrayLayers
+			SampleCount,							// samples
+			tiling,									// tiling
+			usage,									// usage
+			VK_SHARING_MODE_EXCLUSIVE,				// sharingMode
+			0,										// queueFamilyIndexCount
+			nullptr,								// pQueueFamilyIndices
+			VK_IMAGE_LAYOUT_UNDEFINED				// initialLayout
+		};
+
+		result = vkCreateImage(device, &ImageCreateInfo, nullptr, &image);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create image");
+		}
+
+		VkMemoryRequirements MemoryRequirements;
+		vkGetImageMemoryRequirements(device, image, &MemoryRequirements);
+
+		memory = allocator.Allocate(MemoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+		vkBindImageMemory(device, image, memory.memory, memory.offset);
+	}
+
+	// views levels BaseLevel to BaseLevel + MipLevels - 1
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t MipLevels, uint32_t BaseLevel = 0)
+	{
+		VkImageView view;
+
+		VkComponentMapping components = {
+			VK_COMPONENT_SWIZZLE_IDENTITY,	//	r
+			VK_COMPONENT_SWIZZLE_IDENTITY,	//	g
+			VK_COMPONENT_SWIZZLE_IDENTITY,	//	b
+			VK_COMPONENT_SWIZZLE_IDENTITY	//	a
+		};
+
+		VkImageSubresourceRange range = {
+			aspect,		//	aspectMask
+			BaseLevel,	//	baseMipLevel
+			MipLevels,	//	levelCount
+			0,			//	baseArrayLayer
+			1			//	layerCount
+		};
+
+		VkImageViewCreateInfo ImageViewCreateInfo = {
+			VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,	// sType
+			nullptr,									// pNext
+			0,											// flags
+			image,										// image
+			VK_IMAGE_VIEW_TYPE_2D,						// viewType
+			format,										// format
+			components,									// components
+			range										// subresourceRange
+		};
+
+		VkResult result = vkCreateImageView(device, &ImageViewCreateInfo, nullptr, &view);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create image view");
+		}
+
+		return view;
+	}
+
+	// transitions levels BaseLevel to BaseLevel + MipLevels - 1
+	void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout OldLayout, VkImageLayout NewLayout, uint32_t MipLevels, uint32_t BaseLevel = 0)
+	{
+		VkImageAspectFlags aspect;
+
+		if (NewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		{
+			aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+			if (HasStencilComponent(format))
+			{
+				aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+			}
+		}
+		else
+		{
+			aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+
+		VkImageSubresourceRange range = {
+			aspect,		// aspectMask
+			BaseLevel,	// baseMipLevel
+			MipLevels,	// levelCount
+			0,			// baseArrayLayer
+			1			// layerCount
+		};
+
+		VkAccessFlags SrcAccessMask;
+		VkAccessFlags DstAccessMask;
+		VkPipelineStageFlags SrcStage;
+		VkPipelineStageFlags DstStage;
+
+		if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		{
+			SrcAccessMask = 0;
+			DstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			DstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		else if (OldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && NewLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
+			SrcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			DstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			SrcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			DstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		}
+		else if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		{
+			SrcAccessMask = 0;
+			DstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			DstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		}
+		else if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+		{
+			SrcAccessMask = 0;
+			DstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			DstStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		}
+		else
+		{
+			throw std::runtime_error("unsupported layout transition");
+		}
+
+		VkImageMemoryBarrier ImageMemoryBarrier = {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,	// sType
+			nullptr,								// pNext
+			SrcAccessMask,							// srcAccessMask
+			DstAccessMask,							// dstAccessMask
+			OldLayout,								// oldLayout
+			NewLayout,								// newLayout
+			VK_QUEUE_FAMILY_IGNORED,				// srcQueueFamilyIndex
+			VK_QUEUE_FAMILY_IGNORED,				// dstQueueFamilyIndex
+			image,									// image
+			range									// subresourceRange
+		};
+
+		// preparing an image for a copy can run on the transfer queue, the attachment stages need the graphic queue
+		VkCommandBuffer CommandBuffer = DstStage == VK_PIPELINE_STAGE_TRANSFER_BIT ? GetTransferUploadCommands() : GetGraphicUploadCommands();
+
+		vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 0, nullptr, 0, nullptr, 1, &ImageMemoryBarrier);
+	}
+
+	// one region per mip level, level BaseLevel + i starts at offsets[i] in the buffer
+	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, const std::vector<VkDeviceSize>& offsets, uint32_t BaseLevel = 0)
+	{
+		VkCommandBuffer CommandBuffer = GetTransferUploadCommands();
+
+		std::vector<VkBufferImageCopy> regions;
+
+		for (uint32_t i = BaseLevel; i < BaseLevel + offsets.size(); i++)
+		{
+			VkExtent3D extent = { std::max(width >> i, 1u), std::max(height >> i, 1u), 1 };
+
+			VkBufferImageCopy region = {
+				offsets[i - BaseLevel],					// bufferOffset
+				0,										// bufferRowLength
+				0,										// bufferImageHeight
+				{ VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 },	// imageSubresource
+				{ 0, 0, 0 },							// imageOffset
+				extent									// imageExtent
+			};
+
+			regions.push_back(region);
+		}
+
+		vkCmdCopyBufferToImage(CommandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	void CreateTextureImageView()
+	{
+		TextureImageViews.resize(ResidentLevel + 1);
+
+		for (uint32_t level = 0; level < TextureImageViews.size(); level++)
+		{
+			TextureImageViews[level] = CreateImageView(TextureImage, TextureFormat, VK_IMAGE_ASPECT_COLOR_BIT, MipLevels - level, level);
+		}
+	}
+
+	// the streamed texture and the material maps share it
+	void CreateTextureSampler()
+	{
+		VkSamplerCreateInfo SamplerCreateInfo = {
+			VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,	// sType
+			nullptr,								// pNext
+			0,										// flags
+			VK_FILTER_LINEAR,						// magFilter
+			VK_FILTER_LINEAR,						// minFilter
+			VK_SAMPLER_MIPMAP_MODE_LINEAR,			// mipmapMode
+			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeU
+			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeV
+			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeW
+			0.0f,									// mipLodBias
+			VK_TRUE,								// anisotropyEnable
+			16,										// maxAnisotropy
+			VK_FALSE,								// compareEnable
+			VK_COMPARE_OP_ALWAYS,					// compareOp
+			0.0f,									// minLod
+			VK_LOD_CLAMP_NONE,						// maxLod
+			VK_BORDER_COLOR_INT_OPAQUE_BLACK,		// borderColor
+			VK_FALSE								// unnormalizedCoordinates
+		};
+
+		VkResult result = vkCreateSampler(device, &SamplerCreateInfo, nullptr, &TextureSampler);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create texture sampler");
+		}
+	}
+
+	void LoadModel()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		MappedFile source;
+
+		if (!source.Open(ModelPath))
+		{
+			throw std::runtime_error("failed to open model file " + ModelPath);
+		}
+
+		uint64_t hash = HashBytes(source.GetData(), source.GetSize());
+
+		// the cache keeps the materials of the MTL files, so an edited or replaced library invalidates it as well
+		for (const std::string& library : ObjParser::FindLibraries(source.GetData(), source.GetSize()))
+		{
+			MappedFile file;
+			uint64_t parts[2] = { hash, file.Open(GetMaterialLibraryPath(library)) ? HashBytes(file.GetData(), file.GetSize()) : ~0ull };
+
+			hash = HashBytes(reinterpret_cast<const char*>(parts), sizeof(parts));
+		}
+
+		bool cached = LoadMeshCache(hash);
+
+		if (!cached)
+		{
+			ParseModel(source.GetData(), source.GetSize());
+			BuildChunks();
+			BuildLevels();
+			EncodeVertices();
+
+			MeshVertices = EncodedVertices.data();
+			VertexCount = EncodedVertices.size();
+			MeshIndices = IndexSize == sizeof(uint16_t) ? static_cast<const void*>(ShortIndices.data()) : indices.data();
+			IndexCount = IndexSize == sizeof(uint16_t) ? ShortIndices.size() : indices.size();
+
+			WriteMeshCache(hash);
+		}
+
+		ChunkBoxes.Assign(chunks.data(), GetChunkCount());
+
+		// whole instances are culled with the box around the chunks of the full mesh
+		MeshMinimum = chunks[0].minimum;
+		MeshMaximum = chunks[0].maximum;
+
+		for (size_t c = 1; c < GetChunkCount(); c++)
+		{
+			MeshMinimum = glm::min(MeshMinimum, chunks[c].minimum);
+			MeshMaximum = glm::max(MeshMaximum, chunks[c].maximum);
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << "model " << (cached ? "loaded from cache" : "parsed") << " in " << Milliseconds(start, end) << " ms, ";
+		std::cout << VertexCount << " vertices of " << sizeof(VertexLayout) << " bytes, " << IndexCount << " indices of " << IndexSize << " bytes";
+		std::cout << " in " << GetChunkCount() << (GetChunkCount() == 1 ? " chunk" : " chunks") << std::endl;
+
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			std::cout << "LOD " << level << ": " << levels[level].IndexCount / 3 << " triangles, error " << levels[level].error << std::endl;
+		}
+	}
+
+	// number of chunks every level of detail is drawn with
+	size_t GetChunkCount() const
+	{
+		return levels.empty() ? 0 : chunks.size() / levels.size();
+	}
+
+	void BuildChunks()
+	{
+		if (vertices.size() <= size_t(std::numeric_limits<uint16_t>::max()) + 1 || options.split)
+		{
+			MeshOptimizer::SplitIndices16(vertices, indices, shapes, ShortIndices, chunks);
+			IndexSize = sizeof(uint16_t);
+		}
+		else
+		{
+			chunks.clear();
+
+			for (size_t shape = 0; shape < shapes.size(); shape++)
+			{
+				size_t last = shape + 1 < shapes.size() ? shapes[shape + 1] : indices.size();
+
+				MeshChunk chunk = {
+					shapes[shape],								// FirstIndex
+					static_cast<uint32_t>(last - shapes[shape]),// IndexCount
+					0,											// VertexOffset
+					static_cast<uint32_t>(vertices.size()),		// VertexCount
+					glm::vec3(0.0f),							// minimum
+					glm::vec3(0.0f),							// maximum
+					0											// material
+				};
+
+				chunks.push_back(chunk);
+			}
+
+			IndexSize = sizeof(uint32_t);
+		}
+
+		workers.ParallelFor(chunks.size(), [this](size_t c)
+		{
+			MeshChunk& chunk = chunks[c];
+
+			// the chunks keep the triangle order, so the shape of the first triangle is the shape of the chunk
+			size_t shape = std::upper_bound(shapes.begin(), shapes.end(), chunk.FirstIndex) - shapes.begin() - 1;
+			chunk.material = ShapeMaterials[shape];
+
+			chunk.minimum = glm::vec3(std::numeric_limits<float>::max());
+			chunk.maximum = glm::vec3(-std::numeric_limits<float>::max());
+
+			for (uint32_t i = chunk.FirstIndex; i < chunk.FirstIndex + chunk.IndexCount; i++)
+			{
+				uint32_t index = IndexSize == sizeof(uint16_t) ? ShortIndices[i] : indices[i];
+				const glm::vec3& position = vertices[chunk.VertexOffset + index].position;
+
+				chunk.minimum = glm::min(chunk.minimum, position);
+				chunk.maximum = glm::max(chunk.maximum, position);
+			}
+		});
+
+		std::cout << shapes.size() << (shapes.size() == 1 ? " shape" : " shapes") << std::endl;
+	}
+
+	void ComputeBounds()
+	{
+		glm::vec3 minimum = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+		glm::vec3 maximum = minimum;
+
+		for (const Vertex& vertex : vertices)
+		{
+			minimum = glm::min(minimum, vertex.position);
+			maximum = glm::max(maximum, vertex.position);
+		}
+
+		BoundsCenter = (minimum + maximum) * 0.5f;
+		BoundsRadius = 0.0f;
+
+		for (const Vertex& vertex : vertices)
+		{
+			BoundsRadius = std::max(BoundsRadius, glm::length(vertex.position - BoundsCenter));
+		}
+	}
+
+	// appends a chain of simplified levels after the full mesh in the index data, each chunk is simplified on its own
+	// from the previous level, with its open edges locked so neighbouring chunks stay connected
+	void BuildLevels()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		ComputeBounds();
+
+		MeshLevel base = {
+			0,														// FirstChunk
+			static_cast<uint32_t>(IndexSize == sizeof(uint16_t) ? ShortIndices.size() : indices.size()),	// IndexCount
+			0.0f													// error
+		};
+
+		levels = { base };
+
+		size_t ChunkCount = chunks.size();
+		float TargetError = options.LodError * BoundsRadius;
+
+		std::vector<std::vector<std::vector<uint32_t>>> ChunkIndices(ChunkCount);
+		std::vector<std::vector<float>> ChunkErrors(ChunkCount);
+
+		workers.ParallelFor(ChunkCount, [&](size_t c)
+		{
+			const MeshChunk& chunk = chunks[c];
+			std::vector<uint32_t> current(chunk.IndexCount);
+
+			for (uint32_t i = 0; i < chunk.IndexCount; i++)
+			{
+				current[i] = IndexSize == sizeof(uint16_t) ? ShortIndices[chunk.FirstIndex + i] : indices[chunk.FirstIndex + i];
+			}
+
+			float error = 0.0f;
+
+			for (uint32_t level = 1; level < options.LodLevels; level++)
+			{
+				size_t target = static_cast<size_t>(current.size() / 3 * options.LodRatio) * 3;
+
+				error = std::max(error, MeshSimplifier::Simplify(vertices.data() + chunk.VertexOffset, chunk.VertexCount, current, target, TargetError));
+				MeshOptimizer::OptimizeVertexCache(current, chunk.VertexCount);
+
+				ChunkIndices[c].push_back(current);
+				ChunkErrors[c].push_back(error);
+			}
+		});
+
+		for (uint32_t level = 1; level < options.LodLevels; level++)
+		{
+			MeshLevel entry = {
+				static_cast<uint32_t>(chunks.size()),	// FirstChunk
+				0,										// IndexCount
+				levels.back().error						// error
+			};
+
+			for (size_t c = 0; c < ChunkCount; c++)
+			{
+				entry.IndexCount += static_cast<uint32_t>(ChunkIndices[c][level - 1].size());
+				entry.error = std::max(entry.error, ChunkErrors[c][level - 1]);
+			}
+
+			// the chain ends once the error bound stops a level from removing a useful share of the triangles
+			if (entry.IndexCount > levels.back().IndexCount * 0.9)
+			{
+				break;
+			}
+
+			for (size_t c = 0; c < ChunkCount; c++)
+			{
+				const std::vector<uint32_t>& local = ChunkIndices[c][level - 1];
+				const MeshChunk& previous = chunks[levels.back().FirstChunk + c];
+
+				MeshChunk chunk = {
+					static_cast<uint32_t>(IndexSize == sizeof(uint16_t) ? ShortIndices.size() : indices.size()),	// FirstIndex
+					static_cast<uint32_t>(local.size()),		// IndexCount
+					previous.VertexOffset,						// VertexOffset
+					previous.VertexCount,						// VertexCount
+					previous.minimum,							// minimum
+					previous.maximum,							// maximum
+					previous.material							// material
+				};
+
+				// a chunk that could not be simplified any further shares the indices of the previous level
+				if (local.size() == previous.IndexCount)
+				{
+					chunk.FirstIndex = previous.FirstIndex;
+				}
+				else if (IndexSize == sizeof(uint16_t))
+				{
+					ShortIndices.insert(ShortIndices.end(), local.begin(), local.end());
+				}
+				else
+				{
+					indices.insert(indices.end(), local.begin(), local.end());
+				}
+
+				chunks.push_back(chunk);
+			}
+
+			levels.push_back(entry);
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << levels.size() << " levels of detail built in " << Milliseconds(start, end) << " ms" << std::endl;
+	}
+
+	void EncodeVertices()
+	{
+		quantization = VertexLayout::GetQuantization(vertices);
+
+		EncodedVertices.resize(vertices.size());
+
+		// a task per block rather than per vertex, encoding one vertex costs less than handing it to a worker
+		const size_t BlockSize = 1 << 16;
+		size_t blocks = (vertices.size() + BlockSize - 1) / BlockSize;
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			for (size_t i = block * BlockSize; i < std::min(vertices.size(), (block + 1) * BlockSize); i++)
+			{
+				EncodedVertices[i] = VertexLayout::Encode(vertices[i], quantization);
+			}
+		});
+	}
+
+	uint32_t MeshProcessing() const
+	{
+		return (options.overdraw ? MeshProcessingOverdraw : 0) | (options.split ? MeshProcessingIndexSplit : 0);
+	}
+
+	bool LoadMeshCache(uint64_t hash)
+	{
+		if (!MeshCache.Open(MeshCachePath))
+		{
+			return false;
+		}
+
+		const char* data = MeshCache.GetData();
+		size_t size = MeshCache.GetSize();
+
+		MeshCacheHeader header;
+		bool valid = size >= sizeof(header);
+
+		if (valid)
+		{
+			memcpy(&header, data, sizeof(header));
+
+			valid = valid && memcmp(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic)) == 0;
+			valid = valid && header.version == MeshCacheVersion;
+			valid = valid && header.SourceHash == hash;
+			valid = valid && header.processing == MeshProcessing();
+			valid = valid && header.layout == VertexLayout::LayoutId;
+			valid = valid && header.VertexSize == sizeof(VertexLayout);
+			valid = valid && (header.IndexSize == sizeof(uint16_t) || header.IndexSize == sizeof(uint32_t));
+			valid = valid && header.LodLevels == options.LodLevels && header.LodRatio == options.LodRatio && header.LodError == options.LodError;
+			valid = valid && header.LevelCount != 0 && header.LevelCount <= size / sizeof(MeshLevel);
+			valid = valid && header.ChunkCount <= size / sizeof(MeshChunk) && header.ChunkCount % header.LevelCount == 0;
+			valid = valid && header.MaterialCount != 0 && header.MaterialCount <= size / sizeof(MeshMaterial);
+			valid = valid && header.VertexCount <= size / sizeof(VertexLayout);
+			valid = valid && header.IndexCount <= size / header.IndexSize;
+			valid = valid && size == sizeof(header) + header.LevelCount * sizeof(MeshLevel) + header.ChunkCount * sizeof(MeshChunk) + header.MaterialCount * sizeof(MeshMaterial) + header.VertexCount * sizeof(VertexLayout) + header.IndexCount * header.IndexSize;
+		}
+
+		// every level has a chunk for each chunk of the full mesh, and WriteDrawCommands indexes the chunks from FirstChunk
+		for (uint32_t l = 0; valid && l < header.LevelCount; l++)
+		{
+			MeshLevel level;
+			memcpy(&level, data + sizeof(header) + l * sizeof(MeshLevel), sizeof(level));
+
+			valid = level.FirstChunk == l * (header.ChunkCount / header.LevelCount);
+		}
+
+		// the material indices end up in a storage buffer the shaders index without a bounds check, and the index and
+		// vertex ranges go to the indirect draws
+		for (uint64_t c = 0; valid && c < header.ChunkCount; c++)
+		{
+			MeshChunk chunk;
+			memcpy(&chunk, data + sizeof(header) + header.LevelCount * sizeof(MeshLevel) + c * sizeof(MeshChunk), sizeof(chunk));
+
+			valid = chunk.material < header.MaterialCount;
+			valid = valid && static_cast<uint64_t>(chunk.FirstIndex) + chunk.IndexCount <= header.IndexCount;
+			valid = valid && chunk.VertexOffset >= 0 && static_cast<uint64_t>(chunk.VertexOffset) + chunk.VertexCount <= header.VertexCount;
+		}
+
+		if (!valid)
+		{
+			std::cout << "mesh cache " << MeshCachePath << " is stale, parsing " << ModelPath << std::endl;
+			MeshCache.Close();
+			return false;
+		}
+
+		// the mapping is page aligned and the header keeps both arrays aligned, so they are used in place
+		const MeshLevel* CachedLevels = reinterpret_cast<const MeshLevel*>(data + sizeof(header));
+		levels.assign(CachedLevels, CachedLevels + header.LevelCount);
+
+		const MeshChunk* CachedChunks = reinterpret_cast<const MeshChunk*>(data + sizeof(header) + header.LevelCount * sizeof(MeshLevel));
+		chunks.assign(CachedChunks, CachedChunks + header.ChunkCount);
+
+		const MeshMaterial* CachedMaterials = reinterpret_cast<const MeshMaterial*>(CachedChunks + header.ChunkCount);
+		materials.assign(CachedMaterials, CachedMaterials + header.MaterialCount);
+
+		for (MeshMaterial& material : materials)
+		{
+			material.texture[sizeof(material.texture) - 1] = 0;
+		}
+
+		size_t offset = sizeof(header) + header.LevelCount * sizeof(MeshLevel) + header.ChunkCount * sizeof(MeshChunk) + header.MaterialCount * sizeof(MeshMaterial);
+		MeshVertices = reinterpret_cast<const VertexLayout*>(data + offset);
+		VertexCount = header.VertexCount;
+		MeshIndices = data + offset + header.VertexCount * sizeof(VertexLayout);
+		IndexCount = header.IndexCount;
+		IndexSize = header.IndexSize;
+
+		quantization.PositionCenter = glm::vec3(header.PositionCenter[0], header.PositionCenter[1], header.PositionCenter[2]);
+		quantization.PositionExtent = glm::vec3(header.PositionExtent[0], header.PositionExtent[1], header.PositionExtent[2]);
+		quantization.TexCoordScale = glm::vec2(header.TexCoordScale[0], header.TexCoordScale[1]);
+		quantization.TexCoordOffset = glm::vec2(header.TexCoordOffset[0], header.TexCoordOffset[1]);
+
+		BoundsCenter = glm::vec3(header.BoundsCenter[0], header.BoundsCenter[1], header.BoundsCenter[2]);
+		BoundsRadius = header.BoundsRadius;
+
+		return true;
+	}
+
+	void WriteMeshCache(uint64_t hash)
+	{
+		MeshCacheHeader header = {};
+		memcpy(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+		header.version = MeshCacheVersion;
+		header.SourceHash = hash;
+		header.VertexSize = sizeof(VertexLayout);
+		header.IndexSize = IndexSize;
+		header.VertexCount = VertexCount;
+		header.IndexCount = IndexCount;
+		header.processing = MeshProcessing();
+		header.layout = VertexLayout::LayoutId;
+		header.ChunkCount = chunks.size();
+		header.LevelCount = static_cast<uint32_t>(levels.size());
+		header.MaterialCount = static_cast<uint32_t>(materials.size());
+		header.LodLevels = options.LodLevels;
+		header.LodRatio = options.LodRatio;
+		header.LodError = options.LodError;
+		header.BoundsRadius = BoundsRadius;
+
+		for (int i = 0; i < 3; i++)
+		{
+			header.PositionCenter[i] = quantization.PositionCenter[i];
+			header.PositionExtent[i] = quantization.PositionExtent[i];
+			header.BoundsCenter[i] = BoundsCenter[i];
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			header.TexCoordScale[i] = quantization.TexCoordScale[i];
+			header.TexCoordOffset[i] = quantization.TexCoordOffset[i];
+		}
+
+		bool written = WriteFileReplacing(MeshCachePath, [&](std::ostream& file)
+		{
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(MeshLevel));
+			file.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(MeshChunk));
+			file.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(MeshMaterial));
+			file.write(reinterpret_cast<const char*>(MeshVertices), VertexCount * sizeof(VertexLayout));
+			file.write(reinterpret_cast<const char*>(MeshIndices), IndexCount * IndexSize);
+		});
+
+		if (!written)
+		{
+			std::cerr << "failed to write mesh cache " << MeshCachePath << std::endl;
+		}
+	}
+
+	void ParseModel(const char* data, size_t size)
+	{
+		ObjMesh mesh = ObjParser::Parse(data, size, workers);
+
+		// one vertex per triangle corner, deduplicated below
+		std::vector<Vertex> expanded(mesh.corners.size());
+
+		const size_t BlockSize = 1 << 16;
+		size_t blocks = (expanded.size() + BlockSize - 1) / BlockSize;
+
+		workers.ParallelFor(blocks, [&](size_t block)
+		{
+			for (size_t i = block * BlockSize; i < std::min(expanded.size(), (block + 1) * BlockSize); i++)
+			{
+				const ObjCorner& corner = mesh.corners[i];
+				Vertex vertex = {};
+
+				vertex.position = {
+					mesh.positions[3 * corner.position + 0],
+					mesh.positions[3 * corner.position + 1],
+					mesh.positions[3 * corner.position + 2]
+				};
+
+				if (corner.texcoord >= 0)
+				{
+					vertex.TexCoord = {
+						mesh.texcoords[2 * corner.texcoord + 0],
+						1.0f - mesh.texcoords[2 * corner.texcoord + 1]
+					};
+				}
+
+				vertex.color = { 1.0f, 1.0f, 1.0f };
+
+				expanded[i] = vertex;
+			}
+		});
+
+		VertexDeduplicator::DeduplicateParallel(expanded, vertices, indices, workers);
+
+		// there is one index per corner, so the shapes start at the same offsets
+		shapes.assign(mesh.shapes.begin(), mesh.shapes.end());
+
+		LoadMaterials(mesh);
+		OptimizeMesh();
+	}
+
+	// mtllib names are relative to the OBJ file
+	std::string GetMaterialLibraryPath(const std::string& library) const
+	{
+		return ModelPath.substr(0, ModelPath.find_last_of("/\\") + 1) + library;
+	}
+
+	// reads the MTL files the model names and sets the material of every shape, material 0 has the texture of
+	// TexturePath and is used by the faces without a usemtl record or with a material no file defines
+	void LoadMaterials(const ObjMesh& mesh)
+	{
+		std::vector<ObjMaterial> defined;
+		std::vector<std::string> MapDirectories;
+
+		for (const std::string& library : mesh.libraries)
+		{
+			std::string path = GetMaterialLibraryPath(library);
+			MappedFile file;
+
+			if (!file.Open(path))
+			{
+				std::cerr << "failed to open material library " << path << std::endl;
+				continue;
+			}
+
+			MtlParser::Parse(file.GetData(), file.GetSize(), defined);
+
+			// the maps are relative to the MTL file
+			MapDirectories.resize(defined.size(), path.substr(0, path.find_last_of("/\\") + 1));
+		}
+
+		MeshMaterial fallback = { { 1.0f, 1.0f, 1.0f, 1.0f }, {} };
+		TexturePath.copy(fallback.texture, sizeof(fallback.texture) - 1);
+
+		materials = { fallback };
+
+		// the index in materials of every material the usemtl records name
+		std::vector<uint32_t> used(mesh.materials.size(), 0);
+
+		for (size_t i = 0; i < mesh.materials.size(); i++)
+		{
+			auto found = std::find_if(defined.begin(), defined.end(), [&](const ObjMaterial& material) { return material.name == mesh.materials[i]; });
+
+			if (found == defined.end())
+			{
+				std::cerr << "material " << mesh.materials[i] << " is not defined" << std::endl;
+				continue;
+			}
+
+			MeshMaterial material = { { found->diffuse.x, found->diffuse.y, found->diffuse.z, 1.0f }, {} };
+
+			if (!found->DiffuseMap.empty())
+			{
+				std::string path = MapDirectories[found - defined.begin()] + found->DiffuseMap;
+
+				if (path.size() < sizeof(material.texture))
+				{
+					path.copy(material.texture, sizeof(material.texture) - 1);
+				}
+				else
+				{
+					std::cerr << "texture path " << path << " of material " << found->name << " is too long" << std::endl;
+				}
+			}
+
+			used[i] = static_cast<uint32_t>(materials.size());
+			materials.push_back(material);
+		}
+
+		ShapeMaterials.resize(mesh.ShapeMaterials.size());
+
+		for (size_t shape = 0; shape < ShapeMaterials.size(); shape++)
+		{
+			ShapeMaterials[shape] = mesh.ShapeMaterials[shape] < 0 ? 0 : used[mesh.ShapeMaterials[shape]];
+		}
+
+		std::cout << materials.size() - 1 << (materials.size() == 2 ? " material" : " materials") << " from " << mesh.libraries.size() << " material libraries" << std::endl;
+	}
+
+	void OptimizeMesh()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		VertexCacheStatistics before = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+
+		// triangles are only reordered within their shape so every shape stays one index range
+		workers.ParallelFor(shapes.size(), [this](size_t shape)
+		{
+			size_t first = shapes[shape];
+			size_t last = shape + 1 < shapes.size() ? shapes[shape + 1] : indices.size();
+
+			std::vector<uint32_t> range(indices.begin() + first, indices.begin() + last);
+
+			MeshOptimizer::OptimizeVertexCache(range, vertices.size());
+
+			if (options.overdraw)
+			{
+				MeshOptimizer::OptimizeOverdraw(range, vertices, 1.05f);
+			}
+
+			std::copy(range.begin(), range.end(), indices.begin() + first);
+		});
+
+		MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+		VertexCacheStatistics after = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << "mesh optimised in " << Milliseconds(start, end) << " ms, ";
+		std::cout << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+	}
+
+	void CreateVertexBuffer()
+	{
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		VkDeviceSize size = sizeof(VertexLayout) * VertexCount;
+		VkBufferUsageFlags usage;
+		VkMemoryPropertyFlags properties;
+
+		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+
+		memcpy(StagingBufferMemory.data, MeshVertices, size);
+
+		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		CreateBuffer(size, usage, properties, VertexBuffer, VertexBufferMemory);
+
+		CopyBuffer(StagingBuffer, VertexBuffer, size);
+		TransferBufferOwnership(VertexBuffer, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+	}
+
+	void CreateIndexBuffer()
+	{
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		VkDeviceSize size = IndexSize * IndexCount;
+		VkBufferUsageFlags usage;
+		VkMemoryPropertyFlags properties;
+
+		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+
+		memcpy(StagingBufferMemory.data, MeshIndices, size);
+
+		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		CreateBuffer(size, usage, properties, IndexBuffer, IndexBufferMemory);
+
+		CopyBuffer(StagingBuffer, IndexBuffer, size);
+		TransferBufferOwnership(IndexBuffer, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+	}
+
+	void CreateChunkBuffer()
+	{
+		if (!ComputeCulling)
+		{
+			return;
+		}
+
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		VkDeviceSize size = sizeof(GpuChunk) * chunks.size();
+		VkBufferUsageFlags usage;
+		VkMemoryPropertyFlags properties;
+
+		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+
+		GpuChunk* data = reinterpret_cast<GpuChunk*>(StagingBufferMemory.data);
+
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			GpuChunk chunk = {
+				glm::vec4(chunks[i].minimum, 0.0f),	// minimum
+				glm::vec4(chunks[i].maximum, 0.0f),	// maximum
+				chunks[i].FirstIndex,				// FirstIndex
+				chunks[i].IndexCount,				// IndexCount
+				chunks[i].VertexOffset,				// VertexOffset
+				chunks[i].material					// material
+			};
+
+			data[i] = chunk;
+		}
+
+		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		CreateBuffer(size, usage, properties, ChunkBuffer, ChunkBufferMemory);
+
+		CopyBuffer(StagingBuffer, ChunkBuffer, size);
+		TransferBufferOwnership(ChunkBuffer, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+	}
+
+	// the diffuse maps of the materials are decoded as one batch on the thread pool straight into a staging buffer that
+	// also takes their mip chains, and uploaded as RGBA8 images. Slot 0 of the texture array is the streamed texture,
+	// a map several materials share is loaded once and one that fails to load or decode leaves its materials untextured
+	void CreateMaterialTextures()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		MaterialTextureSlots.assign(materials.size(), NoTextureSlot);
+
+		// without descriptor indexing every draw uses material 0, so the maps of the others are not loaded
+		if (!BindlessTextures)
+		{
+			MaterialTextureSlots[0] = 0;
+
+			if (materials.size() > 1)
+			{
+				std::cout << "drawing every shape with material 0, the device has no descriptor indexing" << std::endl;
+			}
+
+			return;
+		}
+
+		std::unordered_map<std::string, uint32_t> slots = { { TexturePath, 0 } };
+		std::vector<std::unique_ptr<MappedFile>> files;
+		std::vector<ImageDecodeJob> jobs;
+		std::vector<std::string> paths;
+
+		for (size_t m = 0; m < materials.size(); m++)
+		{
+			std::string path = materials[m].texture;
+
+			if (path.empty())
+			{
+				continue;
+			}
+
+			auto found = slots.find(path);
+
+			if (found == slots.end())
+			{
+				std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+				bool opened = file->Open(path);
+
+				ImageDecodeJob job = { opened ? file->GetData() : nullptr, opened ? file->GetSize() : 0, nullptr };
+
+				if (!opened || !ImageDecoder::ReadInfo(job))
+				{
+					std::cerr << "failed to load texture " << path << std::endl;
+					slots.emplace(path, NoTextureSlot);
+					continue;
+				}
+
+				if (jobs.size() + 1 >= MaxTextureSlots)
+				{
+					std::cerr << "texture " << path << " does not fit in the " << MaxTextureSlots << " texture slots" << std::endl;
+					slots.emplace(path, NoTextureSlot);
+					continue;
+				}
+
+				found = slots.emplace(path, static_cast<uint32_t>(jobs.size() + 1)).first;
+				files.push_back(std::move(file));
+				jobs.push_back(job);
+				paths.push_back(path);
+			}
+
+			MaterialTextureSlots[m] = found->second;
+		}
+
+		if (jobs.empty())
+		{
+			return;
+		}
+
+		// every level of every map goes into one staging buffer, level 0 with the slack the decoder asks for
+		std::vector<std::vector<VkDeviceSize>> offsets(jobs.size());
+		VkDeviceSize size = 0;
+
+		for (size_t t = 0; t < jobs.size(); t++)
+		{
+			uint32_t LevelCount = MipGenerator::GetLevelCount(jobs[t].width, jobs[t].height);
+
+			for (uint32_t i = 0; i < LevelCount; i++)
+			{
+				uint32_t width = std::max(jobs[t].width >> i, 1u);
+				uint32_t height = std::max(jobs[t].height >> i, 1u);
+
+				offsets[t].push_back((size + 15) & ~static_cast<VkDeviceSize>(15));
+				size = offsets[t].back() + (i == 0 ? ImageDecoder::GetSize(width, height) : static_cast<VkDeviceSize>(width) * height * 4);
+			}
+		}
+
+		// the decoder and the mip filter read back what they write, which is slow from write combined memory
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		if (allocator.HasMemoryType(properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+		{
+			properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, StagingBuffer, StagingBufferMemory);
+
+		for (size_t t = 0; t < jobs.size(); t++)
+		{
+			jobs[t].destination = reinterpret_cast<uint8_t*>(StagingBufferMemory.data + offsets[t][0]);
+		}
+
+		ImageDecoder::Decode(jobs, workers);
+
+		// the maps that decoded keep their order and close up the slots of those that did not, whose materials are left
+		// untextured
+		std::vector<uint32_t> remap(jobs.size() + 1, NoTextureSlot);
+		uint32_t decoded = 0;
+
+		remap[0] = 0;
+
+		for (size_t t = 0; t < jobs.size(); t++)
+		{
+			if (!jobs[t].decoded)
+			{
+				std::cerr << "failed to decode texture " << paths[t] << std::endl;
+				continue;
+			}
+
+			remap[t + 1] = ++decoded;
+		}
+
+		for (uint32_t& slot : MaterialTextureSlots)
+		{
+			if (slot != NoTextureSlot)
+			{
+				slot = remap[slot];
+			}
+		}
+
+		MipGenerator generator(options.MipFiltering, options.SrgbMips);
+		size_t direct = 0;
+
+		MaterialImages.resize(decoded);
+		MaterialImageMemories.resize(decoded);
+		MaterialImageViews.resize(decoded);
+
+		for (size_t t = 0; t < jobs.size(); t++)
+		{
+			if (!jobs[t].decoded)
+			{
+				continue;
+			}
+
+			// the image of slot remap[t + 1], slot 0 being the streamed texture
+			size_t image = remap[t + 1] - 1;
+			std::vector<uint8_t*> levels;
+
+			for (VkDeviceSize offset : offsets[t])
+			{
+				levels.push_back(reinterpret_cast<uint8_t*>(StagingBufferMemory.data + offset));
+			}
+
+			generator.Generate(levels, jobs[t].width, jobs[t].height, workers);
+
+			uint32_t LevelCount = static_cast<uint32_t>(levels.size());
+			VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+			VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			CreateImage(jobs[t].width, jobs[t].height, LevelCount, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MaterialImages[image], MaterialImageMemories[image]);
+
+			TransitionImageLayout(MaterialImages[image], format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, LevelCount);
+			CopyBufferToImage(StagingBuffer, MaterialImages[image], jobs[t].width, jobs[t].height, offsets[t]);
+
+			TransferImageOwnership(MaterialImages[image], LevelCount, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			TransitionImageLayout(MaterialImages[image], format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, LevelCount);
+
+			MaterialImageViews[image] = CreateImageView(MaterialImages[image], format, VK_IMAGE_ASPECT_COLOR_BIT, LevelCount);
+
+			MaterialTextureBytes += (t + 1 < jobs.size() ? offsets[t + 1][0] : size) - offsets[t][0];
+			direct += jobs[t].direct ? 1 : 0;
+		}
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << MaterialImages.size() << " material textures, " << MaterialTextureBytes << " bytes, " << direct << " decoded in place, loaded in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+	}
+
+	// the material table the fragment shader indexes with the material of the draw
+	void CreateMaterialBuffer()
+	{
+		VkBuffer StagingBuffer;
+		MemoryAllocation StagingBufferMemory;
+		VkDeviceSize size = sizeof(GpuMaterial) * materials.size();
+		VkBufferUsageFlags usage;
+		VkMemoryPropertyFlags properties;
+
+		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+
+		GpuMaterial* data = reinterpret_cast<GpuMaterial*>(StagingBufferMemory.data);
+
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			const float* diffuse = materials[i].diffuse;
+
+			GpuMaterial material = {
+				glm::vec4(diffuse[0], diffuse[1], diffuse[2], diffuse[3]),	// diffuse
+				MaterialTextureSlots[i],									// texture
+				{ 0, 0, 0 }													// padding
+			};
+
+			data[i] = material;
+		}
+
+		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		CreateBuffer(size, usage, properties, MaterialBuffer, MaterialBufferMemory);
+
+		CopyBuffer(StagingBuffer, MaterialBuffer, size);
+		TransferBufferOwnership(MaterialBuffer, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		ReleaseStagingBuffer(StagingBuffer, StagingBufferMemory);
+	}
+
+	void CreateUniformBuffers()
+	{
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		// dynamic offsets must be a multiple of minUniformBufferOffsetAlignment, which is a power of two
+		VkDeviceSize alignment = PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+		UniformBufferStride = (sizeof(UniformBufferObject) + alignment - 1) & ~(alignment - 1);
+
+		VkDeviceSize size = UniformBufferStride * FramesInFlight;
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		CreateBuffer(size, usage, properties, UniformBuffer, UniformBufferMemory);
+
+		// the allocator keeps host visible blocks mapped and the memory is coherent, so writes need no flush
+		UniformBufferData = UniformBufferMemory.data;
+	}
+
+	void CreateIndirectBuffers()
+	{
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		// the storage slices are bound with dynamic offsets
+		VkDeviceSize alignment = PhysicalDeviceProperties.limits.minStorageBufferOffsetAlignment;
+
+		// the transforms of a frame go into the slice of its frame in flight, which the GPU no longer reads once the
+		// frame's fence has signalled
+		InstanceBufferStride = sizeof(InstanceData) * options.instances;
+		InstanceBufferStride = (InstanceBufferStride + alignment - 1) & ~(alignment - 1);
+
+		VkDeviceSize size = InstanceBufferStride * FramesInFlight;
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		CreateBuffer(size, usage, properties, InstanceBuffer, InstanceBufferMemory);
+
+		InstanceBufferData = InstanceBufferMemory.data;
+
+		// both paths lay a slice out the same way, the vertex shader reads the materials of the draws from it, and only
+		// the compute pass fills in the count
+		IndirectBufferStride = DrawCountSize + sizeof(DrawRecord) * GetMaxDrawCount();
+		IndirectBufferStride = (IndirectBufferStride + alignment - 1) & ~(alignment - 1);
+
+		size = IndirectBufferStride * FramesInFlight;
+
+		if (!ComputeCulling)
+		{
+			usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+			CreateBuffer(size, usage, properties, IndirectBuffer, IndirectBufferMemory);
+
+			IndirectBufferData = IndirectBufferMemory.data;
+			return;
+		}
+
+		// the compute pass writes the draws, so they live in device local memory
+		usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		CreateBuffer(size, usage, properties, IndirectBuffer, IndirectBufferMemory);
+
+		// the CPU reads the counts back, so cached memory is preferred
+		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		if (allocator.HasMemoryType(properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+		{
+			properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+
+		CreateBuffer(sizeof(uint32_t) * FramesInFlight, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, DrawCountBuffer, DrawCountBufferMemory);
+
+		DrawCountData = reinterpret_cast<const uint32_t*>(DrawCountBufferMemory.data);
+		DrawCountWritten.assign(FramesInFlight, false);
+	}
+
+	// the compute pass may emit a draw for every chunk of every instance, the CPU groups the instances by level and
+	// emits one instanced draw for every chunk of each level
+	uint32_t GetMaxDrawCount() const
+	{
+		uint32_t ChunkCount = static_cast<uint32_t>(GetChunkCount());
+
+		return ComputeCulling ? ChunkCount * options.instances : ChunkCount * static_cast<uint32_t>(levels.size());
+	}
+
+	// the instances stand on a square grid in the xy plane and each spins with its own phase, a single instance stays
+	// at the origin
+	void UpdateInstances(float time)
+	{
+		uint32_t side = GetGridSide();
+		float spacing = GetInstanceSpacing();
+
+		InstanceTransforms.resize(options.instances);
+
+		for (uint32_t i = 0; i < options.instances; i++)
+		{
+			glm::vec3 offset = glm::vec3(i % side - (side - 1) * 0.5f, i / side - (side - 1) * 0.5f, 0.0f) * spacing;
+			float angle = time * glm::radians(90.0f * 0.25f) + i * 0.7f;
+
+			InstanceTransforms[i] = glm::rotate(glm::translate(glm::mat4(1.0f), offset), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+	}
+
+	uint32_t GetGridSide() const
+	{
+		return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(options.instances))));
+	}
+
+	// neighbouring bounding spheres stay half a diameter apart whatever the instances' rotation
+	float GetInstanceSpacing() const
+	{
+		return 3.0f * BoundsRadius;
+	}
+
+	// distance from the centre of the grid to the outermost row of instances
+	float GetGridReach() const
+	{
+		return (GetGridSide() - 1) * 0.5f * GetInstanceSpacing();
+	}
+
+	void UpdateUniformBuffer(uint32_t slot)
+	{
+		static auto StartTime = std::chrono::high_resolution_clock::now();
+
+		auto CurrentTime = std::chrono::high_resolution_clock::now();
+		float DeltaTime = std::chrono::duration<float, std::chrono::seconds::period>(CurrentTime - StartTime).count();
+
+		UpdateInstances(DeltaTime);
+
+		UniformBufferObject ubo = {};
+
+		// the model matrix only decodes the quantised positions, the instance transforms place the copies
+		ubo.model = glm::scale(glm::translate(glm::mat4(1.0f), quantization.PositionCenter), quantization.PositionExtent);
+		ubo.TexCoordTransform = glm::vec4(quantization.TexCoordScale, quantization.TexCoordOffset);
+
+		// the camera backs away along the diagonal until the whole grid is in view
+		float reach = GetGridReach();
+		glm::vec3 eye = glm::vec3(2.0f + 1.5f * reach);
+		ubo.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+		float FieldOfView = glm::radians(45.0f);
+		float AspectRatio = SwapChainExtent.width / static_cast<float>(SwapChainExtent.height);
+		float FarPlane = std::max(10.0f, glm::length(eye) + 1.5f * reach + 2.0f * BoundsRadius);
+		ubo.proj = glm::perspective(FieldOfView, AspectRatio, 0.1f, FarPlane);
+		ubo.proj[1][1] *= -1;
+
+		// pixels covered by one model unit at unit distance from the camera
+		float PixelsPerUnit = SwapChainExtent.height / (2.0f * std::tan(FieldOfView * 0.5f));
+
+		std::array<glm::vec4, 6> planes = FrustumCuller::ExtractPlanes(ubo.proj * ubo.view);
+
+		// the compute pass selects the level of every instance, culls and writes the draws, it only needs the transforms
+		if (ComputeCulling)
+		{
+			std::copy(planes.begin(), planes.end(), ubo.planes);
+			ubo.camera = glm::vec4(eye, PixelsPerUnit);
+			ubo.bounds = glm::vec4(BoundsCenter, BoundsRadius);
+
+			for (size_t level = 0; level < levels.size(); level++)
+			{
+				ubo.LevelErrors[level / 4][level % 4] = levels[level].error;
+				ubo.LevelChunks[level / 4][level % 4] = levels[level].FirstChunk;
+			}
+
+			ubo.LevelCount = static_cast<uint32_t>(levels.size());
+			ubo.ChunkCount = static_cast<uint32_t>(GetChunkCount());
+			ubo.InstanceCount = options.instances;
+			ubo.LodThreshold = options.LodThreshold;
+
+			InstanceData* instances = reinterpret_cast<InstanceData*>(InstanceBufferData + slot * InstanceBufferStride);
+
+			for (uint32_t i = 0; i < options.instances; i++)
+			{
+				instances[i].transform = InstanceTransforms[i];
+			}
+
+			// only reported, the shader makes the same choice per instance
+			CurrentLevel = SelectLevel(InstanceTransforms[0], eye, PixelsPerUnit);
+
+			memcpy(UniformBufferData + slot * UniformBufferStride, &ubo, sizeof(ubo));
+			return;
+		}
+
+		memcpy(UniformBufferData + slot * UniformBufferStride, &ubo, sizeof(ubo));
+
+		CullInstances(planes);
+
+		// CurrentLevel ends up as the finest level any visible instance needs, which all of them share when a draw
+		// cannot start at an arbitrary instance
+		InstanceLevels.resize(VisibleInstances.size());
+		CurrentLevel = VisibleInstances.empty() ? 0 : static_cast<uint32_t>(levels.size() - 1);
+
+		for (size_t v = 0; v < VisibleInstances.size(); v++)
+		{
+			InstanceLevels[v] = SelectLevel(InstanceTransforms[VisibleInstances[v]], eye, PixelsPerUnit);
+			CurrentLevel = std::min(CurrentLevel, InstanceLevels[v]);
+		}
+
+		if (!DrawIndirectFirstInstance)
+		{
+			std::fill(InstanceLevels.begin(), InstanceLevels.end(), CurrentLevel);
+		}
+
+		// single chunks are only culled when one instance is visible, otherwise every draw covers all the instances
+		// of its level
+		if (options.culling && VisibleInstances.size() == 1)
+		{
+			FrustumCuller::Cull(FrustumCuller::ExtractPlanes(ubo.proj * ubo.view * InstanceTransforms[VisibleInstances[0]]), ChunkBoxes, VisibleChunks);
+		}
+		else
+		{
+			VisibleChunks.resize(GetChunkCount());
+
+			for (size_t c = 0; c < VisibleChunks.size(); c++)
+			{
+				VisibleChunks[c] = static_cast<uint32_t>(c);
+			}
+		}
+
+		WriteDrawCommands(slot);
+	}
+
+	// the world space box of an instance encloses the box around the full mesh under the instance's transform
+	void CullInstances(const std::array<glm::vec4, 6>& planes)
+	{
+		if (!options.culling)
+		{
+			VisibleInstances.resize(options.instances);
+
+			for (uint32_t i = 0; i < options.instances; i++)
+			{
+				VisibleInstances[i] = i;
+			}
+
+			return;
+		}
+
+		glm::vec3 center = (MeshMinimum + MeshMaximum) * 0.5f;
+		glm::vec3 extent = (MeshMaximum - MeshMinimum) * 0.5f;
+
+		InstanceBoxes.Resize(options.instances);
+
+		for (uint32_t i = 0; i < options.instances; i++)
+		{
+			const glm::mat4& transform = InstanceTransforms[i];
+
+			glm::vec3 WorldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+			glm::vec3 WorldExtent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y + glm::abs(glm::vec3(transform[2])) * extent.z;
+
+			InstanceBoxes.Set(i, WorldCenter, WorldExtent);
+		}
+
+		FrustumCuller::Cull(planes, InstanceBoxes, VisibleInstances);
+	}
+
+	// the coarsest level whose error, projected at the point of the bounding sphere closest to the camera, stays
+	// within the pixel threshold
+	uint32_t SelectLevel(const glm::mat4& model, const glm::vec3& eye, float PixelsPerUnit) const
+	{
+		glm::vec4 center = model * glm::vec4(BoundsCenter, 1.0f);
+		float distance = glm::length(glm::vec3(center.x, center.y, center.z) - eye) - BoundsRadius;
+
+		if (distance <= 0.0f)
+		{
+			return 0;
+		}
+
+		uint32_t level = 0;
+
+		while (level + 1 < levels.size() && levels[level + 1].error * PixelsPerUnit / distance <= options.LodThreshold)
+		{
+			level++;
+		}
+
+		return level;
+	}
+
+	// sorts the visible instances by level into the frame's instance slice, then writes one instanced draw for every
+	// visible chunk of each level in use, the draws after those are left empty
+	void WriteDrawCommands(uint32_t slot)
+	{
+		std::array<uint32_t, MaxLodLevels + 1> FirstInstance = {};
+
+		for (uint32_t level : InstanceLevels)
+		{
+			FirstInstance[level + 1]++;
+		}
+
+		for (size_t level = 1; level < FirstInstance.size(); level++)
+		{
+			FirstInstance[level] += FirstInstance[level - 1];
+		}
+
+		std::array<uint32_t, MaxLodLevels> cursor;
+		std::copy(FirstInstance.begin(), FirstInstance.end() - 1, cursor.begin());
+
+		InstanceData* instances = reinterpret_cast<InstanceData*>(InstanceBufferData + slot * InstanceBufferStride);
+
+		for (size_t v = 0; v < VisibleInstances.size(); v++)
+		{
+			instances[cursor[InstanceLevels[v]]++].transform = InstanceTransforms[VisibleInstances[v]];
+		}
+
+		DrawRecord* records = reinterpret_cast<DrawRecord*>(IndirectBufferData + slot * IndirectBufferStride + DrawCountSize);
+		uint32_t draw = 0;
+
+		for (uint32_t level = 0; level < levels.size(); level++)
+		{
+			uint32_t InstanceCount = FirstInstance[level + 1] - FirstInstance[level];
+
+			if (InstanceCount == 0)
+			{
+				continue;
+			}
+
+			for (size_t c = 0; c < VisibleChunks.size(); c++)
+			{
+				const MeshChunk& chunk = chunks[levels[level].FirstChunk + VisibleChunks[c]];
+
+				DrawRecord record = {
+					{
+						chunk.IndexCount,		// indexCount
+						InstanceCount,			// instanceCount
+						chunk.FirstIndex,		// firstIndex
+						chunk.VertexOffset,		// vertexOffset
+						FirstInstance[level]	// firstInstance
+					},							// command
+					chunk.material				// material
+				};
+
+				records[draw++] = record;
+			}
+		}
+
+		FrameDraws = draw;
+
+		for (size_t c = draw; c < GetMaxDrawCount(); c++)
+		{
+			records[c] = {};
+		}
+	}
+
+	// the streamed texture and the material maps
+	uint32_t GetTextureSlotCount() const
+	{
+		return 1 + static_cast<uint32_t>(MaterialImageViews.size());
+	}
+
+	void CreateDescriptorPool()
+	{
+		// a set per view of the streamed texture
+		uint32_t SetCount = static_cast<uint32_t>(TextureImageViews.size());
+
+		VkDescriptorPoolSize UniformPoolSize = {
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	// type
+			SetCount									// descriptorCount
+		};
+
+		VkDescriptorPoolSize SamplerPoolSize = {
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// type
+			SetCount * GetTextureSlotCount()			// descriptorCount
+		};
+
+		// the draw records and the material table
+		VkDescriptorPoolSize StoragePoolSize = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			// type
+			SetCount									// descriptorCount
+		};
+
+		VkDescriptorPoolSize DynamicStoragePoolSize = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,	// type
+			SetCount									// descriptorCount
+		};
+
+		// the culling set reads the same uniform slice, the chunks, and the instance and draw slices
+		if (ComputeCulling)
+		{
+			UniformPoolSize.descriptorCount++;
+			StoragePoolSize.descriptorCount++;
+			DynamicStoragePoolSize.descriptorCount += 2;
+		}
+
+		std::vector<VkDescriptorPoolSize> PoolSizes = { UniformPoolSize, SamplerPoolSize, StoragePoolSize, DynamicStoragePoolSize };
+
+		VkDescriptorPoolCreateInfo DescriptorPoolCreateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,	// sType
+			nullptr,										// pNext
+			0,												// flags
+			SetCount + (ComputeCulling ? 1u : 0u),			// maxSets
+			PoolSizes.size(),								// poolSizeCount
+			PoolSizes.data()								// pPoolSizes
+		};
+
+		VkResult result = vkCreateDescriptorPool(device, &DescriptorPoolCreateInfo, nullptr, &DescriptorPool);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor pool");
+		}
+	}
+
+	void CreateDescriptorSetLayout()
+	{
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
+
+		// the texture array is declared as large as the device allows, capped at what a scene sensibly uses, and every
+		// set is allocated with the slots it fills. Without descriptor indexing it holds the streamed texture alone
+		const VkPhysicalDeviceLimits& limits = PhysicalDeviceProperties.limits;
+		MaxTextureSlots = BindlessTextures ? std::min({ limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages, 4096u }) : 1;
+
+		VkDescriptorSetLayoutBinding UniformLayoutBinding = {
+			0,											// binding
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_VERTEX_BIT,					// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding DrawLayoutBinding = {
+			1,											// binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,	// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_VERTEX_BIT,					// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding MaterialLayoutBinding = {
+			2,											// binding
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			// descriptorType
+			1,											// descriptorCount
+			VK_SHADER_STAGE_FRAGMENT_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		VkDescriptorSetLayoutBinding SamplerLayoutBinding = {
+			3,											// binding
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// descriptorType
+			MaxTextureSlots,							// descriptorCount
+			VK_SHADER_STAGE_FRAGMENT_BIT,				// stageFlags
+			nullptr										// pImmutableSamplers
+		};
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings = { UniformLayoutBinding, DrawLayoutBinding, MaterialLayoutBinding, SamplerLayoutBinding };
+
+		std::vector<VkDescriptorBindingFlagsEXT> BindingFlags = {
+			0,
+			0,
+			0,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT
+		};
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT BindingFlagsCreateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,	// sType
+			nullptr,																// pNext
+			BindingFlags.size(),													// bindingCount
+			BindingFlags.data()														// pBindingFlags
+		};
+
+		VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCreateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,	// sType
+			BindlessTextures ? &BindingFlagsCreateInfo : nullptr,	// pNext
+			0,														// flags
+			bindings.size(),										// bindingCount
+			bindings.data()											// pBindings
+		};
+
+		VkResult result = vkCreateDescriptorSetLayout(device, &DescriptorSetLayoutCreateInfo, nullptr, &DescriptorSetLayout);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor set layout");
+		}
+	}
+
+	void CreateDescriptorSets()
+	{
+		// the sets only differ in the view of the streamed texture, the one of ResidentLevel is bound, and each covers
+		// every frame in flight with the uniform and draw slices picked by the dynamic offsets at bind time
+		std::vector<VkDescriptorSetLayout> layouts(TextureImageViews.size(), DescriptorSetLayout);
+		std::vector<uint32_t> TextureSlotCounts(layouts.size(), GetTextureSlotCount());
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfoEXT VariableCountAllocateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT,	// sType
+			nullptr,																		// pNext
+			TextureSlotCounts.size(),														// descriptorSetCount
+			TextureSlotCounts.data()														// pDescriptorCounts
+		};
+
+		VkDescriptorSetAllocateInfo DescriptorSetAllocateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,				// sType
+			BindlessTextures ? &VariableCountAllocateInfo : nullptr,	// pNext
+			DescriptorPool,												// descriptorPool
+			layouts.size(),												// descriptorSetCount
+			layouts.data()												// pSetLayouts
+		};
+
+		DescriptorSets.resize(layouts.size());
+
+		VkResult result = vkAllocateDescriptorSets(device, &DescriptorSetAllocateInfo, DescriptorSets.data());
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate descriptor sets");
+		}
+
+		std::vector<VkDescriptorBufferInfo> BufferInfos = {
+			{ UniformBuffer, 0, sizeof(UniformBufferObject) },
+			{ IndirectBuffer, 0, IndirectBufferStride },
+			{ MaterialBuffer, 0, VK_WHOLE_SIZE }
+		};
+
+		std::vector<VkDescriptorType> types = {
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+		};
+
+		std::vector<VkDescriptorImageInfo> ImageInfos(GetTextureSlotCount());
+
+		for (size_t i = 0; i < MaterialImageViews.size(); i++)
+		{
+			ImageInfos[i + 1] = { TextureSampler, MaterialImageViews[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		}
+
+		for (size_t level = 0; level < DescriptorSets.size(); level++)
+		{
+			ImageInfos[0] = { TextureSampler, TextureImageViews[level], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+			std::vector<VkWriteDescriptorSet> DescriptorWrites;
+
+			for (uint32_t binding = 0; binding < BufferInfos.size(); binding++)
+			{
+				VkWriteDescriptorSet WriteDescriptor = {
+					VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,		// sType
+					nullptr,									// pNext
+					DescriptorSets[level],						// dstSet
+					binding,									// dstBinding
+					0,											// dstArrayElement
+					1,											// descriptorCount
+					types[binding],								// descriptorType
+					nullptr,									// pImageInfo
+					&BufferInfos[binding],						// pBufferInfo
+					nullptr										// pTexelBufferView
+				};
+
+				DescriptorWrites.push_back(WriteDescriptor);
+			}
+
+			VkWriteDescriptorSet SamplerWriteDescriptor = {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,		// sType
+				nullptr,									// pNext
+				DescriptorSets[level],						// dstSet
+				3,											// dstBinding
+				0,											// dstArrayElement
+				ImageInfos.size(),							// descriptorCount
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// descriptorType
+				ImageInfos.data(),							// pImageInfo
+				nullptr,									// pBufferInfo
+				nullptr										// pTexelBufferView
+			};
+
+			DescriptorWrites.push_back(SamplerWriteDescriptor);
+
+			vkUpdateDescriptorSets(device, DescriptorWrites.size(), DescriptorWrites.data(), 0, nullptr);
+		}
+
+		if (ComputeCulling)
+		{
+			CreateCullDescriptorSet();
+		}
+	}
+
+	void CreateCullDescriptorSet()
+	{
+		VkDescriptorSetAllocateInfo DescriptorSetAllocateInfo = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,	// sType
+			nullptr,										// pNext
+			DescriptorPool,									// descriptorPool
+			1,												// descriptorSetCount
+			&CullDescriptorSetLayout						// pSetLayouts
+		};
+
+		VkResult result = vkAllocateDescriptorSets(device, &DescriptorSetAllocateInfo, &CullDescriptorSet);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate culling descriptor set");
+		}
+
+		std::vector<VkDescriptorBufferInfo> BufferInfos = {
+			{ UniformBuffer, 0, sizeof(UniformBufferObject) },
+			{ ChunkBuffer, 0, VK_WHOLE_SIZE },
+			{ InstanceBuffer, 0, InstanceBufferStride },
+			{ IndirectBuffer, 0, IndirectBufferStride }
+		};
+
+		std::vector<VkDescriptorType> types = {
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
+		};
+
+		std::vector<VkWriteDescriptorSet> DescriptorWrites;
+
+		for (uint32_t binding = 0; binding < BufferInfos.size(); binding++)
+		{
+			VkWriteDescriptorSet WriteDescriptor = {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,		// sType
+				nullptr,									// pNext
+				CullDescriptorSet,							// dstSet
+				binding,									// dstBinding
+				0,											// dstArrayElement
+				1,											// descriptorCount
+				types[binding],								// descriptorType
+				nullptr,									// pImageInfo
+				&BufferInfos[binding],						// pBufferInfo
+				nullptr										// pTexelBufferView
+			};
+
+			DescriptorWrites.push_back(WriteDescriptor);
+		}
+
+		vkUpdateDescriptorSets(device, DescriptorWrites.size(), DescriptorWrites.data(), 0, nullptr);
+	}
+
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, MemoryAllocation & memory)
+	{
+		VkResult result;
+
+		VkBufferCreateInfo BufferCreateInfo = {
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,	// sType
+			nullptr,								// pNext
+			0,										// flags
+			size,									// size
+			usage,									// usage
+			VK_SHARING_MODE_EXCLUSIVE,				// sharingMode
+			0,										// queueFamilyIndexCount
+			nullptr									// pQueueFamilyIndices
+		};
+
+		result = vkCreateBuffer(device, &BufferCreateInfo, nullptr, &buffer);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create buffer");
+		}
+
+		VkMemoryRequirements MemoryRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &MemoryRequirements);
+
+		memory = allocator.Allocate(MemoryRequirements, properties, true);
+
+		vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+	}
+
+	void CopyBuffer(VkBuffer SrcBuffer, VkBuffer DstBuffer, VkDeviceSize size)
+	{
+		VkCommandBuffer CommandBuffer = GetTransferUploadCommands();
+
+		VkBufferCopy region = {
+			0,		// srcOffset
+			0,		// dstOffset
+			size	// size
 		};
 
-		VkAccessFlags flags = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		vkCmdCopyBuffer(CommandBuffer, SrcBuffer, DstBuffer, 1, &region);
+	}
 
-		VkSubpassDependency dependecy = {
-			VK_SUBPASS_EXTERNAL,							// srcSubpass
-			0,												// dstSubpass
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,	// srcStageMask
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,	// dstStageMask
-			0,												// srcAccessMask
-			flags,											// dstAccessMask
-			0												// dependencyFlags
+	VkCommandBuffer BeginUploadCommandBuffer(VkCommandPool pool)
+	{
+		VkResult result;
+		VkCommandBuffer CommandBuffer;
+
+		VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,	// sType
+			nullptr,										// pNext
+			pool,											// commandPool
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,				// level
+			1												// commandBufferCount
 		};
 
-		VkRenderPassCreateInfo RenderPassCreateInfo = {
-			VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,	// sType
-			nullptr,									// pNext
-			0,											// flags
-			attachments.size(),							// attachmentCount
-			attachments.data(),							// pAttachments
-			1,											// subpassCount
-			&SubpassDescription,						// pSubpasses
-			1,											// dependencyCount
-			&dependecy									// pDependencies
+		result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, &CommandBuffer);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffers");
+		}
+
+		VkCommandBufferBeginInfo CommandBufferBeginInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,	// sType
+			nullptr,										// pNext
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,	// flags
+			nullptr											// pInheritanceInfo
 		};
 
-		VkResult result = vkCreateRenderPass(device, &RenderPassCreateInfo, nullptr, &RenderPass);
+		result = vkBeginCommandBuffer(CommandBuffer, &CommandBufferBeginInfo);
 
 		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create render pass");
+			throw std::runtime_error("failed to begin recording command buffer");
 		}
+
+		return CommandBuffer;
 	}
 
-	void CreateGraphicsPipeline()
+	void OpenUploadBatch()
 	{
-		VkResult result;
+		if (UploadOpen)
+		{
+			return;
+		}
 
-		std::vector<char> VertCode = ReadFile("shaders/vert.spv");
-		std::vector<char> FragCode = ReadFile("shaders/frag.spv");
+		OpenUpload = UploadBatch();
+		OpenUpload.graphic = BeginUploadCommandBuffer(CommandPool);
+		OpenUpload.transfer = DedicatedTransfer ? BeginUploadCommandBuffer(TransferCommandPool) : OpenUpload.graphic;
 
-		VkShaderModule VertModule = CreateShaderModule(VertCode);
-		VkShaderModule FragModule = CreateShaderModule(FragCode);
+		// the upload queries are shared, so only a batch opened while no other one is pending gets timed
+		OpenUpload.timed = UploadTimestamps && PendingUploads.empty();
 
-		// the buffer with the code can be freed immediately after creating the shader module
+		if (OpenUpload.timed)
+		{
+			vkCmdResetQueryPool(OpenUpload.graphic, TimestampQueryPool, 0, 2);
+			vkCmdWriteTimestamp(OpenUpload.graphic, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TimestampQueryPool, 0);
+		}
 
-		VkPipelineShaderStageCreateInfo VertStageCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,	// sType
-			nullptr,												// pNext
-			0,														// flags
-			VK_SHADER_STAGE_VERTEX_BIT,								// stage
-			VertModule,												// module
-			"main",													// pName
-			nullptr													// pSpecializationInfo
-		};
+		UploadOpen = true;
+	}
 
-		VkPipelineShaderStageCreateInfo FragStageCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,	// sType
-			nullptr,												// pNext
-			0,														// flags
-			VK_SHADER_STAGE_FRAGMENT_BIT,							// stage
-			FragModule,												// module
-			"main",													// pName
-			nullptr													// pSpecializationInfo
+	VkCommandBuffer GetTransferUploadCommands()
+	{
+		OpenUploadBatch();
+		return OpenUpload.transfer;
+	}
+
+	VkCommandBuffer GetGraphicUploadCommands()
+	{
+		OpenUploadBatch();
+		return OpenUpload.graphic;
+	}
+
+	// makes a buffer written by the upload copies visible to the graphic queue
+	// with a dedicated transfer queue this is a release on the transfer queue and the matching acquire on the graphic one
+	void TransferBufferOwnership(VkBuffer buffer, VkAccessFlags DstAccessMask, VkPipelineStageFlags DstStage)
+	{
+		VkBufferMemoryBarrier BufferMemoryBarrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,							// sType
+			nullptr,															// pNext
+			VK_ACCESS_TRANSFER_WRITE_BIT,										// srcAccessMask
+			DstAccessMask,														// dstAccessMask
+			DedicatedTransfer ? TransferFamily : VK_QUEUE_FAMILY_IGNORED,		// srcQueueFamilyIndex
+			DedicatedTransfer ? GraphicFamily : VK_QUEUE_FAMILY_IGNORED,		// dstQueueFamilyIndex
+			buffer,																// buffer
+			0,																	// offset
+			VK_WHOLE_SIZE														// size
 		};
 
-		std::vector<VkPipelineShaderStageCreateInfo> stages = { VertStageCreateInfo, FragStageCreateInfo };
+		if (!DedicatedTransfer)
+		{
+			vkCmdPipelineBarrier(GetGraphicUploadCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, DstStage, 0, 0, nullptr, 1, &BufferMemoryBarrier, 0, nullptr);
+			return;
+		}
 
-		auto BindingDescription = Vertex::GetBindingDescription();
-		auto AttributeDescriptions = Vertex::GetAttributeDescriptions();
+		VkBufferMemoryBarrier release = BufferMemoryBarrier;
+		release.dstAccessMask = 0;
 
-		VkPipelineVertexInputStateCreateInfo VertexInputStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,	// sType
-			nullptr,													// pNext
-			0,															// flags
-			1,															// vertexBindingDescriptionCount
-			&BindingDescription,										// pVertexBindingDescriptions
-			AttributeDescriptions.size(),								// vertexAttributeDescriptionCount
-			AttributeDescriptions.data()								// pVertexAttributeDescriptions
+		VkBufferMemoryBarrier acquire = BufferMemoryBarrier;
+		acquire.srcAccessMask = 0;
+
+		vkCmdPipelineBarrier(GetTransferUploadCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+		vkCmdPipelineBarrier(GetGraphicUploadCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, DstStage, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+	}
+
+	// same as TransferBufferOwnership for a color image left in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL by its upload
+	void TransferImageOwnership(VkImage image, uint32_t MipLevels, VkAccessFlags DstAccessMask, VkPipelineStageFlags DstStage, uint32_t BaseLevel = 0)
+	{
+		VkImageSubresourceRange range = {
+			VK_IMAGE_ASPECT_COLOR_BIT,	// aspectMask
+			BaseLevel,					// baseMipLevel
+			MipLevels,					// levelCount
+			0,							// baseArrayLayer
+			1							// layerCount
 		};
 
-		VkPipelineInputAssemblyStateCreateInfo InputAssemblyStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,	// sType
+		VkImageMemoryBarrier ImageMemoryBarrier = {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,							// sType
 			nullptr,														// pNext
-			0,																// flags
-			VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,							// topology
-			VK_FALSE														// primitiveRestartEnable
+			VK_ACCESS_TRANSFER_WRITE_BIT,									// srcAccessMask
+			DstAccessMask,													// dstAccessMask
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,							// oldLayout
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,							// newLayout
+			DedicatedTransfer ? TransferFamily : VK_QUEUE_FAMILY_IGNORED,	// srcQueueFamilyIndex
+			DedicatedTransfer ? GraphicFamily : VK_QUEUE_FAMILY_IGNORED,	// dstQueueFamilyIndex
+			image,															// image
+			range															// subresourceRange
 		};
 
-		VkViewport viewport = {
-			0.0f,					// x
-			0.0f,					// y
-			SwapChainExtent.width,	// width
-			SwapChainExtent.height,	// height
-			0.0f,					// minDepth
-			1.0f					// maxDepth
-		};
+		if (!DedicatedTransfer)
+		{
+			vkCmdPipelineBarrier(GetGraphicUploadCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, DstStage, 0, 0, nullptr, 0, nullptr, 1, &ImageMemoryBarrier);
+			return;
+		}
 
-		VkRect2D scissor = {
-			{0, 0},			// offset
-			SwapChainExtent	// extent
-		};
+		VkImageMemoryBarrier release = ImageMemoryBarrier;
+		release.dstAccessMask = 0;
 
-		VkPipelineViewportStateCreateInfo ViewportStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,	// sType
-			nullptr,												// pNext
-			0,														// flags
-			1,														// viewportCount
-			&viewport,												// pViewports
-			1,														// scissorCount
-			&scissor												// pScissors
-		};
+		VkImageMemoryBarrier acquire = ImageMemoryBarrier;
+		acquire.srcAccessMask = 0;
 
-		VkPipelineRasterizationStateCreateInfo RasterizationStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,	// sType
-			nullptr,													// pNext
-			0,															// flags
-			VK_FALSE,													// depthClampEnable
-			VK_FALSE,													// rasterizerDiscardEnable
-			VK_POLYGON_MODE_FILL,										// polygonMode
-			VK_CULL_MODE_BACK_BIT,										// cullMode
-			VK_FRONT_FACE_COUNTER_CLOCKWISE,							// frontFace
-			VK_FALSE,													// depthBiasEnable
-			0.0f,														// depthBiasConstantFactor
-			0.0f,														// depthBiasClamp
-			0.0f,														// depthBiasSlopeFactor
-			1.0f														// lineWidth
-		};
+		vkCmdPipelineBarrier(GetTransferUploadCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+		vkCmdPipelineBarrier(GetGraphicUploadCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, DstStage, 0, 0, nullptr, 0, nullptr, 1, &acquire);
+	}
 
-		VkPipelineMultisampleStateCreateInfo MultisampleStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,	// sType
-			nullptr,													// pNext
-			0,															// flags
-			SampleCount,												// rasterizationSamples;
-			VK_FALSE,													// sampleShadingEnable
-			1.0f,														// minSampleShading
-			nullptr,													// pSampleMask
-			VK_FALSE,													// alphaToCoverageEnable
-			VK_FALSE													// alphaToOneEnable
-		};
+	// the staging buffer is still read by the open batch, it is destroyed when that batch completes
+	void ReleaseStagingBuffer(VkBuffer buffer, MemoryAllocation& memory)
+	{
+		OpenUploadBatch();
+		OpenUpload.staging.emplace_back(buffer, memory);
+		memory = MemoryAllocation();
+	}
 
-		VkPipelineDepthStencilStateCreateInfo DepthStencilStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,	// sType
-			nullptr,													// pNext
-			0,															// flags
-			VK_TRUE,													// depthTestEnable
-			VK_TRUE,													// depthWriteEnable
-			VK_COMPARE_OP_LESS,											// depthCompareOp
-			VK_FALSE,													// depthBoundsTestEnable
-			VK_FALSE,													// stencilTestEnable
-			{},															// front
-			{},															// back
-			0.0f,														// minDepthBounds
-			1.0f														// maxDepthBounds
-		};
+	// submits the open batch and returns its ticket, or the last ticket when nothing was recorded
+	uint64_t SubmitUploads()
+	{
+		if (!UploadOpen)
+		{
+			return UploadTicket;
+		}
 
-		VkColorComponentFlags ColorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkResult result;
+		UploadBatch& batch = OpenUpload;
 
-		VkPipelineColorBlendAttachmentState ColorBlendAttachmentState = {
-			VK_FALSE,				// blendEnable
-			VK_BLEND_FACTOR_ONE,	// srcColorBlendFactor
-			VK_BLEND_FACTOR_ZERO,	// dstColorBlendFactor
-			VK_BLEND_OP_ADD,		// colorBlendOp
-			VK_BLEND_FACTOR_ONE,	// srcAlphaBlendFactor
-			VK_BLEND_FACTOR_ZERO,	// dstAlphaBlendFactor
-			VK_BLEND_OP_ADD,		// alphaBlendOp
-			ColorWriteMask			// colorWriteMask
+		VkSemaphoreCreateInfo SemaphoreCreateInfo = {
+			VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,	// sType
+			nullptr,									// pNext
+			0											// flags
 		};
 
-		/*
-		// alpha blending : new color blended with old color based on its opacity
-		VkPipelineColorBlendAttachmentState AlphaBlending = {
-			VK_TRUE,								// blendEnable
-			VK_BLEND_FACTOR_SRC_ALPHA,				// srcColorBlendFactor
-			VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,	// dstColorBlendFactor
-			VK_BLEND_OP_ADD,						// colorBlendOp
-			VK_BLEND_FACTOR_ONE,					// srcAlphaBlendFactor
-			VK_BLEND_FACTOR_ZERO,					// dstAlphaBlendFactor
-			VK_BLEND_OP_ADD,						// alphaBlendOp
-			ColorWriteMask							// colorWriteMask
+		VkFenceCreateInfo FenceCreateInfo = {
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,	// sType
+			nullptr,								// pNext
+			0										// flags
 		};
-		*/
 
-		VkPipelineColorBlendStateCreateInfo ColorBlendStateCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,	// sType
-			nullptr,													// pNext
-			0,															// flags
-			VK_FALSE,													// logicOpEnable
-			VK_LOGIC_OP_COPY,											// logicOp
-			1,															// attachmentCount
-			&ColorBlendAttachmentState,									// pAttachments
-			{0.0f, 0.0f, 0.0f, 0.0f}									// blendConstants
-		};
+		if (DedicatedTransfer)
+		{
+			vkEndCommandBuffer(batch.transfer);
 
-		// VkDynamicState & VkPipelineDynamicStateCreateInfo
+			result = vkCreateSemaphore(device, &SemaphoreCreateInfo, nullptr, &batch.semaphore);
 
-		VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {
-			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,	// sType
-			nullptr,										// pNext
-			0,												// flags
-			1,												// setLayoutCount
-			&DescriptorSetLayout,							// pSetLayouts
-			0,												// pushConstantRangeCount
-			nullptr											// pPushConstantRanges
-		};
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload semaphore");
+			}
 
-		result = vkCreatePipelineLayout(device, &PipelineLayoutCreateInfo, nullptr, &PipelineLayout);
+			VkSubmitInfo TransferSubmitInfo = {
+				VK_STRUCTURE_TYPE_SUBMIT_INFO,	// sType
+				nullptr,						// pNext
+				0,								// waitSemaphoreCount
+				nullptr,						// pWaitSemaphores
+				nullptr,						// pWaitDstStageMask
+				1,								// commandBufferCount
+				&batch.transfer,				// pCommandBuffers
+				1,								// signalSemaphoreCount
+				&batch.semaphore				// pSignalSemaphores
+			};
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create pipeline layout");
-		}
+			result = vkQueueSubmit(TransferQueue, 1, &TransferSubmitInfo, VK_NULL_HANDLE);
 
-		VkGraphicsPipelineCreateInfo GraphicsPipelineCreateInfo = {
-			VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,	// sType
-			nullptr,											// pNext
-			0,													// flags
-			2,													// stageCount
-			stages.data(),										// pStages
-			&VertexInputStateCreateInfo,						// pVertexInputState
-			&InputAssemblyStateCreateInfo,						// pInputAssemblyState
-			nullptr,											// pTessellationState
-			&ViewportStateCreateInfo,							// pViewportState
-			&RasterizationStateCreateInfo,						// pRasterizationState
-			&MultisampleStateCreateInfo,						// pMultisampleState
-			&DepthStencilStateCreateInfo,						// pDepthStencilState
-			&ColorBlendStateCreateInfo,							// pColorBlendState
-			nullptr,											// pDynamicState
-			PipelineLayout,										// layout
-			RenderPass,											// renderPass
-			0,													// subpass
-			VK_NULL_HANDLE,										// basePipelineHandle
-			-1													// basePipelineIndex
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit transfer command buffer");
+			}
+		}
+
+		if (batch.timed)
+		{
+			vkCmdWriteTimestamp(batch.graphic, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TimestampQueryPool, 1);
+		}
+
+		vkEndCommandBuffer(batch.graphic);
+
+		result = vkCreateFence(device, &FenceCreateInfo, nullptr, &batch.fence);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload fence");
+		}
+
+		VkPipelineStageFlags WaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkSubmitInfo SubmitInfo = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,		// sType
+			nullptr,							// pNext
+			DedicatedTransfer ? 1u : 0u,		// waitSemaphoreCount
+			&batch.semaphore,					// pWaitSemaphores
+			&WaitStage,							// pWaitDstStageMask
+			1,									// commandBufferCount
+			&batch.graphic,						// pCommandBuffers
+			0,									// signalSemaphoreCount
+			nullptr								// pSignalSemaphores
 		};
 
-		result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &GraphicsPipelineCreateInfo, nullptr, &GraphicsPipeline);
+		result = vkQueueSubmit(GraphicQueue, 1, &SubmitInfo, batch.fence);
 
 		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create graphics pipeline");
+			throw std::runtime_error("failed to submit upload command buffer");
 		}
 
-		// bytecode compilation and linking happens during graphics pipeline creation
-		// so we can destroy shader modules as soon as pipeline creation is finished
+		batch.ticket = ++UploadTicket;
 
-		vkDestroyShaderModule(device, VertModule, nullptr);
-		vkDestroyShaderModule(device, FragModule, nullptr);
+		PendingUploads.push_back(std::move(batch));
+		UploadOpen = false;
+
+		return UploadTicket;
 	}
 
-	void CreateFramebuffers()
+	bool IsUploadComplete(uint64_t ticket)
 	{
-		SwapChainFramebuffers.clear();
+		for (const UploadBatch& batch : PendingUploads)
+		{
+			if (batch.ticket <= ticket && vkGetFenceStatus(device, batch.fence) != VK_SUCCESS)
+			{
+				return false;
+			}
+		}
 
-		for (VkImageView view : SwapChainImageViews)
+		return true;
+	}
+
+	void WaitUpload(uint64_t ticket)
+	{
+		while (!PendingUploads.empty() && PendingUploads.front().ticket <= ticket)
 		{
-			VkFramebuffer framebuffer;
-			// std::vector<VkImageView> attachments = { view, DepthImageView };
-			std::vector<VkImageView> attachments = { ColorImageView, DepthImageView, view };
+			UploadBatch& batch = PendingUploads.front();
 
-			VkFramebufferCreateInfo FramebufferCreateInfo = {
-				VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,	// sType
-				nullptr,									// pNext
-				0,											// flags
-				RenderPass,									// renderPass
-				attachments.size(),							// attachmentCount
-				attachments.data(),							// pAttachments
-				SwapChainExtent.width,						// width
-				SwapChainExtent.height,						// height
-				1											// layers
-			};
+			vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 
-			VkResult result = vkCreateFramebuffer(device, &FramebufferCreateInfo, nullptr, &framebuffer);
+			double milliseconds;
 
-			if (result != VK_SUCCESS)
+			// the fence is signaled so the results are already available
+			if (batch.timed && ReadTimestamps(0, VK_QUERY_RESULT_WAIT_BIT, milliseconds))
 			{
-				throw std::runtime_error("failed to create framebuffer");
+				UploadGpuTime += milliseconds;
+				UploadCount++;
 			}
 
-			SwapChainFramebuffers.push_back(framebuffer);
+			for (auto& staging : batch.staging)
+			{
+				vkDestroyBuffer(device, staging.first, nullptr);
+				allocator.Free(staging.second);
+			}
+
+			if (DedicatedTransfer)
+			{
+				vkFreeCommandBuffers(device, TransferCommandPool, 1, &batch.transfer);
+				vkDestroySemaphore(device, batch.semaphore, nullptr);
+			}
+
+			vkFreeCommandBuffers(device, CommandPool, 1, &batch.graphic);
+			vkDestroyFence(device, batch.fence, nullptr);
+
+			PendingUploads.erase(PendingUploads.begin());
 		}
 	}
 
-	void CreateCommandPool()
+	VkCommandPool CreateTransientCommandPool()
 	{
-		QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
-
 		VkCommandPoolCreateInfo CommandPoolCreateInfo = {
 			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,	// sType
 			nullptr,									// pNext
-			0,											// flags
-			index.graphic.value()						// queueFamilyIndex
+			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,		// flags
+			GraphicFamily								// queueFamilyIndex
 		};
 
-		VkResult result = vkCreateCommandPool(device, &CommandPoolCreateInfo, nullptr, &CommandPool);
+		VkCommandPool pool;
+		VkResult result = vkCreateCommandPool(device, &CommandPoolCreateInfo, nullptr, &pool);
 
 		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create command pool");
+			throw std::runtime_error("failed to create frame command pool");
 		}
-	}
-
-	void CreateColorResources()
-	{
-		VkFormat format = SwapChainFormat;
-		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-		CreateImage(SwapChainExtent.width, SwapChainExtent.height, 1, SampleCount, format, tiling, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ColorImage, ColorImageMemory);
-
-		ColorImageView = CreateImageView(ColorImage, format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
-		TransitionImageLayout(ColorImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
+		return pool;
 	}
 
-	void CreateDepthResources()
+	void CreateCommandBuffers()
 	{
-		uint32_t width = SwapChainExtent.width;
-		uint32_t height = SwapChainExtent.height;
-		VkFormat format = FindDepthFormat();
-		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-
-		CreateImage(width, height, 1, SampleCount, format, tiling, usage, properties, DepthImage, DepthImageMemory);
-		DepthImageView = CreateImageView(DepthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+		uint32_t TaskCount = options.RecordTasks != 0 ? options.RecordTasks : static_cast<uint32_t>(workers.GetThreadCount());
 
-		TransitionImageLayout(DepthImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-	}
+		FrameCommandBuffers.resize(FramesInFlight);
 
-	VkFormat FindSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags feature)
-	{
-		for (VkFormat format : formats)
+		for (FrameCommands& frame : FrameCommandBuffers)
 		{
-			VkFormatProperties properties;
-			vkGetPhysicalDeviceFormatProperties(PhysicalDevice, format, &properties);
+			frame.pool = CreateTransientCommandPool();
 
-			if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & feature) == feature)
+			VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
+				VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,	// sType
+				nullptr,										// pNext
+				frame.pool,										// commandPool
+				VK_COMMAND_BUFFER_LEVEL_PRIMARY,				// level
+				1												// commandBufferCount
+			};
+
+			VkResult result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, &frame.primary);
+
+			if (result != VK_SUCCESS)
 			{
-				return format;
+				throw std::runtime_error("failed to allocate command buffers");
 			}
-			else if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & feature) == feature)
+
+			frame.TaskPools.resize(TaskCount);
+			frame.secondaries.resize(TaskCount);
+
+			for (uint32_t task = 0; task < TaskCount; task++)
 			{
-				return format;
+				frame.TaskPools[task] = CreateTransientCommandPool();
+
+				CommandBufferAllocateInfo.commandPool = frame.TaskPools[task];
+				CommandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+				result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, &frame.secondaries[task]);
+
+				if (result != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to allocate secondary command buffers");
+				}
 			}
 		}
-
-		throw std::runtime_error("failed to find supported format");
 	}
 
-	VkFormat FindDepthFormat()
+	// resets the draw count of the frame's indirect slice and lets the culling shader append the visible draws, the
+	// frame's fence has signalled so the previous draws from this slice are done
+	void RecordCulling(VkCommandBuffer CommandBuffer, uint32_t slot)
 	{
-		std::vector<VkFormat> formats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
-		return FindSupportedFormat(formats, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-	}
+		VkDeviceSize IndirectOffset = slot * IndirectBufferStride;
 
-	bool HasStencilComponent(VkFormat format)
-	{
-		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+		vkCmdFillBuffer(CommandBuffer, IndirectBuffer, IndirectOffset, sizeof(uint32_t), 0);
+
+		VkBufferMemoryBarrier BufferMemoryBarrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,					// sType
+			nullptr,													// pNext
+			VK_ACCESS_TRANSFER_WRITE_BIT,								// srcAccessMask
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,		// dstAccessMask
+			VK_QUEUE_FAMILY_IGNORED,									// srcQueueFamilyIndex
+			VK_QUEUE_FAMILY_IGNORED,									// dstQueueFamilyIndex
+			IndirectBuffer,												// buffer
+			IndirectOffset,												// offset
+			IndirectBufferStride										// size
+		};
+
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &BufferMemoryBarrier, 0, nullptr);
+
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipeline);
+
+		std::vector<uint32_t> DynamicOffsets = {
+			static_cast<uint32_t>(slot * UniformBufferStride),
+			static_cast<uint32_t>(slot * InstanceBufferStride),
+			static_cast<uint32_t>(IndirectOffset)
+		};
+
+		vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, CullPipelineLayout, 0, 1, &CullDescriptorSet, DynamicOffsets.size(), DynamicOffsets.data());
+
+		// one invocation per instance and chunk, the shader's workgroups are 64 wide
+		vkCmdDispatch(CommandBuffer, (GetMaxDrawCount() + 63) / 64, 1, 1);
+
+		// the vertex shader reads the materials of the draws, and the count is copied out for the report
+		BufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		BufferMemoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &BufferMemoryBarrier, 0, nullptr);
+
+		VkBufferCopy region = {
+			IndirectOffset,				// srcOffset
+			slot * sizeof(uint32_t),	// dstOffset
+			sizeof(uint32_t)			// size
+		};
+
+		vkCmdCopyBuffer(CommandBuffer, IndirectBuffer, DrawCountBuffer, 1, &region);
+
+		VkBufferMemoryBarrier ReadbackBarrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,	// sType
+			nullptr,									// pNext
+			VK_ACCESS_TRANSFER_WRITE_BIT,				// srcAccessMask
+			VK_ACCESS_HOST_READ_BIT,					// dstAccessMask
+			VK_QUEUE_FAMILY_IGNORED,					// srcQueueFamilyIndex
+			VK_QUEUE_FAMILY_IGNORED,					// dstQueueFamilyIndex
+			DrawCountBuffer,							// buffer
+			region.dstOffset,							// offset
+			region.size									// size
+		};
+
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &ReadbackBarrier, 0, nullptr);
+
+		DrawCountWritten.at(slot) = true;
 	}
 
-	void CreateTextureImage()
+	// records the primary command buffer of the current frame in flight: the culling pass, then the render pass running
+	// the secondary buffers the recording tasks fill in parallel, each with its own range of the frame's draws
+	void RecordFrame(uint32_t index)
 	{
-		int width;
-		int height;
-		int channels;
+		FrameCommands& frame = FrameCommandBuffers.at(CurrentFrame);
+		uint32_t slot = static_cast<uint32_t>(CurrentFrame);
 
-		stbi_uc* pixels = stbi_load(TexturePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		// the count draw cannot be split, and small frames are not worth the hand off to the workers
+		uint32_t DrawCount = ComputeCulling ? GetMaxDrawCount() : FrameDraws;
+		uint32_t TaskCount = ComputeCulling ? 1 : std::min(static_cast<uint32_t>(frame.secondaries.size()), (DrawCount + MinTaskDraws - 1) / MinTaskDraws);
 
-		if (pixels == nullptr)
+		workers.ParallelFor(TaskCount, [&](size_t task)
+		{
+			uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(DrawCount) * task / TaskCount);
+			uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(DrawCount) * (task + 1) / TaskCount);
+
+			RecordDraws(frame, task, index, slot, first, last - first);
+		});
+
+		FrameDrawCalls = ComputeCulling ? 1 : MultiDrawIndirect ? TaskCount : DrawCount;
+		FrameRecordTasks = TaskCount;
+
+		// the fence of this frame in flight has signalled, so nothing allocated from its pools is still pending
+		vkResetCommandPool(device, frame.pool, 0);
+
+		VkCommandBufferBeginInfo CommandBufferBeginInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,	// sType
+			nullptr,										// pNext
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,	// flags
+			nullptr											// pInheritanceInfo
+		};
+
+		VkResult result = vkBeginCommandBuffer(frame.primary, &CommandBufferBeginInfo);
+
+		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to load texture image");
+			throw std::runtime_error("failed to begin recording command buffer");
 		}
 
-		VkDeviceSize size = width * height * 4;
+		VkRect2D area = {
+			{0, 0},			// offset
+			SwapChainExtent	// extent
+		};
 
-		MipLevels = std::floor(std::log2(std::max(width, height))) + 1;
+		VkClearValue ClearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+		VkClearValue ClearDepthStencil = { 1.0f, 0 };
+		std::vector<VkClearValue> ClearValues = { ClearColor, ClearDepthStencil };
 
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, StagingBuffer, StagingBufferMemory);
+		VkRenderPassBeginInfo RenderPassBeginInfo = {
+			VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,	// sType
+			nullptr,									// pNext
+			RenderPass,									// renderPass
+			SwapChainFramebuffers[index],				// framebuffer
+			area,										// renderArea
+			ClearValues.size(),							// clearValueCount
+			ClearValues.data()							// pClearValues
+		};
 
-		void* data;
-		vkMapMemory(device, StagingBufferMemory, 0, size, 0, &data);
-		memcpy(data, pixels, size);
-		vkUnmapMemory(device, StagingBufferMemory);
+		if (ComputeCulling)
+		{
+			RecordCulling(frame.primary, slot);
+		}
 
-		stbi_image_free(pixels);
+		vkCmdBeginRenderPass(frame.primary, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
-		VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
-		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		// VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		CreateImage(width, height, MipLevels, VK_SAMPLE_COUNT_1_BIT, format, tiling, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, TextureImage, TextureImageMemory);
+		if (TaskCount != 0)
+		{
+			vkCmdExecuteCommands(frame.primary, TaskCount, frame.secondaries.data());
+		}
 
-		TransitionImageLayout(TextureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, MipLevels);
-		CopyBufferToImage(StagingBuffer, TextureImage, width, height);
-		// TransitionImageLayout(TextureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, MipLevels);
+		vkCmdEndRenderPass(frame.primary);
 
-		GenerateMipmaps(TextureImage, format, width, height, MipLevels);
+		result = vkEndCommandBuffer(frame.primary);
 
-		vkDestroyBuffer(device, StagingBuffer, nullptr);
-		vkFreeMemory(device, StagingBufferMemory, nullptr);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record command buffer");
+		}
 	}
 
-	void GenerateMipmaps(VkImage image, VkFormat format, int32_t TexWidth, int32_t TexHeight, uint32_t MipLevels)
+	// runs on a worker thread, which is the only one touching the task's pool during the frame, index picks the
+	// framebuffer and slot the frame in flight's buffer slices
+	void RecordDraws(FrameCommands& frame, size_t task, uint32_t index, uint32_t slot, uint32_t first, uint32_t count)
 	{
-		// chack if image format supports linear blitting
-		VkFormatProperties FormatProperties;
-		vkGetPhysicalDeviceFormatProperties(PhysicalDevice, format, &FormatProperties);
+		vkResetCommandPool(device, frame.TaskPools[task], 0);
+
+		VkCommandBuffer CommandBuffer = frame.secondaries[task];
+
+		VkCommandBufferInheritanceInfo InheritanceInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,	// sType
+			nullptr,											// pNext
+			RenderPass,											// renderPass
+			0,													// subpass
+			SwapChainFramebuffers[index],						// framebuffer
+			VK_FALSE,											// occlusionQueryEnable
+			0,													// queryFlags
+			0													// pipelineStatistics
+		};
+
+		VkCommandBufferBeginInfo CommandBufferBeginInfo = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,												// sType
+			nullptr,																					// pNext
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,	// flags
+			&InheritanceInfo																			// pInheritanceInfo
+		};
 
-		if (!(FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		VkResult result = vkBeginCommandBuffer(CommandBuffer, &CommandBufferBeginInfo);
+
+		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("texture image format does not support linear blitting");
+			throw std::runtime_error("failed to begin recording secondary command buffer");
 		}
 
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
+		// secondary command buffers inherit no state from the primary
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
 
-		VkImageSubresourceRange SubresourceRange = {
-			VK_IMAGE_ASPECT_COLOR_BIT,	// aspectMask
-			0,							// baseMipLevel
-			1,							// levelCount
-			0,							// baseArrayLayer
-			1							// layerCount
+		VkViewport viewport = {
+			0.0f,					// x
+			0.0f,					// y
+			SwapChainExtent.width,	// width
+			SwapChainExtent.height,	// height
+			0.0f,					// minDepth
+			1.0f					// maxDepth
 		};
 
-		VkImageMemoryBarrier barrier = {
-			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,	// sType
-			nullptr,								// pNext
-			0,										// srcAccessMask
-			0,										// dstAccessMask
-			VK_IMAGE_LAYOUT_UNDEFINED,				// oldLayout
-			VK_IMAGE_LAYOUT_UNDEFINED,				// newLayout
-			VK_QUEUE_FAMILY_IGNORED,				// srcQueueFamilyIndex
-			VK_QUEUE_FAMILY_IGNORED,				// dstQueueFamilyIndex
-			image,									// image
-			SubresourceRange						// subresourceRange
+		VkRect2D area = {
+			{0, 0},			// offset
+			SwapChainExtent	// extent
+		};
+
+		vkCmdSetViewport(CommandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(CommandBuffer, 0, 1, &area);
+
+		// the instance stream starts at this frame's slice of the ring
+		std::vector<VkBuffer> VertexBuffers = { VertexBuffer, InstanceBuffer };
+		std::vector<VkDeviceSize> offsets = { 0, slot * InstanceBufferStride };
+		vkCmdBindVertexBuffers(CommandBuffer, 0, VertexBuffers.size(), VertexBuffers.data(), offsets.data());
+
+		VkIndexType IndexType = IndexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		vkCmdBindIndexBuffer(CommandBuffer, IndexBuffer, 0, IndexType);
+
+		// the uniform and draw slices of the frame being rendered
+		std::vector<uint32_t> DynamicOffsets = {
+			static_cast<uint32_t>(slot * UniformBufferStride),
+			static_cast<uint32_t>(slot * IndirectBufferStride)
 		};
 
-		int32_t MipWidth = TexWidth;
-		int32_t MipHeight = TexHeight;
+		vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, 0, 1, &DescriptorSets.at(ResidentLevel), DynamicOffsets.size(), DynamicOffsets.data());
+
+		// the draws written for the frame are read from its indirect slice, the vertex shader finds the record of a draw
+		// at DrawBase + gl_DrawID
+		VkDeviceSize DrawOffset = slot * IndirectBufferStride + DrawCountSize;
+		uint32_t DrawBase = ComputeCulling ? 0 : first;
+
+		vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawBase), &DrawBase);
+
+		if (ComputeCulling)
+		{
+			CmdDrawIndexedIndirectCount(CommandBuffer, IndirectBuffer, DrawOffset, IndirectBuffer, slot * IndirectBufferStride, count, sizeof(DrawRecord));
+		}
+		else if (MultiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(CommandBuffer, IndirectBuffer, DrawOffset + first * sizeof(DrawRecord), count, sizeof(DrawRecord));
+		}
+		else
+		{
+			for (uint32_t draw = first; draw < first + count; draw++)
+			{
+				vkCmdPushConstants(CommandBuffer, PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+				vkCmdDrawIndexedIndirect(CommandBuffer, IndirectBuffer, DrawOffset + draw * sizeof(DrawRecord), 1, sizeof(DrawRecord));
+			}
+		}
+
+		result = vkEndCommandBuffer(CommandBuffer);
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record secondary command buffer");
+		}
+	}
+
+	void DrawFrame()
+	{
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+
+		vkWaitForFences(device, 1, &fences.at(CurrentFrame), VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+		auto FenceEnd = std::chrono::high_resolution_clock::now();
+
+		// the fence guarantees the previous submission of this frame slot has completed, so its timestamps can be read without stalling
+		// the flag is cleared at once, a frame that returns before its submission must not read the same pair again
+		if (TimestampSupported && TimestampWritten.at(CurrentFrame))
+		{
+			TimestampWritten.at(CurrentFrame) = false;
+
+			if (ReadTimestamps(2 + 2 * CurrentFrame, 0, GpuFrameTime) && options.bench)
+			{
+				GpuFrameTimes.push_back(GpuFrameTime);
+			}
+		}
+
+		// the same for the draw count the culling pass of that submission wrote
+		if (ComputeCulling && DrawCountWritten.at(CurrentFrame))
+		{
+			DrawCountWritten.at(CurrentFrame) = false;
+			FrameDraws = DrawCountData[CurrentFrame];
+
+			if (options.bench)
+			{
+				BenchDraws += FrameDraws;
+				BenchDrawFrames++;
+			}
+		}
+
+		VkResult result;
+
+		uint32_t index;
+
+		if (options.headless)
+		{
+			// each frame in flight owns one offscreen image
+			index = CurrentFrame;
+		}
+		else
+		{
+			result = vkAcquireNextImageKHR(device, SwapChain, std::numeric_limits<uint64_t>::max(), ImageAvailableSemaphore.at(CurrentFrame), VK_NULL_HANDLE, &index);
+
+			if (result == VK_ERROR_OUT_OF_DATE_KHR)
+			{
+				RecreateSwapchain();
+				return;
+			}
+			else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+			{
+				throw std::runtime_error("failed to acquire swap chain image");
+			}
+		}
+
+		// with more frames in flight than swap chain images, an earlier frame of another slot can still be rendering to
+		// the acquired image
+		VkFence ImageFence = ImagesInFlight.at(index);
 
-		for (uint32_t i = 1; i < MipLevels; i++)
+		if (ImageFence != VK_NULL_HANDLE && ImageFence != fences.at(CurrentFrame))
 		{
-			barrier.subresourceRange.baseMipLevel = i - 1;
-			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-			vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			vkWaitForFences(device, 1, &ImageFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
 
-			VkImageSubresourceLayers SrcSubresource = {
-				VK_IMAGE_ASPECT_COLOR_BIT,	// aspectMask
-				i - 1,						// mipLevel
-				0,							// baseArrayLayer
-				1							// layerCount
-			};
+		ImagesInFlight.at(index) = fences.at(CurrentFrame);
 
-			VkImageSubresourceLayers DstSubresource = {
-				VK_IMAGE_ASPECT_COLOR_BIT,	// aspectMask
-				i,							// mipLevel
-				0,							// baseArrayLayer
-				1							// layerCount
-			};
+		auto AcquireEnd = std::chrono::high_resolution_clock::now();
 
-			VkOffset3D OffsetsSrc = { MipWidth, MipHeight, 1 };
-			VkOffset3D OffsetsDst = { MipWidth > 1 ? MipWidth / 2 : 1, MipHeight > 1 ? MipHeight / 2 : 1, 1 };
+		std::vector<VkSemaphore> WaitSemaphores = { ImageAvailableSemaphore.at(CurrentFrame) };
+		std::vector<VkPipelineStageFlags> stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		std::vector<VkSemaphore> SignalSemaphores = { RenderFinishedSemaphore.at(CurrentFrame) };
 
-			VkImageBlit blit = {
-				SrcSubresource,				// srcSubresource
-				{ {0, 0, 0}, OffsetsSrc },	// srcOffsets
-				DstSubresource,				// dstSubresource
-				{ {0, 0, 0}, OffsetsDst }	// dstOffsets
-			};
+		// there is no acquire to wait on and no present to signal in headless mode
+		uint32_t SemaphoreCount = options.headless ? 0 : 1;
 
-			vkCmdBlitImage(CommandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+		StreamTexture();
 
-			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		auto StreamEnd = std::chrono::high_resolution_clock::now();
 
-			vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		UpdateUniformBuffer(static_cast<uint32_t>(CurrentFrame));
 
-			MipWidth = MipWidth > 1 ? MipWidth / 2 : 1;
-			MipHeight = MipHeight > 1 ? MipHeight / 2 : 1;
-		}
+		auto UpdateEnd = std::chrono::high_resolution_clock::now();
 
-		barrier.subresourceRange.baseMipLevel = MipLevels - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		RecordFrame(index);
 
-		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		auto RecordEnd = std::chrono::high_resolution_clock::now();
 
-		EndSingleTimeCommands(CommandBuffer);
-	}
+		VkCommandBuffer primary = FrameCommandBuffers.at(CurrentFrame).primary;
+		std::vector<VkCommandBuffer> SubmitCommandBuffers = { primary };
 
-	void CreateImage(uint32_t width, uint32_t height, uint32_t MipLevels, VkSampleCountFlagBits SampleCount, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& memory)
-	{
-		VkResult result;
+		if (TimestampSupported)
+		{
+			SubmitCommandBuffers = { TimestampCommandBuffers.at(2 * CurrentFrame), primary, TimestampCommandBuffers.at(2 * CurrentFrame + 1) };
+			TimestampWritten.at(CurrentFrame) = true;
+		}
 
-		VkExtent3D extent = {
-			width,	// width
-			height,	// height
-			1		// depth
+		VkSubmitInfo SubmitInfo = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,	// sType
+			nullptr,						// pNext
+			SemaphoreCount,					// waitSemaphoreCount
+			WaitSemaphores.data(),			// pWaitSemaphores
+			stages.data(),					// pWaitDstStageMask
+			SubmitCommandBuffers.size(),	// commandBufferCount
+			SubmitCommandBuffers.data(),	// pCommandBuffers
+			SemaphoreCount,					// signalSemaphoreCount
+			SignalSemaphores.data()			// pSignalSemaphores
 		};
 
-		// QueueFamilyIndex index = FindQueueFamilyIndex(PhysicalDevice);
-		// std::vector<uint32_t> indices = { index.graphic.value() };
-
-		VkImageCreateInfo ImageCreateInfo = {
-			VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,	// sType
-			nullptr,								// pNext
-			0,										// flags
-			VK_IMAGE_TYPE_2D,						// imageType
-			format,									// format
-			extent,									// extent
-			MipLevels,								// mipLevels
-			1,										// arrayLayers
-			SampleCount,							// samples
-			tiling,									// tiling
-			usage,									// usage
-			VK_SHARING_MODE_EXCLUSIVE,				// sharingMode
-			0,										// queueFamilyIndexCount
-			nullptr,								// pQueueFamilyIndices
-			VK_IMAGE_LAYOUT_UNDEFINED				// initialLayout
-		};
+		vkResetFences(device, 1, &fences.at(CurrentFrame));
 
-		result = vkCreateImage(device, &ImageCreateInfo, nullptr, &image);
+		result = vkQueueSubmit(GraphicQueue, 1, &SubmitInfo, fences.at(CurrentFrame));
 
 		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create image");
+			throw std::runtime_error("failed to submit draw command buffer");
 		}
 
-		VkMemoryRequirements MemoryRequirements;
-		vkGetImageMemoryRequirements(device, image, &MemoryRequirements);
+		auto SubmitEnd = std::chrono::high_resolution_clock::now();
 
-		uint32_t index = FindMemoryType(MemoryRequirements.memoryTypeBits, properties);
+		if (!options.headless)
+		{
+			std::vector<VkSwapchainKHR> swapchains = { SwapChain };
+
+			VkPresentInfoKHR PresentInfo = {
+				VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,	// sType
+				nullptr,							// pNext
+				1,									// waitSemaphoreCount
+				SignalSemaphores.data(),			// pWaitSemaphores
+				1,									// swapchainCount
+				swapchains.data(),					// pSwapchains
+				&index,								// pImageIndices
+				nullptr								// pResults
+			};
 
-		VkMemoryAllocateInfo MemoryAllocateInfo = {
-			VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,	// sType
-			nullptr,								// pNext
-			MemoryRequirements.size,				// allocationSize
-			index									// memoryTypeIndex
-		};
+			result = vkQueuePresentKHR(PresentQueue, &PresentInfo);
+
+			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || FramebufferResized)
+			{
+				FramebufferResized = false;
+				RecreateSwapchain();
+			}
+			else if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to present swap chain image");
+			}
+		}
 
-		result = vkAllocateMemory(device, &MemoryAllocateInfo, nullptr, &memory);
+		auto PresentEnd = std::chrono::high_resolution_clock::now();
 
-		if (result != VK_SUCCESS)
+		if (options.bench)
 		{
-			throw std::runtime_error("failed to allocate image memory");
+			FrameTiming timing = {
+				Milliseconds(FrameStart, PresentEnd),	// total
+				Milliseconds(FrameStart, FenceEnd),		// fence
+				Milliseconds(FenceEnd, AcquireEnd),		// acquire
+				Milliseconds(AcquireEnd, StreamEnd),	// stream
+				Milliseconds(StreamEnd, UpdateEnd),		// update
+				Milliseconds(UpdateEnd, RecordEnd),		// record
+				Milliseconds(RecordEnd, SubmitEnd),		// submit
+				Milliseconds(SubmitEnd, PresentEnd)		// present
+			};
+
+			FrameTimings.push_back(timing);
+
+			if (!ComputeCulling)
+			{
+				BenchDraws += FrameDraws;
+				BenchDrawFrames++;
+			}
 		}
 
-		vkBindImageMemory(device, image, memory, 0);
+		CurrentFrame = (CurrentFrame + 1) % FramesInFlight;
 	}
 
-	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t MipLevels)
+	static double Milliseconds(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
 	{
-		VkImageView view;
-
-		VkComponentMapping components = {
-			VK_COMPONENT_SWIZZLE_IDENTITY,	//	r
-			VK_COMPONENT_SWIZZLE_IDENTITY,	//	g
-			VK_COMPONENT_SWIZZLE_IDENTITY,	//	b
-			VK_COMPONENT_SWIZZLE_IDENTITY	//	a
-		};
-
-		VkImageSubresourceRange range = {
-			aspect,		//	aspectMask
-			0,			//	baseMipLevel
-			MipLevels,	//	levelCount
-			0,			//	baseArrayLayer
-			1			//	layerCount
-		};
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
 
-		VkImageViewCreateInfo ImageViewCreateInfo = {
-			VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,	// sType
-			nullptr,									// pNext
-			0,											// flags
-			image,										// image
-			VK_IMAGE_VIEW_TYPE_2D,						// viewType
-			format,										// format
-			components,									// components
-			range										// subresourceRange
-		};
+	static void WriteStatistics(std::ostream& stream, const std::string& name, std::vector<double> values, bool last)
+	{
+		std::sort(values.begin(), values.end());
 
-		VkResult result = vkCreateImageView(device, &ImageViewCreateInfo, nullptr, &view);
+		double sum = 0.0;
 
-		if (result != VK_SUCCESS)
+		for (double value : values)
 		{
-			throw std::runtime_error("failed to create image view");
+			sum += value;
 		}
 
-		return view;
+		// nearest-rank percentiles
+		auto percentile = [&values](double p)
+		{
+			size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+			return values.at(std::max<size_t>(rank, 1) - 1);
+		};
+
+		stream << "\t\t\"" << name << "\": { ";
+		stream << "\"mean\": " << sum / values.size() << ", ";
+		stream << "\"p50\": " << percentile(0.50) << ", ";
+		stream << "\"p99\": " << percentile(0.99) << ", ";
+		stream << "\"max\": " << values.back() << " }";
+		stream << (last ? "\n" : ",\n");
 	}
 
-	void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout OldLayout, VkImageLayout NewLayout, uint32_t MipLevels)
+	void WriteBenchReport()
 	{
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
-
-		VkImageAspectFlags aspect;
-
-		if (NewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		if (FrameTimings.empty())
 		{
-			aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-			if (HasStencilComponent(format))
-			{
-				aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
-			}
+			throw std::runtime_error("no frame was timed during the benchmark");
 		}
-		else
+
+		std::vector<double> total, fence, acquire, stream, update, record, submit, present;
+
+		for (const FrameTiming& timing : FrameTimings)
 		{
-			aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			total.push_back(timing.total);
+			fence.push_back(timing.fence);
+			acquire.push_back(timing.acquire);
+			stream.push_back(timing.stream);
+			update.push_back(timing.update);
+			record.push_back(timing.record);
+			submit.push_back(timing.submit);
+			present.push_back(timing.present);
 		}
 
-		VkImageSubresourceRange range = {
-			aspect,		// aspectMask
-			0,			// baseMipLevel
-			MipLevels,	// levelCount
-			0,			// baseArrayLayer
-			1			// layerCount
-		};
+		VkPhysicalDeviceProperties PhysicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(PhysicalDevice, &PhysicalDeviceProperties);
 
-		VkAccessFlags SrcAccessMask;
-		VkAccessFlags DstAccessMask;
-		VkPipelineStageFlags SrcStage;
-		VkPipelineStageFlags DstStage;
+		std::ofstream file(options.report);
 
-		if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		if (!file.is_open())
 		{
-			SrcAccessMask = 0;
-			DstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			DstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			throw std::runtime_error("failed to open benchmark report " + options.report);
 		}
-		else if (OldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && NewLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+
+		file << std::fixed << std::setprecision(4);
+		file << "{\n";
+		file << "\t\"device\": \"" << PhysicalDeviceProperties.deviceName << "\",\n";
+		file << "\t\"mode\": \"" << (options.headless ? "headless" : "window") << "\",\n";
+		file << "\t\"width\": " << SwapChainExtent.width << ",\n";
+		file << "\t\"height\": " << SwapChainExtent.height << ",\n";
+		file << "\t\"samples\": " << SampleCount << ",\n";
+		file << "\t\"frames_in_flight\": " << FramesInFlight << ",\n";
+		file << "\t\"swapchain_images\": " << SwapChainImages.size() << ",\n";
+		file << "\t\"vertex_bytes\": " << sizeof(VertexLayout) << ",\n";
+		file << "\t\"lod_levels\": " << levels.size() << ",\n";
+		file << "\t\"lod_level\": " << CurrentLevel << ",\n";
+		file << "\t\"chunks\": " << GetChunkCount() << ",\n";
+		file << "\t\"culling\": \"" << (ComputeCulling ? "compute" : options.culling ? "cpu" : "off") << "\",\n";
+		file << "\t\"instances\": " << options.instances << ",\n";
+		file << "\t\"texture_format\": \"" << TextureFormatName << "\",\n";
+		file << "\t\"texture_bytes\": " << TextureBytes << ",\n";
+		file << "\t\"texture_staging_bytes\": " << TextureStagingBytes << ",\n";
+		file << "\t\"texture_resident_level\": " << ResidentLevel << ",\n";
+		file << "\t\"texture_stream_milliseconds\": " << TextureStreamTime << ",\n";
+		file << "\t\"material_count\": " << materials.size() << ",\n";
+		file << "\t\"bindless_textures\": " << (BindlessTextures ? "true" : "false") << ",\n";
+		file << "\t\"material_texture_count\": " << MaterialImages.size() << ",\n";
+		file << "\t\"material_texture_bytes\": " << MaterialTextureBytes << ",\n";
+
+		// indirect calls recorded for the last frame and the tasks that recorded them, and the most draws a frame can carry
+		file << "\t\"draw_calls\": " << FrameDrawCalls << ",\n";
+		file << "\t\"record_tasks\": " << FrameRecordTasks << ",\n";
+		file << "\t\"max_draws\": " << GetMaxDrawCount() << ",\n";
+
+		// the compute path only reads back the draw count, the visible instances and chunks stay on the GPU
+		if (!ComputeCulling)
 		{
-			SrcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			DstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			SrcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			DstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			file << "\t\"visible_instances\": " << VisibleInstances.size() << ",\n";
+			file << "\t\"visible_chunks\": " << VisibleChunks.size() << ",\n";
 		}
-		else if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+
+		file << "\t\"draws_per_frame\": " << (BenchDrawFrames != 0 ? static_cast<double>(BenchDraws) / BenchDrawFrames : 0.0) << ",\n";
+		file << "\t\"frames\": " << FrameTimings.size() << ",\n";
+		file << "\t\"milliseconds\": {\n";
+		WriteStatistics(file, "frame", total, false);
+		WriteStatistics(file, "fence", fence, false);
+		WriteStatistics(file, "acquire", acquire, false);
+		WriteStatistics(file, "stream", stream, false);
+		WriteStatistics(file, "update", update, false);
+		WriteStatistics(file, "record", record, false);
+		WriteStatistics(file, "submit", submit, false);
+		WriteStatistics(file, "present", present, GpuFrameTimes.empty());
+
+		if (!GpuFrameTimes.empty())
 		{
-			SrcAccessMask = 0;
-			DstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
-			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			DstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			WriteStatistics(file, "gpu", GpuFrameTimes, true);
 		}
-		else if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+
+		file << "\t},\n";
+
+		// null when the uploads were not timed
+		if (UploadTimestamps)
 		{
-			SrcAccessMask = 0;
-			DstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			SrcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			DstStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			file << "\t\"upload_gpu_milliseconds\": " << UploadGpuTime << ",\n";
 		}
 		else
 		{
-			throw std::runtime_error("unsupported layout transition");
+			file << "\t\"upload_gpu_milliseconds\": null,\n";
 		}
 
-		VkImageMemoryBarrier ImageMemoryBarrier = {
-			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,	// sType
-			nullptr,								// pNext
-			SrcAccessMask,							// srcAccessMask
-			DstAccessMask,							// dstAccessMask
-			OldLayout,								// oldLayout
-			NewLayout,								// newLayout
-			VK_QUEUE_FAMILY_IGNORED,				// srcQueueFamilyIndex
-			VK_QUEUE_FAMILY_IGNORED,				// dstQueueFamilyIndex
-			image,									// image
-			range									// subresourceRange
-		};
+		file << "\t\"pipeline_cache\": \"" << (PipelineCacheLoaded ? "warm" : "cold") << "\",\n";
+		file << "\t\"pipeline_milliseconds\": " << PipelineCreationTime << ",\n";
 
-		vkCmdPipelineBarrier(CommandBuffer, SrcStage, DstStage, 0, 0, nullptr, 0, nullptr, 1, &ImageMemoryBarrier);
+		MemoryStatistics memory = allocator.GetStatistics();
 
-		EndSingleTimeCommands(CommandBuffer);
+		file << "\t\"memory\": {\n";
+		file << "\t\t\"blocks\": " << memory.blocks << ",\n";
+		file << "\t\t\"allocations\": " << memory.allocations << ",\n";
+		file << "\t\t\"reserved_bytes\": " << memory.reserved << ",\n";
+		file << "\t\t\"used_bytes\": " << memory.used << ",\n";
+		file << "\t\t\"free_ranges\": " << memory.FreeRanges << ",\n";
+		file << "\t\t\"fragmentation\": " << memory.fragmentation() << "\n";
+		file << "\t}\n";
+		file << "}\n";
+
+		std::cout << "benchmark report written to " << options.report << " (" << FrameTimings.size() << " frames)" << std::endl;
 	}
 
-	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+	void CreateSemaphoresAndFences()
 	{
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
+		ImageAvailableSemaphore.resize(FramesInFlight);
+		RenderFinishedSemaphore.resize(FramesInFlight);
+		fences.resize(FramesInFlight);
 
-		VkBufferImageCopy region = {
-			0,										// bufferOffset
-			0,										// bufferRowLength
-			0,										// bufferImageHeight
-			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },	// imageSubresource
-			{ 0, 0, 0 },							// imageOffset
-			{ width, height, 1 }					// imageExtent
+		VkSemaphoreCreateInfo SemaphoreCreateInfo = {
+			VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,	// sType
+			nullptr,									// pNext
+			0											// flags
 		};
 
-		vkCmdCopyBufferToImage(CommandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		VkFenceCreateInfo FenceCreateInfo = {
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,	// sType
+			nullptr,								// pNext
+			VK_FENCE_CREATE_SIGNALED_BIT			// flags
+		};
 
-		EndSingleTimeCommands(CommandBuffer);
-	}
+		for (size_t i = 0; i < FramesInFlight; i++)
+		{
+			VkResult ImageAvailableResult = vkCreateSemaphore(device, &SemaphoreCreateInfo, nullptr, &ImageAvailableSemaphore.at(i));
+			VkResult RenderFinishedResult = vkCreateSemaphore(device, &SemaphoreCreateInfo, nullptr, &RenderFinishedSemaphore.at(i));
+			VkResult FenceResult = vkCreateFence(device, &FenceCreateInfo, nullptr, &fences.at(i));
 
-	void CreateTextureImageView()
-	{
-		TextureImageView = CreateImageView(TextureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, MipLevels);
+			if (ImageAvailableResult || RenderFinishedResult || FenceResult)
+			{
+				throw std::runtime_error("failed to create synchronization objects for a frame");
+			}
+		}
 	}
 
-	void CreateTextureSampler()
+	void MainLoop()
 	{
-		VkSamplerCreateInfo SamplerCreateInfo = {
-			VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,	// sType
-			nullptr,								// pNext
-			0,										// flags
-			VK_FILTER_LINEAR,						// magFilter
-			VK_FILTER_LINEAR,						// minFilter
-			VK_SAMPLER_MIPMAP_MODE_LINEAR,			// mipmapMode
-			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeU
-			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeV
-			VK_SAMPLER_ADDRESS_MODE_REPEAT,			// addressModeW
-			0.0f,									// mipLodBias
-			VK_TRUE,								// anisotropyEnable
-			16,										// maxAnisotropy
-			VK_FALSE,								// compareEnable
-			VK_COMPARE_OP_ALWAYS,					// compareOp
-			0.0f,									// minLod
-			MipLevels,								// maxLod
-			VK_BORDER_COLOR_INT_OPAQUE_BLACK,		// borderColor
-			VK_FALSE								// unnormalizedCoordinates
-		};
-
-		VkResult result = vkCreateSampler(device, &SamplerCreateInfo, nullptr, &TextureSampler);
-
-		if (result != VK_SUCCESS)
+		if (options.headless)
 		{
-			throw std::runtime_error("failed to create texture sampler");
+			for (uint32_t i = 0; i < options.frames; i++)
+			{
+				DrawFrame();
+			}
+		}
+		else
+		{
+			uint32_t frame = 0;
+
+			while (!glfwWindowShouldClose(window) && (options.frames == 0 || frame < options.frames))
+			{
+				glfwPollEvents();
+				DrawFrame();
+				frame++;
+			}
 		}
+
+		vkDeviceWaitIdle(device);
 	}
 
-	void LoadModel()
+	void cleanup()
 	{
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warning;
-		std::string error;
+		StopTextureStreaming();
+		WaitUpload(SubmitUploads());
 
-		bool result = tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, ModelPath.c_str());
+		CleanupSwapchain();
+		CleanupFrameResources();
+		CleanupPipeline();
+
+		vkDestroySampler(device, TextureSampler, nullptr);
 
-		if (!result)
+		for (VkImageView view : TextureImageViews)
 		{
-			throw std::runtime_error(warning + error);
+			vkDestroyImageView(device, view, nullptr);
 		}
 
-		std::unordered_map<Vertex, uint32_t> VertexMap = {};
+		vkDestroyImage(device, TextureImage, nullptr);
+		allocator.Free(TextureImageMemory);
 
-		for (const auto& shape : shapes)
+		for (size_t i = 0; i < MaterialImages.size(); i++)
 		{
-			for (const auto& index : shape.mesh.indices)
-			{
-				Vertex vertex = {};
+			vkDestroyImageView(device, MaterialImageViews[i], nullptr);
+			vkDestroyImage(device, MaterialImages[i], nullptr);
+			allocator.Free(MaterialImageMemories[i]);
+		}
 
-				vertex.position = {
-					attrib.vertices[3 * index.vertex_index + 0],
-					attrib.vertices[3 * index.vertex_index + 1],
-					attrib.vertices[3 * index.vertex_index + 2]
-				};
+		vkDestroyBuffer(device, MaterialBuffer, nullptr);
+		allocator.Free(MaterialBufferMemory);
 
-				vertex.TexCoord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-				};
+		vkDestroyDescriptorSetLayout(device, DescriptorSetLayout, nullptr);
 
-				vertex.color = { 1.0f, 1.0f, 1.0f };
+		if (ComputeCulling)
+		{
+			vkDestroyPipeline(device, CullPipeline, nullptr);
+			vkDestroyPipelineLayout(device, CullPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, CullDescriptorSetLayout, nullptr);
 
-				if (VertexMap.count(vertex) == 0)
-				{
-					VertexMap[vertex] = vertices.size();
-					vertices.push_back(vertex);
-				}
+			vkDestroyBuffer(device, ChunkBuffer, nullptr);
+			allocator.Free(ChunkBufferMemory);
+		}
 
-				indices.push_back(VertexMap[vertex]);
-			}
+		vkDestroyBuffer(device, IndexBuffer, nullptr);
+		allocator.Free(IndexBufferMemory);
+
+		vkDestroyBuffer(device, VertexBuffer, nullptr);
+		allocator.Free(VertexBufferMemory);
+
+		for (size_t i = 0; i < FramesInFlight; i++)
+		{
+			vkDestroyFence(device, fences.at(i), nullptr);
+			vkDestroySemaphore(device, RenderFinishedSemaphore.at(i), nullptr);
+			vkDestroySemaphore(device, ImageAvailableSemaphore.at(i), nullptr);
 		}
-	}
-
-	void CreateVertexBuffer()
-	{
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-		VkDeviceSize size = sizeof(Vertex) * vertices.size();
-		VkBufferUsageFlags usage;
-		VkMemoryPropertyFlags properties;
 
-		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+		if (TimestampSupported)
+		{
+			vkDestroyQueryPool(device, TimestampQueryPool, nullptr);
+		}
 
-		void* data;
-		vkMapMemory(device, StagingBufferMemory, 0, size, 0, &data);
-		memcpy(data, vertices.data(), size);
-		vkUnmapMemory(device, StagingBufferMemory);
+		SavePipelineCache();
+		vkDestroyPipelineCache(device, PipelineCache, nullptr);
 
-		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		CreateBuffer(size, usage, properties, VertexBuffer, VertexBufferMemory);
+		if (DedicatedTransfer)
+		{
+			vkDestroyCommandPool(device, TransferCommandPool, nullptr);
+		}
 
-		CopyBuffer(StagingBuffer, VertexBuffer, size);
+		// command buffers are automatically freed when their command pool is destroyed
+		for (FrameCommands& frame : FrameCommandBuffers)
+		{
+			vkDestroyCommandPool(device, frame.pool, nullptr);
 
-		vkDestroyBuffer(device, StagingBuffer, nullptr);
-		vkFreeMemory(device, StagingBufferMemory, nullptr);
-	}
+			for (VkCommandPool pool : frame.TaskPools)
+			{
+				vkDestroyCommandPool(device, pool, nullptr);
+			}
+		}
 
-	void CreateIndexBuffer()
-	{
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-		// VkDeviceSize size = sizeof(uint16_t) * indices.size();
-		VkDeviceSize size = sizeof(indices.at(0)) * indices.size();
-		VkBufferUsageFlags usage;
-		VkMemoryPropertyFlags properties;
+		vkDestroyCommandPool(device, CommandPool, nullptr);
 
-		usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		CreateBuffer(size, usage, properties, StagingBuffer, StagingBufferMemory);
+		allocator.Destroy();
 
-		void* data;
-		vkMapMemory(device, StagingBufferMemory, 0, size, 0, &data);
-		memcpy(data, indices.data(), size);
-		vkUnmapMemory(device, StagingBufferMemory);
+		// device VkQueue are implicitly cleaned up when the VkDevice is destroyed
 
-		usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		CreateBuffer(size, usage, properties, IndexBuffer, IndexBufferMemory);
+		vkDestroyDevice(device, nullptr);
 
-		CopyBuffer(StagingBuffer, IndexBuffer, size);
+		// VkPhysicalDevice are implicitly destroyed when VkInstance is destroyed
 
-		vkDestroyBuffer(device, StagingBuffer, nullptr);
-		vkFreeMemory(device, StagingBufferMemory, nullptr);
-	}
+		if (EnableValidationLayer)
+		{
+			vkDestroyDebugUtilsMessengerEXT(instance, messenger, nullptr);
+		}
 
-	void CreateUniformBuffers()
-	{
-		size_t images = SwapChainImages.size();
-		UniformBuffers.resize(images);
-		UniformBuffersMemory.resize(images);
+		if (!options.headless)
+		{
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
 
-		VkDeviceSize size = sizeof(UniformBufferObject);
-		VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		vkDestroyInstance(instance, nullptr);
 
-		for (size_t i = 0; i < images; i++)
+		if (!options.headless)
 		{
-			CreateBuffer(size, usage, properties, UniformBuffers[i], UniformBuffersMemory[i]);
+			glfwDestroyWindow(window);
+			glfwTerminate();
 		}
 	}
 
-	void UpdateUniformBuffer(uint32_t index)
+	void CleanupPipeline()
 	{
-		static auto StartTime = std::chrono::high_resolution_clock::now();
+		vkDestroyPipeline(device, GraphicsPipeline, nullptr);
+		vkDestroyPipelineLayout(device, PipelineLayout, nullptr);
+		vkDestroyRenderPass(device, RenderPass, nullptr);
+	}
 
-		auto CurrentTime = std::chrono::high_resolution_clock::now();
-		float DeltaTime = std::chrono::duration<float, std::chrono::seconds::period>(CurrentTime - StartTime).count();
+	void CleanupFrameResources()
+	{
+		vkDestroyBuffer(device, UniformBuffer, nullptr);
+		allocator.Free(UniformBufferMemory);
 
-		UniformBufferObject ubo = {};
+		vkDestroyBuffer(device, IndirectBuffer, nullptr);
+		allocator.Free(IndirectBufferMemory);
 
-		ubo.model = glm::rotate(glm::mat4(1.0f), DeltaTime * glm::radians(90.0f * 0.25f), glm::vec3(0.0f, 0.0f, 1.0f));
+		if (DrawCountBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(device, DrawCountBuffer, nullptr);
+			allocator.Free(DrawCountBufferMemory);
+			DrawCountBuffer = VK_NULL_HANDLE;
+		}
 
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		vkDestroyBuffer(device, InstanceBuffer, nullptr);
+		allocator.Free(InstanceBufferMemory);
 
-		float AspectRatio = SwapChainExtent.width / static_cast<float>(SwapChainExtent.height);
-		ubo.proj = glm::perspective(glm::radians(45.0f), AspectRatio, 0.1f, 10.0f);
-		ubo.proj[1][1] *= -1;
+		// descriptor sets are automatically freed when the descriptor pool is destroyed
 
-		VkDeviceSize size = sizeof(ubo);
-		void* data;
-		vkMapMemory(device, UniformBuffersMemory[index], 0, size, 0, &data);
-		memcpy(data, &ubo, size);
-		vkUnmapMemory(device, UniformBuffersMemory[index]);
+		vkDestroyDescriptorPool(device, DescriptorPool, nullptr);
 	}
 
-	void CreateDescriptorPool()
+	void CleanupSwapchain()
 	{
-		VkDescriptorPoolSize UniformPoolSize = {
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	// type
-			SwapChainImages.size()				// descriptorCount
-		};
-
-		VkDescriptorPoolSize SamplerPoolSize = {
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// type
-			SwapChainImages.size()						// descriptorCount
-		};
-
-		std::vector<VkDescriptorPoolSize> PoolSizes = { UniformPoolSize, SamplerPoolSize };
+		vkDestroyImageView(device, ColorImageView, nullptr);
+		vkDestroyImage(device, ColorImage, nullptr);
+		allocator.Free(ColorImageMemory);
 
-		VkDescriptorPoolCreateInfo DescriptorPoolCreateInfo = {
-			VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,	// sType
-			nullptr,										// pNext
-			0,												// flags
-			SwapChainImages.size(),							// maxSets
-			PoolSizes.size(),								// poolSizeCount
-			PoolSizes.data()								// pPoolSizes
-		};
+		vkDestroyImageView(device, DepthImageView, nullptr);
+		vkDestroyImage(device, DepthImage, nullptr);
+		allocator.Free(DepthImageMemory);
 
-		VkResult result = vkCreateDescriptorPool(device, &DescriptorPoolCreateInfo, nullptr, &DescriptorPool);
+		for (VkFramebuffer framebuffer : SwapChainFramebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
 
-		if (result != VK_SUCCESS)
+		for (VkImageView view : SwapChainImageViews)
 		{
-			throw std::runtime_error("failed to create descriptor pool");
+			vkDestroyImageView(device, view, nullptr);
 		}
-	}
 
-	void CreateDescriptorSetLayout()
-	{
-		VkDescriptorSetLayoutBinding UniformLayoutBinding = {
-			0,									// binding
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	// descriptorType
-			1,									// descriptorCount
-			VK_SHADER_STAGE_VERTEX_BIT,			// stageFlags
-			nullptr								// pImmutableSamplers
-		};
+		if (options.headless)
+		{
+			for (size_t i = 0; i < SwapChainImages.size(); i++)
+			{
+				vkDestroyImage(device, SwapChainImages[i], nullptr);
+				allocator.Free(OffscreenImagesMemory[i]);
+			}
+		}
+		else
+		{
+			// swap chain images are automatically cleaned up once the swap chain is destroyed
 
+			vkDestroySwapchainKHR(device, SwapChain, nullptr);
+		}
+	}
+};
 
-		VkDescriptorSetLayoutBinding SamplerLayoutBinding = {
-			1,											// binding
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// descriptorType
-			1,											// descriptorCount
-			VK_SHADER_STAGE_FRAGMENT_BIT,				// stageFlags
-			nullptr										// pImmutableSamplers
-		};
+ApplicationOptions ParseOptions(int argc, char* argv[])
+{
+	ApplicationOptions options;
 
-		std::vector<VkDescriptorSetLayoutBinding> bindings = { UniformLayoutBinding, SamplerLayoutBinding };
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
 
-		VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCreateInfo = {
-			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,	// sType
-			nullptr,												// pNext
-			0,														// flags
-			bindings.size(),										// bindingCount
-			bindings.data()											// pBindings
-		};
+		if (argument == "--headless")
+		{
+			options.headless = true;
+		}
+		else if (argument == "--frames" && i + 1 < argc)
+		{
+			options.frames = std::stoul(argv[++i]);
+		}
+		else if (argument == "--bench" && i + 1 < argc)
+		{
+			options.bench = true;
+			options.frames = std::stoul(argv[++i]);
+		}
+		else if (argument == "--report" && i + 1 < argc)
+		{
+			options.report = argv[++i];
+		}
+		else if (argument == "--no-overdraw")
+		{
+			options.overdraw = false;
+		}
+		else if (argument == "--float-vertices")
+		{
+			options.quantize = false;
+		}
+		else if (argument == "--no-index-split")
+		{
+			options.split = false;
+		}
+		else if (argument == "--no-culling")
+		{
+			options.culling = false;
+		}
+		else if (argument == "--cpu-culling")
+		{
+			options.CpuCulling = true;
+		}
+		else if (argument == "--instances" && i + 1 < argc)
+		{
+			options.instances = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		}
+		else if (argument == "--record-tasks" && i + 1 < argc)
+		{
+			options.RecordTasks = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (argument == "--frames-in-flight" && i + 1 < argc)
+		{
+			options.FramesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (argument == "--texture-format" && i + 1 < argc)
+		{
+			options.TextureFormat = argv[++i];
+		}
+		else if (argument == "--mip-filter" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			auto found = std::find(std::begin(MipFilterNames), std::end(MipFilterNames), name);
 
-		VkResult result = vkCreateDescriptorSetLayout(device, &DescriptorSetLayoutCreateInfo, nullptr, &DescriptorSetLayout);
+			if (found == std::end(MipFilterNames))
+			{
+				throw std::runtime_error("--mip-filter needs one of box, kaiser or lanczos");
+			}
 
-		if (result != VK_SUCCESS)
+			options.MipFiltering = static_cast<MipFilter>(found - std::begin(MipFilterNames));
+		}
+		else if (argument == "--no-srgb-mips")
 		{
-			throw std::runtime_error("failed to create descriptor set layout");
+			options.SrgbMips = false;
+		}
+		else if (argument == "--no-texture-streaming")
+		{
+			options.TextureStreaming = false;
+		}
+		else if (argument == "--no-bindless")
+		{
+			options.bindless = false;
+		}
+		else if (argument == "--lod-levels" && i + 1 < argc)
+		{
+			options.LodLevels = std::min(std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u), MaxLodLevels);
+		}
+		else if (argument == "--lod-ratio" && i + 1 < argc)
+		{
+			options.LodRatio = std::stof(argv[++i]);
+		}
+		else if (argument == "--lod-error" && i + 1 < argc)
+		{
+			options.LodError = std::stof(argv[++i]);
+		}
+		else if (argument == "--lod-threshold" && i + 1 < argc)
+		{
+			options.LodThreshold = std::stof(argv[++i]);
+		}
+		else if (argument == "--bench-obj")
+		{
+			// the grid size is optional
+			options.BenchObj = i + 1 < argc && argv[i + 1][0] != '-' ? std::stoul(argv[++i]) : 1000;
+		}
+		else if (argument == "--bench-dedup")
+		{
+			options.BenchDedup = i + 1 < argc && argv[i + 1][0] != '-' ? std::stoul(argv[++i]) : 1000;
+		}
+		else if (argument == "--bench-mips")
+		{
+			options.BenchMips = i + 1 < argc && argv[i + 1][0] != '-' ? std::stoul(argv[++i]) : 2048;
+		}
+		else if (argument == "--bench-decode")
+		{
+			options.BenchDecode = i + 1 < argc && argv[i + 1][0] != '-' ? std::stoul(argv[++i]) : 8;
+		}
+		else
+		{
+			throw std::runtime_error("unknown option " + argument + "\nusage: [--headless] [--frames N] [--bench N] [--report FILE] [--no-overdraw] [--float-vertices] [--no-index-split] [--lod-levels N] [--lod-ratio R] [--lod-error E] [--lod-threshold PIXELS] [--no-culling] [--cpu-culling] [--instances N] [--record-tasks N] [--frames-in-flight N] [--texture-format NAME] [--mip-filter box|kaiser|lanczos] [--no-srgb-mips] [--no-texture-streaming] [--no-bindless] [--bench-obj [N]] [--bench-dedup [N]] [--bench-mips [N]] [--bench-decode [N]]");
 		}
 	}
 
-	void CreateDescriptorSets()
+	if (options.bench && options.frames == 0)
 	{
-		size_t size = SwapChainImages.size();
-		std::vector<VkDescriptorSetLayout> layouts(size, DescriptorSetLayout);
-
-		VkDescriptorSetAllocateInfo DescriptorSetAllocateInfo = {
-			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,	// sType
-			nullptr,										// pNext
-			DescriptorPool,									// descriptorPool
-			size,											// descriptorSetCount
-			layouts.data()									// pSetLayouts
-		};
+		throw std::runtime_error("--bench needs a frame count greater than zero");
+	}
 
-		DescriptorSets.resize(size);
+	if (options.FramesInFlight < 1 || options.FramesInFlight > 4)
+	{
+		throw std::runtime_error("--frames-in-flight needs a value from 1 to 4");
+	}
 
-		VkResult result = vkAllocateDescriptorSets(device, &DescriptorSetAllocateInfo, DescriptorSets.data());
+	if (options.LodRatio <= 0.0f || options.LodRatio >= 1.0f)
+	{
+		throw std::runtime_error("--lod-ratio must be between 0 and 1");
+	}
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate descriptor sets");
-		}
+	// a headless run has no window to close so it needs a frame budget
+	if (options.headless && options.frames == 0)
+	{
+		options.frames = 1000;
+	}
 
-		for (size_t i = 0; i < size; i++)
-		{
-			VkDescriptorBufferInfo DescriptorBufferInfo = {
-				UniformBuffers[i],	// buffer
-				0,					// offset
-				VK_WHOLE_SIZE		// range
-			};
+	return options;
+}
 
-			VkDescriptorImageInfo DescriptorImageInfo = {
-				TextureSampler,								// sampler
-				TextureImageView,							// imageView
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL	// imageLayout
-			};
+// writes a grid of size x size vertices as triangles, with positions and texture coordinates
+void WriteSyntheticObj(const std::string& path, uint32_t size)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
 
-			VkWriteDescriptorSet UniformWriteDescriptor = {
-				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,	// sType
-				nullptr,								// pNext
-				DescriptorSets[i],						// dstSet
-				0,										// dstBinding
-				0,										// dstArrayElement
-				1,										// descriptorCount
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,		// descriptorType
-				nullptr,								// pImageInfo
-				&DescriptorBufferInfo,					// pBufferInfo
-				nullptr									// pTexelBufferView
-			};
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to write " + path);
+	}
 
-			VkWriteDescriptorSet SamplerWriteDescriptor = {
-				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,		// sType
-				nullptr,									// pNext
-				DescriptorSets[i],							// dstSet
-				1,											// dstBinding
-				0,											// dstArrayElement
-				1,											// descriptorCount
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	// descriptorType
-				&DescriptorImageInfo,						// pImageInfo
-				nullptr,									// pBufferInfo
-				nullptr										// pTexelBufferView
-			};
+	char line[128];
 
-			std::vector<VkWriteDescriptorSet> DescriptorWrites = { UniformWriteDescriptor, SamplerWriteDescriptor };
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			float u = x / static_cast<float>(size - 1);
+			float v = y / static_cast<float>(size - 1);
 
-			vkUpdateDescriptorSets(device, DescriptorWrites.size(), DescriptorWrites.data(), 0, nullptr);
+			file.write(line, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.1f * std::sin(10.0f * u) * std::cos(10.0f * v)));
+			file.write(line, snprintf(line, sizeof(line), "vt %.6f %.6f\n", u, v));
 		}
 	}
 
-	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & memory)
+	for (uint32_t y = 0; y + 1 < size; y++)
 	{
-		VkResult result;
+		for (uint32_t x = 0; x + 1 < size; x++)
+		{
+			uint32_t a = y * size + x + 1;
+			uint32_t b = a + 1;
+			uint32_t c = a + size;
+			uint32_t d = c + 1;
 
-		VkBufferCreateInfo BufferCreateInfo = {
-			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,	// sType
-			nullptr,								// pNext
-			0,										// flags
-			size,									// size
-			usage,									// usage
-			VK_SHARING_MODE_EXCLUSIVE,				// sharingMode
-			0,										// queueFamilyIndexCount
-			nullptr									// pQueueFamilyIndices
-		};
+			file.write(line, snprintf(line, sizeof(line), "f %u/%u %u/%u %u/%u\n", a, a, b, b, d, d));
+			file.write(line, snprintf(line, sizeof(line), "f %u/%u %u/%u %u/%u\n", a, a, d, d, c, c));
+		}
+	}
+}
 
-		result = vkCreateBuffer(device, &BufferCreateInfo, nullptr, &buffer);
+// compares tinyobjloader with ObjParser on the same file and checks that both produce the same mesh
+void RunObjBenchmark(uint32_t size)
+{
+	if (size < 2)
+	{
+		throw std::runtime_error("--bench-obj needs a grid size of at least 2");
+	}
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create buffer");
-		}
+	const std::string path = "bench_synthetic.obj";
+	WriteSyntheticObj(path, size);
 
-		VkMemoryRequirements MemoryRequirements;
-		vkGetBufferMemoryRequirements(device, buffer, &MemoryRequirements);
+	ThreadPool workers;
 
-		uint32_t index = FindMemoryType(MemoryRequirements.memoryTypeBits, properties);
+	auto TinyStart = std::chrono::high_resolution_clock::now();
 
-		VkMemoryAllocateInfo MemoryAllocateInfo = {
-			VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,	// sType
-			nullptr,								// pNext
-			MemoryRequirements.size,				// allocationSize
-			index									// memoryTypeIndex
-		};
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warning;
+	std::string error;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, path.c_str()))
+	{
+		throw std::runtime_error(warning + error);
+	}
 
-		result = vkAllocateMemory(device, &MemoryAllocateInfo, nullptr, &memory);
+	auto TinyEnd = std::chrono::high_resolution_clock::now();
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate buffer memory");
-		}
+	MappedFile source;
 
-		vkBindBufferMemory(device, buffer, memory, 0);
+	if (!source.Open(path))
+	{
+		throw std::runtime_error("failed to open " + path);
 	}
 
-	void CopyBuffer(VkBuffer SrcBuffer, VkBuffer DstBuffer, VkDeviceSize size)
-	{
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
+	auto ParallelStart = std::chrono::high_resolution_clock::now();
 
-		VkBufferCopy region = {
-			0,		// srcOffset
-			0,		// dstOffset
-			size	// size
-		};
+	ObjMesh mesh = ObjParser::Parse(source.GetData(), source.GetSize(), workers);
 
-		vkCmdCopyBuffer(CommandBuffer, SrcBuffer, DstBuffer, 1, &region);
+	auto ParallelEnd = std::chrono::high_resolution_clock::now();
 
-		EndSingleTimeCommands(CommandBuffer);
-	}
+	// the two float parsers may round the last bit differently
+	bool match = attrib.vertices.size() == mesh.positions.size() && attrib.texcoords.size() == mesh.texcoords.size();
 
-	VkCommandBuffer BeginSingleTimeCommands()
+	for (size_t i = 0; match && i < mesh.positions.size(); i++)
 	{
-		VkResult result;
-		VkCommandBuffer CommandBuffer;
+		match = std::abs(attrib.vertices[i] - mesh.positions[i]) <= 1e-6f;
+	}
 
-		VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
-			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,	// sType
-			nullptr,										// pNext
-			CommandPool,									// commandPool
-			VK_COMMAND_BUFFER_LEVEL_PRIMARY,				// level
-			1												// commandBufferCount
-		};
+	for (size_t i = 0; match && i < mesh.texcoords.size(); i++)
+	{
+		match = std::abs(attrib.texcoords[i] - mesh.texcoords[i]) <= 1e-6f;
+	}
 
-		result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, &CommandBuffer);
+	size_t corner = 0;
 
-		if (result != VK_SUCCESS)
+	for (const tinyobj::shape_t& shape : shapes)
+	{
+		for (const tinyobj::index_t& index : shape.mesh.indices)
 		{
-			throw std::runtime_error("failed to allocate command buffers");
+			match = match && corner < mesh.corners.size();
+			match = match && index.vertex_index == mesh.corners[corner].position && index.texcoord_index == mesh.corners[corner].texcoord;
+			corner++;
 		}
+	}
 
-		VkCommandBufferBeginInfo CommandBufferBeginInfo = {
-			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,	// sType
-			nullptr,										// pNext
-			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,	// flags
-			nullptr											// pInheritanceInfo
-		};
+	match = match && corner == mesh.corners.size();
 
-		result = vkBeginCommandBuffer(CommandBuffer, &CommandBufferBeginInfo);
+	double megabytes = source.GetSize() / (1024.0 * 1024.0);
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to begin recording command buffer");
-		}
+	source.Close();
+	std::remove(path.c_str());
+	double TinyTime = std::chrono::duration<double, std::milli>(TinyEnd - TinyStart).count();
+	double ParallelTime = std::chrono::duration<double, std::milli>(ParallelEnd - ParallelStart).count();
 
-		return CommandBuffer;
-	}
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "synthetic OBJ: " << size << " x " << size << " grid, " << mesh.corners.size() / 3 << " triangles, " << megabytes << " MiB" << std::endl;
+	std::cout << "tinyobjloader: " << TinyTime << " ms" << std::endl;
+	std::cout << "ObjParser (" << workers.GetThreadCount() << " threads): " << ParallelTime << " ms, " << TinyTime / ParallelTime << "x" << std::endl;
+	std::cout << "results " << (match ? "match" : "DIFFER") << std::endl;
 
-	void EndSingleTimeCommands(VkCommandBuffer CommandBuffer)
+	if (!match)
 	{
-		vkEndCommandBuffer(CommandBuffer);
+		throw std::runtime_error("ObjParser and tinyobjloader disagree on the synthetic OBJ");
+	}
+}
 
-		VkSubmitInfo SubmitInfo = {
-			VK_STRUCTURE_TYPE_SUBMIT_INFO,	// sType
-			nullptr,						// pNext
-			0,								// waitSemaphoreCount
-			nullptr,						// pWaitSemaphores
-			nullptr,						// pWaitDstStageMask
-			1,								// commandBufferCount
-			&CommandBuffer,					// pCommandBuffers
-			0,								// signalSemaphoreCount
-			nullptr,						// pSignalSemaphores
-		};
+// times the deduplication of a grid mesh expanded to one vertex per triangle corner
+void RunDedupBenchmark(uint32_t size)
+{
+	if (size < 2)
+	{
+		throw std::runtime_error("--bench-dedup needs a grid size of at least 2");
+	}
 
-		VkResult result = vkQueueSubmit(GraphicQueue, 1, &SubmitInfo, VK_NULL_HANDLE);
+	std::vector<Vertex> grid(size * size);
 
-		if (result != VK_SUCCESS)
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
 		{
-			throw std::runtime_error("failed to submit copy command buffer");
-		}
-
-		vkQueueWaitIdle(GraphicQueue);
+			float u = x / static_cast<float>(size - 1);
+			float v = y / static_cast<float>(size - 1);
 
-		vkFreeCommandBuffers(device, CommandPool, 1, &CommandBuffer);
+			grid[y * size + x] = { { u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.1f * std::sin(10.0f * u) * std::cos(10.0f * v) }, { 1.0f, 1.0f, 1.0f }, { u, v } };
+		}
 	}
 
-	uint32_t FindMemoryType(uint32_t TypeFilter, VkMemoryPropertyFlags properties)
-	{
-		VkPhysicalDeviceMemoryProperties MemoryProperties;
-		vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &MemoryProperties);
+	std::vector<Vertex> expanded;
+	expanded.reserve(6 * (size - 1) * (size - 1));
 
-		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount; i++)
+	for (uint32_t y = 0; y + 1 < size; y++)
+	{
+		for (uint32_t x = 0; x + 1 < size; x++)
 		{
-			bool suitable = (MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties;
+			uint32_t a = y * size + x;
+			uint32_t c = a + size;
 
-			if (TypeFilter & (1 << i) && suitable)
+			for (uint32_t corner : { a, a + 1, c + 1, a, c + 1, c })
 			{
-				return i;
+				expanded.push_back(grid[corner]);
 			}
 		}
-
-		throw std::runtime_error("failed to find suitable memory type");
 	}
 
-	void CreateCommandBuffers()
-	{
-		VkResult result;
-
-		CommandBuffers.resize(SwapChainImageViews.size());
+	ThreadPool workers;
 
-		VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
-			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,	// sType
-			nullptr,										// pNext
-			CommandPool,									// commandPool
-			VK_COMMAND_BUFFER_LEVEL_PRIMARY,				// level
-			CommandBuffers.size()							// commandBufferCount
-		};
+	// the loop LoadModel used before, kept as the reference
+	auto MapStart = std::chrono::high_resolution_clock::now();
 
-		result = vkAllocateCommandBuffers(device, &CommandBufferAllocateInfo, CommandBuffers.data());
+	std::unordered_map<Vertex, uint32_t> VertexMap = {};
+	std::vector<Vertex> MapVertices;
+	std::vector<uint32_t> MapIndices;
 
-		if (result != VK_SUCCESS)
+	for (const Vertex& vertex : expanded)
+	{
+		if (VertexMap.count(vertex) == 0)
 		{
-			throw std::runtime_error("failed to allocate command buffers");
+			VertexMap[vertex] = MapVertices.size();
+			MapVertices.push_back(vertex);
 		}
 
-		for (size_t i = 0; i < CommandBuffers.size(); i++)
-		{
-			VkCommandBufferBeginInfo CommandBufferBeginInfo = {
-				VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,	// sType
-				nullptr,										// pNext
-				VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,	// flags
-				nullptr											// pInheritanceInfo
-			};
-
-			result = vkBeginCommandBuffer(CommandBuffers[i], &CommandBufferBeginInfo);
+		MapIndices.push_back(VertexMap[vertex]);
+	}
 
-			if (result != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to begin recording command buffer");
-			}
+	auto MapEnd = std::chrono::high_resolution_clock::now();
 
-			VkRect2D area = {
-				{0, 0},			// offset
-				SwapChainExtent	// extent		
-			};
+	std::vector<Vertex> SerialVertices;
+	std::vector<uint32_t> SerialIndices;
+	VertexDeduplicator::Deduplicate(expanded, SerialVertices, SerialIndices);
 
-			VkClearValue ClearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-			VkClearValue ClearDepthStencil = { 1.0f, 0 };
-			std::vector<VkClearValue> ClearValues = { ClearColor, ClearDepthStencil };
+	auto SerialEnd = std::chrono::high_resolution_clock::now();
 
-			VkRenderPassBeginInfo RenderPassBeginInfo = {
-				VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,	// sType
-				nullptr,									// pNext
-				RenderPass,									// renderPass
-				SwapChainFramebuffers[i],					// framebuffer
-				area,										// renderArea
-				ClearValues.size(),							// clearValueCount
-				ClearValues.data()							// pClearValues
-			};
+	std::vector<Vertex> ParallelVertices;
+	std::vector<uint32_t> ParallelIndices;
+	VertexDeduplicator::DeduplicateParallel(expanded, ParallelVertices, ParallelIndices, workers);
 
-			vkCmdBeginRenderPass(CommandBuffers[i], &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	auto ParallelEnd = std::chrono::high_resolution_clock::now();
 
-			vkCmdBindPipeline(CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
+	bool match = MapIndices == SerialIndices && SerialIndices == ParallelIndices;
+	match = match && MapVertices.size() == SerialVertices.size() && SerialVertices.size() == ParallelVertices.size();
+	match = match && memcmp(SerialVertices.data(), ParallelVertices.data(), SerialVertices.size() * sizeof(Vertex)) == 0;
 
-			std::vector<VkBuffer> VertexBuffers = { VertexBuffer };
-			std::vector<VkDeviceSize> offsets = { 0 };
-			vkCmdBindVertexBuffers(CommandBuffers[i], 0, 1, VertexBuffers.data(), offsets.data());
+	auto rate = [&expanded](std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+	{
+		return expanded.size() / std::chrono::duration<double>(end - start).count() / 1000000.0;
+	};
 
-			VkIndexType IndexType = sizeof(indices.at(0)) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
-			vkCmdBindIndexBuffer(CommandBuffers[i], IndexBuffer, 0, IndexType);
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "synthetic mesh: " << expanded.size() << " indices, " << SerialVertices.size() << " unique vertices" << std::endl;
+	std::cout << "std::unordered_map: " << rate(MapStart, MapEnd) << " M vertices/s" << std::endl;
+	std::cout << "open addressing: " << rate(MapEnd, SerialEnd) << " M vertices/s" << std::endl;
+	std::cout << "sharded (" << workers.GetThreadCount() << " threads): " << rate(SerialEnd, ParallelEnd) << " M vertices/s" << std::endl;
+	std::cout << "results " << (match ? "match" : "DIFFER") << std::endl;
 
-			vkCmdBindDescriptorSets(CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, 0, 1, DescriptorSets.data(), 0, nullptr);
+	if (!match)
+	{
+		throw std::runtime_error("the deduplication methods disagree on the synthetic mesh");
+	}
+}
 
-			// vkCmdDraw(CommandBuffers[i], vertices.size(), 1, 0, 0);
-			vkCmdDrawIndexed(CommandBuffers[i], indices.size(), 1, 0, 0, 0);
+// times the mip chain of a synthetic image with the integer box filter on one thread and with MipGenerator
+void RunMipBenchmark(uint32_t size)
+{
+	if (size < 2)
+	{
+		throw std::runtime_error("--bench-mips needs an image size of at least 2");
+	}
 
-			vkCmdEndRenderPass(CommandBuffers[i]);
+	// smooth gradients with a high frequency checker pattern on top, which shows the kernels apart
+	std::vector<uint8_t> image(static_cast<size_t>(size) * size * 4);
 
-			result = vkEndCommandBuffer(CommandBuffers[i]);
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			uint8_t* texel = &image[(static_cast<size_t>(y) * size + x) * 4];
+			uint8_t checker = ((x / 3 + y / 3) & 1) ? 48 : 0;
 
-			if (result != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to record command buffer");
-			}
+			texel[0] = static_cast<uint8_t>(x * 207 / size + checker);
+			texel[1] = static_cast<uint8_t>(y * 207 / size + checker);
+			texel[2] = static_cast<uint8_t>((x + y) * 103 / size + checker);
+			texel[3] = 255;
 		}
 	}
 
-	void DrawFrame()
-	{
-		vkWaitForFences(device, 1, &fences.at(CurrentFrame), VK_TRUE, std::numeric_limits<uint64_t>::max());
+	uint32_t LevelCount = MipGenerator::GetLevelCount(size, size);
 
-		VkResult result;
+	// level 0 is the image, the smaller levels share one allocation per method
+	std::vector<size_t> starts;
+	size_t ChainSize = 0;
 
-		uint32_t index;
-		result = vkAcquireNextImageKHR(device, SwapChain, std::numeric_limits<uint64_t>::max(), ImageAvailableSemaphore.at(CurrentFrame), VK_NULL_HANDLE, &index);
+	for (uint32_t i = 1; i < LevelCount; i++)
+	{
+		starts.push_back(ChainSize);
+		ChainSize += static_cast<size_t>(std::max(size >> i, 1u)) * std::max(size >> i, 1u) * 4;
+	}
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR)
-		{
-			RecreateSwapchain();
-			return;
-		}
-		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	auto levels = [&](std::vector<uint8_t>& chain)
+	{
+		chain.assign(ChainSize, 0);
+		std::vector<uint8_t*> pointers = { image.data() };
+
+		for (size_t start : starts)
 		{
-			throw std::runtime_error("failed to acquire swap chain image");
+			pointers.push_back(chain.data() + start);
 		}
 
-		std::vector<VkSemaphore> WaitSemaphores = { ImageAvailableSemaphore.at(CurrentFrame) };
-		std::vector<VkPipelineStageFlags> stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		std::vector<VkSemaphore> SignalSemaphores = { RenderFinishedSemaphore.at(CurrentFrame) };
-
-		UpdateUniformBuffer(index);
-
-		VkSubmitInfo SubmitInfo = {
-			VK_STRUCTURE_TYPE_SUBMIT_INFO,	// sType
-			nullptr,						// pNext
-			1,								// waitSemaphoreCount
-			WaitSemaphores.data(),			// pWaitSemaphores
-			stages.data(),					// pWaitDstStageMask
-			1,								// commandBufferCount
-			&CommandBuffers.at(index),		// pCommandBuffers
-			1,								// signalSemaphoreCount
-			SignalSemaphores.data()			// pSignalSemaphores
-		};
+		return pointers;
+	};
 
-		vkResetFences(device, 1, &fences.at(CurrentFrame));
+	auto milliseconds = [](std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
 
-		result = vkQueueSubmit(GraphicQueue, 1, &SubmitInfo, fences.at(CurrentFrame));
+	ThreadPool workers;
 
-		if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to submit draw command buffer");
-		}
+	std::vector<uint8_t> reference;
+	std::vector<uint8_t*> ReferenceLevels = levels(reference);
 
-		std::vector<VkSwapchainKHR> swapchains = { SwapChain };
+	auto start = std::chrono::high_resolution_clock::now();
 
-		VkPresentInfoKHR PresentInfo = {
-			VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,	// sType
-			nullptr,							// pNext
-			1,									// waitSemaphoreCount
-			SignalSemaphores.data(),			// pWaitSemaphores
-			1,									// swapchainCount
-			swapchains.data(),					// pSwapchains
-			&index,								// pImageIndices
-			nullptr								// pResults
-		};
+	for (uint32_t i = 1; i < LevelCount; i++)
+	{
+		MipGenerator::DownsampleBox(ReferenceLevels[i - 1], std::max(size >> (i - 1), 1u), std::max(size >> (i - 1), 1u), ReferenceLevels[i]);
+	}
 
-		result = vkQueuePresentKHR(PresentQueue, &PresentInfo);
+	double ReferenceTime = milliseconds(start);
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || FramebufferResized)
-		{
-			FramebufferResized = false;
-			RecreateSwapchain();
-		}
-		else if (result != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to present swap chain image");
-		}
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "synthetic image: " << size << " x " << size << ", " << LevelCount << " levels" << std::endl;
+	std::cout << "integer box (1 thread): " << ReferenceTime << " ms" << std::endl;
 
-		CurrentFrame = (CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-	}
+	bool match = true;
 
-	void CreateSemaphoresAndFences()
+	for (int filter = 0; filter < 3; filter++)
 	{
-		ImageAvailableSemaphore.resize(MAX_FRAMES_IN_FLIGHT);
-		RenderFinishedSemaphore.resize(MAX_FRAMES_IN_FLIGHT);
-		fences.resize(MAX_FRAMES_IN_FLIGHT);
+		for (bool srgb : { false, true })
+		{
+			MipGenerator generator(static_cast<MipFilter>(filter), srgb);
 
-		VkSemaphoreCreateInfo SemaphoreCreateInfo = {
-			VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,	// sType
-			nullptr,									// pNext
-			0											// flags
-		};
+			std::vector<uint8_t> chain;
+			std::vector<uint8_t*> pointers = levels(chain);
 
-		VkFenceCreateInfo FenceCreateInfo = {
-			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,	// sType
-			nullptr,								// pNext
-			VK_FENCE_CREATE_SIGNALED_BIT			// flags
-		};
+			start = std::chrono::high_resolution_clock::now();
+			generator.Generate(pointers, size, size, workers);
+			double time = milliseconds(start);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			VkResult ImageAvailableResult = vkCreateSemaphore(device, &SemaphoreCreateInfo, nullptr, &ImageAvailableSemaphore.at(i));
-			VkResult RenderFinishedResult = vkCreateSemaphore(device, &SemaphoreCreateInfo, nullptr, &RenderFinishedSemaphore.at(i));
-			VkResult FenceResult = vkCreateFence(device, &FenceCreateInfo, nullptr, &fences.at(i));
+			std::cout << MipFilterNames[filter] << (srgb ? " srgb" : "") << " (" << workers.GetThreadCount() << " threads): " << time << " ms, " << ReferenceTime / time << "x" << std::endl;
 
-			if (ImageAvailableResult || RenderFinishedResult || FenceResult)
+			if (filter == static_cast<int>(MipFilter::box) && !srgb)
 			{
-				throw std::runtime_error("failed to create synchronization objects for a frame");
+				match = chain == reference;
 			}
 		}
 	}
 
-	void MainLoop()
-	{
-		while (!glfwWindowShouldClose(window))
-		{
-			glfwPollEvents();
-			DrawFrame();
-		}
+	std::cout << "box results " << (match ? "match" : "DIFFER") << std::endl;
 
-		vkDeviceWaitIdle(device);
+	if (!match)
+	{
+		throw std::runtime_error("MipGenerator and the integer box filter disagree on the synthetic image");
 	}
+}
 
-	void cleanup()
+// times decoding the texture count times the way a scene with many textures would load them, one at a time through
+// stb_image's own buffer and copied out, and as one batch on the thread pool straight into the destinations
+void RunDecodeBenchmark(uint32_t count)
+{
+	const std::string path = "textures/chalet.jpg";
+
+	MappedFile source;
+
+	if (!source.Open(path))
 	{
-		CleanupSwapchain();
+		throw std::runtime_error("failed to open " + path);
+	}
 
-		vkDestroySampler(device, TextureSampler, nullptr);
-		vkDestroyImageView(device, TextureImageView, nullptr);
-		vkDestroyImage(device, TextureImage, nullptr);
-		vkFreeMemory(device, TextureImageMemory, nullptr);
+	std::vector<ImageDecodeJob> jobs(count, { source.GetData(), source.GetSize(), nullptr });
 
-		vkDestroyDescriptorSetLayout(device, DescriptorSetLayout, nullptr);
+	if (!ImageDecoder::ReadInfo(jobs[0]))
+	{
+		throw std::runtime_error("failed to read the header of " + path);
+	}
 
-		vkDestroyBuffer(device, IndexBuffer, nullptr);
-		vkFreeMemory(device, IndexBufferMemory, nullptr);
+	size_t size = ImageDecoder::GetSize(jobs[0].width, jobs[0].height);
+	size_t PixelBytes = size - 1;
 
-		vkDestroyBuffer(device, VertexBuffer, nullptr);
-		vkFreeMemory(device, VertexBufferMemory, nullptr);
+	// one destination per image, as the staging memory of a batch upload would be
+	std::vector<uint8_t> destinations(size * count);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			vkDestroyFence(device, fences.at(i), nullptr);
-			vkDestroySemaphore(device, RenderFinishedSemaphore.at(i), nullptr);
-			vkDestroySemaphore(device, ImageAvailableSemaphore.at(i), nullptr);
-		}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		jobs[i].width = jobs[0].width;
+		jobs[i].height = jobs[0].height;
+		jobs[i].destination = destinations.data() + size * i;
+	}
 
-		vkDestroyCommandPool(device, CommandPool, nullptr);
+	auto milliseconds = [](std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
 
-		// device VkQueue are implicitly cleaned up when the VkDevice is destroyed
+	auto start = std::chrono::high_resolution_clock::now();
 
-		vkDestroyDevice(device, nullptr);
+	for (ImageDecodeJob& job : jobs)
+	{
+		int width;
+		int height;
+		int channels;
 
-		// VkPhysicalDevice are implicitly destroyed when VkInstance is destroyed
+		stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(job.data), static_cast<int>(job.size), &width, &height, &channels, STBI_rgb_alpha);
 
-		if (EnableValidationLayer)
+		if (pixels == nullptr)
 		{
-			vkDestroyDebugUtilsMessengerEXT(instance, messenger, nullptr);
+			throw std::runtime_error("failed to decode " + path);
 		}
 
-		vkDestroySurfaceKHR(instance, surface, nullptr);
-		vkDestroyInstance(instance, nullptr);
-
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		memcpy(job.destination, pixels, PixelBytes);
+		stbi_image_free(pixels);
 	}
 
-	void CleanupSwapchain()
-	{
-		vkDestroyImageView(device, ColorImageView, nullptr);
-		vkDestroyImage(device, ColorImage, nullptr);
-		vkFreeMemory(device, ColorImageMemory, nullptr);
+	double ReferenceTime = milliseconds(start);
+	std::vector<uint8_t> reference(destinations.begin(), destinations.begin() + PixelBytes);
 
-		vkDestroyImageView(device, DepthImageView, nullptr);
-		vkDestroyImage(device, DepthImage, nullptr);
-		vkFreeMemory(device, DepthImageMemory, nullptr);
+	std::fill(destinations.begin(), destinations.end(), 0);
 
-		for (VkFramebuffer framebuffer : SwapChainFramebuffers)
-		{
-			vkDestroyFramebuffer(device, framebuffer, nullptr);
-		}
+	ThreadPool workers;
 
-		// command buffers are automatically freed when their command pool is destroyed
+	start = std::chrono::high_resolution_clock::now();
+	ImageDecoder::Decode(jobs, workers);
+	double time = milliseconds(start);
 
-		// we clean up the existing command buffers and reuse the existing pool to allocate the new command buffers
-		vkFreeCommandBuffers(device, CommandPool, CommandBuffers.size(), CommandBuffers.data());
+	size_t direct = 0;
+	bool match = true;
 
-		vkDestroyPipeline(device, GraphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(device, PipelineLayout, nullptr);
-		vkDestroyRenderPass(device, RenderPass, nullptr);
+	for (const ImageDecodeJob& job : jobs)
+	{
+		direct += job.direct;
+		match = match && job.decoded && memcmp(job.destination, reference.data(), PixelBytes) == 0;
+	}
 
-		for (VkImageView view : SwapChainImageViews)
-		{
-			vkDestroyImageView(device, view, nullptr);
-		}
+	auto rate = [&](double time) { return count * PixelBytes / (time * 1000.0); };
 
-		// swap chain images are automatically cleaned up once the swap chain is destroyed
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << path << ": " << jobs[0].width << " x " << jobs[0].height << ", decoded " << count << " times" << std::endl;
+	std::cout << "one at a time, copied: " << ReferenceTime << " ms, " << rate(ReferenceTime) << " MB/s" << std::endl;
+	std::cout << "batch (" << workers.GetThreadCount() << " threads): " << time << " ms, " << rate(time) << " MB/s, " << ReferenceTime / time << "x, " << direct << " decoded in place" << std::endl;
+	std::cout << "results " << (match ? "match" : "DIFFER") << std::endl;
+
+	if (!match)
+	{
+		throw std::runtime_error("ImageDecoder and stb_image disagree on " + path);
+	}
+}
 
-		vkDestroySwapchainKHR(device, SwapChain, nullptr);
+int main(int argc, char* argv[])
+{
+	try
+	{
+		ApplicationOptions options = ParseOptions(argc, argv);
 
-		for (size_t i = 0; i < SwapChainImages.size(); i++)
+		if (options.BenchObj != 0)
 		{
-			vkDestroyBuffer(device, UniformBuffers[i], nullptr);
-			vkFreeMemory(device, UniformBuffersMemory[i], nullptr);
+			RunObjBenchmark(options.BenchObj);
+			return EXIT_SUCCESS;
 		}
 
-		// descriptor sets are automatically freed when the descriptor pool is destroyed
+		if (options.BenchDedup != 0)
+		{
+			RunDedupBenchmark(options.BenchDedup);
+			return EXIT_SUCCESS;
+		}
 
-		vkDestroyDescriptorPool(device, DescriptorPool, nullptr);
-	}
-};
+		if (options.BenchMips != 0)
+		{
+			RunMipBenchmark(options.BenchMips);
+			return EXIT_SUCCESS;
+		}
 
-int main()
-{
-	VulkanApplication app;
+		if (options.BenchDecode != 0)
+		{
+			RunDecodeBenchmark(options.BenchDecode);
+			return EXIT_SUCCESS;
+		}
 
-	try
-	{
-		app.run();
+		if (options.quantize)
+		{
+			VulkanApplication<QuantizedVertex> app(options);
+			app.run();
+		}
+		else
+		{
+			VulkanApplication<Vertex> app(options);
+			app.run();
+		}
 	}
 	catch (const std::exception & exc)
 	{
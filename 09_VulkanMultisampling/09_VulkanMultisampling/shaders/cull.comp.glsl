@@ -0,0 +1,110 @@
+#version 450
+
+// one invocation per instance and chunk, at the level of detail selected for the instance
+layout(local_size_x = 64) in;
+
+layout(binding = 0) uniform UniformBufferObject
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	vec4 TexCoordTransform;
+	vec4 planes[6];
+	vec4 camera;
+	vec4 bounds;
+	vec4 LevelErrors[2];
+	uvec4 LevelChunks[2];
+	uint LevelCount;
+	uint ChunkCount;
+	uint InstanceCount;
+	float LodThreshold;
+} ubo;
+
+struct Chunk
+{
+	vec4 minimum;
+	vec4 maximum;
+	uint FirstIndex;
+	uint IndexCount;
+	int VertexOffset;
+	uint material;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint material;
+};
+
+layout(std430, binding = 1) readonly buffer Chunks
+{
+	Chunk chunks[];
+};
+
+layout(std430, binding = 2) readonly buffer Instances
+{
+	mat4 transforms[];
+};
+
+// the count is padded to 16 bytes so the draws start where vkCmdDrawIndexedIndirectCount reads them
+layout(std430, binding = 3) buffer Draws
+{
+	uint DrawCount;
+	uint padding[3];
+	DrawCommand draws[];
+};
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+
+	if (id >= ubo.ChunkCount * ubo.InstanceCount)
+	{
+		return;
+	}
+
+	uint instance = id / ubo.ChunkCount;
+	mat4 transform = transforms[instance];
+
+	// the coarsest level whose error projects to at most the threshold, the same choice SelectLevel makes on the CPU
+	vec3 origin = (transform * vec4(ubo.bounds.xyz, 1.0)).xyz;
+	float distance = length(origin - ubo.camera.xyz) - ubo.bounds.w;
+	uint level = 0;
+
+	if (distance > 0.0)
+	{
+		while (level + 1 < ubo.LevelCount && ubo.LevelErrors[(level + 1) / 4][(level + 1) % 4] * ubo.camera.w / distance <= ubo.LodThreshold)
+		{
+			level++;
+		}
+	}
+
+	Chunk chunk = chunks[ubo.LevelChunks[level / 4][level % 4] + id % ubo.ChunkCount];
+
+	if (chunk.IndexCount == 0)
+	{
+		return;
+	}
+
+	// the world space box around the transformed chunk box
+	vec3 center = (transform * vec4((chunk.minimum.xyz + chunk.maximum.xyz) * 0.5, 1.0)).xyz;
+	vec3 extent = (chunk.maximum.xyz - chunk.minimum.xyz) * 0.5;
+	extent = abs(transform[0].xyz) * extent.x + abs(transform[1].xyz) * extent.y + abs(transform[2].xyz) * extent.z;
+
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = ubo.planes[i];
+
+		if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0)
+		{
+			return;
+		}
+	}
+
+	uint slot = atomicAdd(DrawCount, 1);
+	draws[slot] = DrawCommand(chunk.IndexCount, 1, chunk.FirstIndex, chunk.VertexOffset, instance, chunk.material);
+}
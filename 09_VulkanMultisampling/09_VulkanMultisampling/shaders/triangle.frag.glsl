@@ -1,17 +1,53 @@
 #version 450
 
+// SINGLE_TEXTURE builds the variant for devices without descriptor indexing, the set holds the streamed texture alone
+#ifndef SINGLE_TEXTURE
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout(location = 0) in vec3 InColor;
 layout(location = 1) in vec2 InTexCoord;
+layout(location = 2) flat in uint InMaterial;
+
+struct Material
+{
+	vec4 diffuse;
+	uint texture;
+	uint padding[3];
+};
+
+// the texture slot of a material without a diffuse map
+const uint NoTexture = 0xffffffffu;
 
-layout(binding = 1) uniform sampler2D TexSampler;
+layout(std430, binding = 2) readonly buffer Materials
+{
+	Material materials[];
+};
+
+// slot 0 is the streamed texture, the material maps follow
+#ifdef SINGLE_TEXTURE
+layout(binding = 3) uniform sampler2D textures[1];
+#else
+layout(binding = 3) uniform sampler2D textures[];
+#endif
 
 layout(location = 0) out vec4 OutColor;
 
 void main()
 {
+	Material material = materials[InMaterial];
+
 	// OutColor = vec4(InColor, 1.0);
 	// OutColor = vec4(InTexCoord, 0.0, 1.0);
-	OutColor = texture(TexSampler, InTexCoord);
-	// OutColor = texture(TexSampler, InTexCoord * 2.0);
-	// OutColor = vec4(InColor * texture(TexSampler, InTexCoord).rgb, 1.0);
+	OutColor = material.diffuse;
+
+	// the material can change within a subgroup where draws meet, so the index is marked non uniform
+	if (material.texture != NoTexture)
+	{
+#ifdef SINGLE_TEXTURE
+		OutColor *= texture(textures[0], InTexCoord);
+#else
+		OutColor *= texture(textures[nonuniformEXT(material.texture)], InTexCoord);
+#endif
+	}
 }
\ No newline at end of file
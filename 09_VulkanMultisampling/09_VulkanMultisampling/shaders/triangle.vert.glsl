@@ -1,11 +1,20 @@
 #version 450
 
+// SINGLE_TEXTURE builds the variant for devices without descriptor indexing, every draw uses material 0
+#ifndef SINGLE_TEXTURE
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
 layout(location = 0) in vec3 VertPosition;
 layout(location = 1) in vec3 VertColor;
 layout(location = 2) in vec2 VertTexCoord;
 
+// per instance placement from the second vertex binding, one location per column
+layout(location = 3) in mat4 InstanceTransform;
+
 layout(location = 0) out vec3 FragColor;
 layout(location = 1) out vec2 FragTexCoord;
+layout(location = 2) flat out uint FragMaterial;
 
 layout(binding = 0) uniform UniformBufferObject
 {
@@ -14,11 +23,40 @@ layout(binding = 0) uniform UniformBufferObject
 	mat4 proj;
 } ubo;
 
+struct DrawRecord
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint material;
+};
+
+// the frame's indirect slice, the draws start after the count the culling pass writes
+layout(std430, binding = 1) readonly buffer Draws
+{
+	uint DrawCount;
+	uint padding[3];
+	DrawRecord draws[];
+};
+
+// the record of the first draw of the indirect call
+layout(push_constant) uniform PushConstants
+{
+	uint DrawBase;
+} pc;
+
 void main()
 {
-	mat4 MVP = ubo.proj * ubo.view * ubo.model;
+	mat4 MVP = ubo.proj * ubo.view * InstanceTransform * ubo.model;
     gl_Position = MVP * vec4(VertPosition, 1.0);
 
 	FragColor = VertColor;
 	FragTexCoord = VertTexCoord;
+#ifdef SINGLE_TEXTURE
+	FragMaterial = 0u;
+#else
+	FragMaterial = draws[pc.DrawBase + gl_DrawIDARB].material;
+#endif
 }
\ No newline at end of file